@@ -0,0 +1,239 @@
+// Big Mouth Phatt Bass timing benchmark
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Separate firmware ("pio run -e benchmark -t upload") that measures how accurately the sleep and
+// wait primitives hit the times they are asked for, and how long the mouth movement cycles used by
+// the choreography really take. Connect the motors or not, as you like.
+//
+// Results are printed over serial as CSV, one line per primitive and interval, all prefixed with
+// "BENCH," so they can be picked out of the log and compared between firmware versions:
+//
+//   BENCH,<benchmark>,<interval ms>,<samples>,<min ns>,<p50 ns>,<p99 ns>,<max ns>
+//
+// Percentiles are nearest-rank, i.e. the p99 is the 99th of 100 samples sorted. Benchmarks of 3 s or
+// more take fewer samples to keep the run time down, so their p99 is simply the maximum.
+//
+// The flapMouthFor benchmarks are named with their flap interval, and give their runtime as the
+// interval. Each figure is the error: how much longer than requested the wait or cycle took, in nanos.
+// Awake waits are timed with the CPU cycle counter. The cycle counter stops in light sleep, so light
+// sleep is timed with the microsecond timer instead, which keeps running.
+//
+// The motor switching benchmarks time reversing both motors at once, with an interval of 0, so the
+// figures are simply how long it took: "digitalWrite" with a digitalWrite() per direction pin, as
+// the motors used to be switched, "motorPins" with the GPIO register writes that replaced them, and
+// "actuatorFrame" for a whole commitActuatorFrame(), including setting the PWM duties.
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "choreography.h"
+#include "motors.h"
+#include "timing.h"
+
+#define BENCHMARK_SAMPLES 100 // Measurements of each primitive at each interval
+#define BENCHMARK_LONG_SAMPLES 20 // Measurements of benchmarks that take BENCHMARK_LONG_MILLIS or more
+#define BENCHMARK_LONG_MILLIS 3000
+#define BENCHMARK_SETTLE_MILLIS 20 // Pause between measurements, so one doesn't start straight out of the last
+
+// Intervals to test, covering the sleeps used in the choreography scripts
+const uint32_t benchmarkIntervalsMs[] = { 1, 10, 50, 100, 200, 500, 1000, 3000 };
+
+// Common mouthOpenFor durations, and flapMouthFor runtimes and intervals, from the scripts
+const uint32_t mouthOpenForMs[] = { 200, 300, 500, 1000, 1500 };
+const uint32_t flapMouthForMs[][2] = { { 900, 150 }, { 1400, 175 }, { 1200, 300 }, { 3500, 250 } };
+
+typedef int64_t (*BenchmarkFunction)(uint32_t intervalMs);
+
+void runBenchmark(const char *name, BenchmarkFunction function, uint32_t intervalMs);
+int64_t cyclesToNs(uint32_t cycles);
+int64_t timeLightSleep(uint32_t intervalMs);
+int64_t timeDelay(uint32_t intervalMs);
+int64_t timeVTaskDelay(uint32_t intervalMs);
+int64_t timeBusyWait(uint32_t intervalMs);
+int64_t timeSleepUntil(uint32_t intervalMs);
+int64_t timeMouthOpenFor(uint32_t durationMs);
+int64_t timeFlapMouthFor(uint32_t index);
+int64_t timeDigitalWrite(uint32_t unused);
+int64_t timeMotorPins(uint32_t unused);
+int64_t timeActuatorFrame(uint32_t unused);
+
+void setup() {
+  Serial.begin(SERIAL_BAUD_RATE);
+  setupTiming();
+  setupMotors();
+  delay(1000);
+
+  Serial.printf("BENCH_INFO,cpu_mhz,%u\n", (unsigned) getCpuFrequencyMhz());
+  Serial.printf("BENCH_INFO,sdk,%s\n", ESP.getSdkVersion());
+  Serial.printf("BENCH_INFO,built,%s %s\n", __DATE__, __TIME__);
+  Serial.printf("BENCH_INFO,light_sleep_overhead_us,%d\n", (int) getSleepStats().lightSleepOverheadUs);
+  Serial.println("BENCH,benchmark,interval_ms,samples,min_ns,p50_ns,p99_ns,max_ns");
+
+  for (uint32_t intervalMs : benchmarkIntervalsMs) {
+    runBenchmark("lightSleep", timeLightSleep, intervalMs);
+    runBenchmark("delay", timeDelay, intervalMs);
+    runBenchmark("vTaskDelay", timeVTaskDelay, intervalMs);
+    runBenchmark("busyWait", timeBusyWait, intervalMs);
+    runBenchmark("sleepUntil", timeSleepUntil, intervalMs);
+  }
+
+  // Movement cycles run as they do in a performance, with light sleep inhibited
+  inhibitLightSleep();
+  for (uint32_t durationMs : mouthOpenForMs) {
+    runBenchmark("mouthOpenFor", timeMouthOpenFor, durationMs);
+  }
+  char name[32];
+  for (uint32_t i = 0; i < sizeof(flapMouthForMs) / sizeof(flapMouthForMs[0]); i++) {
+    snprintf(name, sizeof(name), "flapMouthFor/%u", (unsigned) flapMouthForMs[i][1]);
+    runBenchmark(name, timeFlapMouthFor, i);
+  }
+  mouthRest(); // The switching benchmarks start and end with every pin low
+  runBenchmark("digitalWrite", timeDigitalWrite, 0);
+  runBenchmark("motorPins", timeMotorPins, 0);
+  runBenchmark("actuatorFrame", timeActuatorFrame, 0);
+  releaseLightSleep();
+  headTailRest();
+  mouthRest();
+
+  Serial.println("BENCH_DONE");
+}
+
+void loop() {
+  vTaskDelete(NULL);
+}
+
+// Measure a primitive BENCHMARK_SAMPLES times, or BENCHMARK_LONG_SAMPLES if it takes a long time,
+// and print the spread of its errors. For the flap benchmark, intervalMs is an index into
+// flapMouthForMs, and the runtime is printed instead.
+void runBenchmark(const char *name, BenchmarkFunction function, uint32_t intervalMs) {
+  uint32_t reportedMs = function == timeFlapMouthFor ? flapMouthForMs[intervalMs][0] : intervalMs;
+  int samples = reportedMs >= BENCHMARK_LONG_MILLIS ? BENCHMARK_LONG_SAMPLES : BENCHMARK_SAMPLES;
+  int64_t errorsNs[BENCHMARK_SAMPLES];
+  for (int i = 0; i < samples; i++) {
+    delay(BENCHMARK_SETTLE_MILLIS);
+    errorsNs[i] = function(intervalMs);
+  }
+  std::sort(errorsNs, errorsNs + samples);
+  // Nearest-rank percentiles, see the top of this file
+  int p50 = (samples * 50 + 99) / 100 - 1;
+  int p99 = (samples * 99 + 99) / 100 - 1;
+
+  Serial.printf("BENCH,%s,%u,%d,%lld,%lld,%lld,%lld\n", name, (unsigned) reportedMs, samples,
+      (long long) errorsNs[0], (long long) errorsNs[p50], (long long) errorsNs[p99],
+      (long long) errorsNs[samples - 1]);
+  // The UART stops in light sleep, so make sure the line has gone before the next benchmark
+  Serial.flush();
+}
+
+// Convert a cycle count to nanos. The counter is 32 bits, so wraps after about 17 s at 240 MHz.
+int64_t cyclesToNs(uint32_t cycles) {
+  return cycles * 1000LL / getCpuFrequencyMhz();
+}
+
+int64_t timeLightSleep(uint32_t intervalMs) {
+  int64_t startUs = esp_timer_get_time();
+  lightSleep(intervalMs);
+  return (esp_timer_get_time() - startUs - intervalMs * 1000LL) * 1000;
+}
+
+int64_t timeDelay(uint32_t intervalMs) {
+  uint32_t start = ESP.getCycleCount();
+  delay(intervalMs);
+  return cyclesToNs(ESP.getCycleCount() - start) - intervalMs * 1000000LL;
+}
+
+int64_t timeVTaskDelay(uint32_t intervalMs) {
+  uint32_t start = ESP.getCycleCount();
+  vTaskDelay(pdMS_TO_TICKS(intervalMs));
+  return cyclesToNs(ESP.getCycleCount() - start) - intervalMs * 1000000LL;
+}
+
+// A busy wait on the microsecond timer, as waitUntil() used to end with before spinning on the
+// cycle counter
+int64_t timeBusyWait(uint32_t intervalMs) {
+  uint32_t start = ESP.getCycleCount();
+  int64_t deadlineUs = timeNowUs() + intervalMs * 1000LL;
+  while (timeNowUs() < deadlineUs);
+  return cyclesToNs(ESP.getCycleCount() - start) - intervalMs * 1000000LL;
+}
+
+// sleepUntil() with light sleep inhibited, as it runs in a performance
+int64_t timeSleepUntil(uint32_t intervalMs) {
+  inhibitLightSleep();
+  uint32_t start = ESP.getCycleCount();
+  sleepUntil(timeNowUs() + intervalMs * 1000LL);
+  int64_t errorNs = cyclesToNs(ESP.getCycleCount() - start) - intervalMs * 1000000LL;
+  releaseLightSleep();
+  return errorNs;
+}
+
+// A choreography "mouthOpenFor": open, wait, close. Timed until the mouth has been told to close.
+int64_t timeMouthOpenFor(uint32_t durationMs) {
+  uint32_t start = ESP.getCycleCount();
+  int64_t epochUs = timeNowUs();
+  mouthOpen();
+  sleepUntil(epochUs + durationMs * 1000LL);
+  mouthClose();
+  return cyclesToNs(ESP.getCycleCount() - start) - durationMs * 1000000LL;
+}
+
+// A choreography "flapMouthFor", with each movement scheduled from the start as playChoreography()
+// does. Timed until the last close, which is how long the script expects it to take.
+int64_t timeFlapMouthFor(uint32_t index) {
+  uint32_t runtimeMs = flapMouthForMs[index][0];
+  uint32_t intervalMs = flapMouthForMs[index][1];
+  int flaps = runtimeMs / intervalMs / 2;
+  uint32_t start = ESP.getCycleCount();
+  int64_t epochUs = timeNowUs();
+  for (int i = 0; i < flaps; i++) {
+    sleepUntil(epochUs + 2 * i * intervalMs * 1000LL);
+    mouthOpen();
+    sleepUntil(epochUs + (2 * i + 1) * intervalMs * 1000LL);
+    mouthClose();
+  }
+  sleepUntil(epochUs + 2 * flaps * intervalMs * 1000LL);
+  return cyclesToNs(ESP.getCycleCount() - start) - 2LL * flaps * intervalMs * 1000000LL;
+}
+
+// Reverse both motors with a digitalWrite() per pin, in the order the old headOut() and mouthOpen()
+// wrote them. The pins are left as they started, so the register benchmarks aren't thrown off.
+int64_t timeDigitalWrite(uint32_t unused) {
+  static bool out = false;
+  out = !out;
+  uint32_t start = ESP.getCycleCount();
+  digitalWrite(HEADTAIL_MOTOR_PIN_1, out ? LOW : HIGH);
+  digitalWrite(HEADTAIL_MOTOR_PIN_2, out ? HIGH : LOW);
+  digitalWrite(MOUTH_MOTOR_PIN_1, out ? LOW : HIGH);
+  digitalWrite(MOUTH_MOTOR_PIN_2, out ? HIGH : LOW);
+  int64_t ns = cyclesToNs(ESP.getCycleCount() - start);
+  digitalWrite(HEADTAIL_MOTOR_PIN_1, LOW);
+  digitalWrite(HEADTAIL_MOTOR_PIN_2, LOW);
+  digitalWrite(MOUTH_MOTOR_PIN_1, LOW);
+  digitalWrite(MOUTH_MOTOR_PIN_2, LOW);
+  return ns;
+}
+
+// Reverse both motors with one clear and one set register write
+int64_t timeMotorPins(uint32_t unused) {
+  static bool out = false;
+  out = !out;
+  uint32_t outPins = (1UL << HEADTAIL_MOTOR_PIN_2) | (1UL << MOUTH_MOTOR_PIN_2);
+  uint32_t inPins = (1UL << HEADTAIL_MOTOR_PIN_1) | (1UL << MOUTH_MOTOR_PIN_1);
+  uint32_t start = ESP.getCycleCount();
+  writeMotorPins(out ? outPins : inPins, out ? inPins : outPins);
+  int64_t ns = cyclesToNs(ESP.getCycleCount() - start);
+  writeMotorPins(0, outPins | inPins);
+  return ns;
+}
+
+// Reverse both motors with a whole frame, as a performance does
+int64_t timeActuatorFrame(uint32_t unused) {
+  static bool out = false;
+  out = !out;
+  ActuatorFrame frame = getActuatorFrame();
+  frame.headTail = out ? CHOREOGRAPHY_ACTION_HEAD_OUT : CHOREOGRAPHY_ACTION_TAIL_OUT;
+  frame.mouth = out ? CHOREOGRAPHY_ACTION_MOUTH_OPEN : CHOREOGRAPHY_ACTION_MOUTH_CLOSE;
+  uint32_t start = ESP.getCycleCount();
+  commitActuatorFrame(frame);
+  return cyclesToNs(ESP.getCycleCount() - start);
+}
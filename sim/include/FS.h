@@ -0,0 +1,48 @@
+// Big Mouth Phatt Bass simulator: mock Arduino filesystem, backed by files on the PC
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+namespace fs {
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(FILE *f) : handle(f, fclose) {}
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *buffer, size_t size);
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const { return handle != nullptr; }
+
+private:
+  std::shared_ptr<FILE> handle;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = "r", bool create = false);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *from, const char *to);
+  bool mkdir(const char *path);
+
+protected:
+  std::string hostPath(const char *path) const;
+  std::string root;
+};
+
+}
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,18 @@
+// Big Mouth Phatt Bass simulator: mock LittleFS
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Reads and writes a folder on the PC, normally the "data" folder that would be uploaded to the
+// flash partition.
+
+#pragma once
+
+#include "FS.h"
+
+class LittleFSFS : public fs::FS {
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+      const char *partitionLabel = "spiffs");
+  void setRoot(const std::string &path) { root = path; }
+};
+
+extern LittleFSFS LittleFS;
@@ -0,0 +1,24 @@
+// Big Mouth Phatt Bass simulator: mock NVS preferences
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Kept in memory for the length of the run, so every simulation starts from the defaults.
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  uint16_t getUShort(const char *key, uint16_t defaultValue = 0);
+  size_t putUShort(const char *key, uint16_t value);
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buffer, size_t maxLength);
+  size_t putBytes(const char *key, const void *value, size_t length);
+
+private:
+  std::string space;
+};
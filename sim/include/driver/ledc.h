@@ -0,0 +1,33 @@
+// Big Mouth Phatt Bass simulator: mock LEDC PWM driver. Duty changes and fades do nothing.
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+  LEDC_HIGH_SPEED_MODE,
+  LEDC_LOW_SPEED_MODE,
+} ledc_mode_t;
+
+typedef enum {
+  LEDC_CHANNEL_0,
+  LEDC_CHANNEL_1,
+  LEDC_CHANNEL_2,
+  LEDC_CHANNEL_3,
+  LEDC_CHANNEL_4,
+  LEDC_CHANNEL_5,
+  LEDC_CHANNEL_6,
+  LEDC_CHANNEL_7,
+} ledc_channel_t;
+
+typedef enum {
+  LEDC_FADE_NO_WAIT,
+  LEDC_FADE_WAIT_DONE,
+} ledc_fade_mode_t;
+
+esp_err_t ledc_fade_func_install(int intrAllocFlags);
+esp_err_t ledc_set_duty_and_update(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint);
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t targetDuty, int maxFadeTimeMs);
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fadeMode);
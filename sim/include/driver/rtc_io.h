@@ -0,0 +1,11 @@
+// Big Mouth Phatt Bass simulator: mock RTC GPIO driver
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+esp_err_t rtc_gpio_deinit(gpio_num_t pin);
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin);
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin);
@@ -0,0 +1,12 @@
+// Big Mouth Phatt Bass simulator: mock UART driver
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include "esp_err.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0 0
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uartNum, int wakeupThreshold);
@@ -0,0 +1,43 @@
+// Big Mouth Phatt Bass simulator: mock ULP coprocessor
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Programs compile but never run, and loading one fails, so the firmware falls back to polling
+// the LDR.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+  uint32_t instruction;
+} ulp_insn_t;
+
+enum { R0, R1, R2, R3 };
+
+extern uint32_t simRtcSlowMem[];
+#define RTC_SLOW_MEM simRtcSlowMem
+
+#define SIM_ULP_INSN ulp_insn_t{0}
+#define I_MOVI(reg_dest, imm) SIM_ULP_INSN
+#define I_ADC(reg_dest, adc_idx, pad_idx) SIM_ULP_INSN
+#define I_ADDR(reg_dest, reg_src1, reg_src2) SIM_ULP_INSN
+#define I_SUBR(reg_dest, reg_src1, reg_src2) SIM_ULP_INSN
+#define I_ADDI(reg_dest, reg_src, imm) SIM_ULP_INSN
+#define I_RSHI(reg_dest, reg_src, imm) SIM_ULP_INSN
+#define I_LSHI(reg_dest, reg_src, imm) SIM_ULP_INSN
+#define I_ST(reg_val, reg_addr, offset) SIM_ULP_INSN
+#define I_LD(reg_dest, reg_addr, offset) SIM_ULP_INSN
+#define I_HALT() SIM_ULP_INSN
+#define I_WAKE() SIM_ULP_INSN
+#define I_END() SIM_ULP_INSN
+#define M_LABEL(label_num) SIM_ULP_INSN
+#define M_BX(label_num) SIM_ULP_INSN
+#define M_BXF(label_num) SIM_ULP_INSN
+#define M_BGE(label_num, imm) SIM_ULP_INSN
+#define M_BL(label_num, imm) SIM_ULP_INSN
+
+esp_err_t ulp_process_macros_and_load(uint32_t loadAddr, const ulp_insn_t *program, size_t *size);
+esp_err_t ulp_set_wakeup_period(size_t periodIndex, uint32_t periodUs);
+esp_err_t ulp_run(uint32_t entryPoint);
@@ -0,0 +1,10 @@
+// Big Mouth Phatt Bass simulator: mock ESP-IDF error codes
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_SUPPORTED 0x106
@@ -0,0 +1,20 @@
+// Big Mouth Phatt Bass simulator: mock GPIO registers. Only the output set and clear registers
+// exist, and writes to them change the simulated pins.
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include <stdint.h>
+
+// A write-only register that sets or clears the output pins in the mask written to it
+struct SimGpioOutputRegister {
+  uint8_t level;
+  SimGpioOutputRegister &operator=(uint32_t mask);
+};
+
+typedef struct {
+  SimGpioOutputRegister out_w1ts;
+  SimGpioOutputRegister out_w1tc;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
@@ -0,0 +1,142 @@
+// Big Mouth Phatt Bass simulator: mock Arduino core
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <stdarg.h>
+#include "Arduino.h"
+#include "simulator.h"
+
+// What analogRead() returns, roughly half way between light and dark for the LDR
+#define SIM_ANALOG_LEVEL 1250
+#define SIM_CPU_MHZ 240
+
+HardwareSerial Serial(0);
+HardwareSerial Serial2(2);
+EspClass ESP;
+
+uint8_t pinModes[40];
+uint8_t pinInputs[40];
+bool serialAtLineStart = true;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < sizeof(pinModes)) {
+    pinModes[pin] = mode;
+    pinInputs[pin] = mode == INPUT_PULLUP ? HIGH : LOW;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  simTracePin(pin, val);
+}
+
+// Inputs read as their pull-up or pull-down, so the button is never pushed
+int digitalRead(uint8_t pin) {
+  return pin < sizeof(pinInputs) ? pinInputs[pin] : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return SIM_ANALOG_LEVEL;
+}
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolutionBits) {
+  return freq;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+}
+
+void detachInterrupt(uint8_t pin) {
+}
+
+void delay(uint32_t ms) {
+  simAdvanceTo(simNowUs() + ms * 1000LL);
+}
+
+unsigned long millis() {
+  return simNowUs() / 1000;
+}
+
+unsigned long micros() {
+  return simNowUs();
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return SIM_CPU_MHZ;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+size_t Print::print(const char *s) {
+  return write((const uint8_t *) s, strlen(s));
+}
+
+size_t Print::println(const char *s) {
+  return print(s) + print("\n");
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return write((const uint8_t *) buffer, min(length, (int) sizeof(buffer) - 1));
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+}
+
+// USB serial goes to stdout, with each line stamped with the virtual time. Serial2 goes to the MP3 player.
+size_t HardwareSerial::write(uint8_t b) {
+  if (uartNum == 2) {
+    mp3EmulatorReceive(b);
+    return 1;
+  }
+  if (serialAtLineStart) {
+    ::printf("[%10.3f] ", simNowUs() / 1000.0);
+  }
+  ::putchar(b);
+  serialAtLineStart = b == '\n';
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return Print::write(buffer, size);
+}
+
+int HardwareSerial::available() {
+  return uartNum == 2 ? mp3EmulatorAvailable() : 0;
+}
+
+int HardwareSerial::read() {
+  return uartNum == 2 ? mp3EmulatorRead() : -1;
+}
+
+int HardwareSerial::peek() {
+  return uartNum == 2 ? mp3EmulatorPeek() : -1;
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+// The CPU cycle counter. Reading it takes a microsecond, like the clock, so spins on it make progress.
+uint32_t EspClass::getCycleCount() {
+  simSpendUs(1);
+  return simNowUs() * SIM_CPU_MHZ;
+}
+
+void EspClass::restart() {
+  ::printf("Restart requested, ending simulation\n");
+  exit(0);
+}
@@ -0,0 +1,278 @@
+// Big Mouth Phatt Bass simulator: mock ESP-IDF drivers
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include "Arduino.h"
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <driver/adc.h>
+#include <driver/gpio.h>
+#include <driver/i2s.h>
+#include <driver/ledc.h>
+#include <driver/rtc_io.h>
+#include <driver/uart.h>
+#include <esp32/ulp.h>
+#include <soc/gpio_struct.h>
+#include "simulator.h"
+
+// How long reading the clock takes, so busy waits on it make progress
+#define SIM_CLOCK_READ_US 1
+
+struct SimTimer {
+  esp_timer_cb_t callback;
+  void *arg;
+  bool active;
+  uint64_t periodUs; // Zero for a one-shot timer
+  SimEventId event;
+};
+
+uint32_t simRtcSlowMem[2048];
+uint64_t sleepTimerWakeupUs = 0;
+esp_sleep_wakeup_cause_t sleepWakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+void fireTimer(SimTimer *timer);
+
+// High resolution timer
+
+int64_t esp_timer_get_time() {
+  simSpendUs(SIM_CLOCK_READ_US);
+  return simNowUs();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+  *handle = new SimTimer{ args->callback, args->arg, false, 0, 0 };
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  esp_timer_stop(timer);
+  timer->active = true;
+  timer->periodUs = 0;
+  timer->event = simSchedule(simNowUs() + timeoutUs, [timer] { fireTimer(timer); });
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  esp_timer_stop(timer);
+  timer->active = true;
+  timer->periodUs = periodUs;
+  timer->event = simSchedule(simNowUs() + periodUs, [timer] { fireTimer(timer); });
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (timer->active) {
+    simCancel(timer->event);
+    timer->active = false;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  esp_timer_stop(timer);
+  delete timer;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  return timer->active;
+}
+
+// Run a timer's callback, re-arming it first if it is periodic, as the callback may restart it
+void fireTimer(SimTimer *timer) {
+  if (timer->periodUs > 0) {
+    timer->event = simSchedule(simNowUs() + timer->periodUs, [timer] { fireTimer(timer); });
+  } else {
+    timer->active = false;
+  }
+  timer->callback(timer->arg);
+}
+
+// Sleep. Light sleep only wakes on its timer, as there's no button to push. Deep sleep would
+// restart the firmware, so it ends the simulation.
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  sleepTimerWakeupUs = timeUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ulp_wakeup() {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(int pin, int level) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uartNum) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  if (source == ESP_SLEEP_WAKEUP_TIMER) {
+    sleepTimerWakeupUs = 0;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start() {
+  simAdvanceTo(simNowUs() + sleepTimerWakeupUs);
+  sleepWakeupCause = ESP_SLEEP_WAKEUP_TIMER;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+  printf("Deep sleep, ending simulation\n");
+  exit(0);
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return sleepWakeupCause;
+}
+
+// GPIO
+
+esp_err_t gpio_intr_enable(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) {
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type) {
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin) {
+  return digitalRead(pin);
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin) {
+  return ESP_OK;
+}
+
+// UART
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uartNum, int wakeupThreshold) {
+  return ESP_OK;
+}
+
+// GPIO registers
+
+gpio_dev_t GPIO = { { HIGH }, { LOW } };
+
+SimGpioOutputRegister &SimGpioOutputRegister::operator=(uint32_t mask) {
+  for (uint8_t pin = 0; pin < 32; pin++) {
+    if (mask & (1UL << pin)) {
+      simTracePin(pin, level);
+    }
+  }
+  return *this;
+}
+
+// LEDC, whose duty cycle doesn't matter without motors
+
+esp_err_t ledc_fade_func_install(int intrAllocFlags) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t targetDuty, int maxFadeTimeMs) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fadeMode) {
+  return ESP_OK;
+}
+
+// System
+
+esp_reset_reason_t esp_reset_reason() {
+  return ESP_RST_POWERON;
+}
+
+// ADC
+
+esp_err_t adc1_config_width(adc_bits_width_t width) {
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+  return ESP_OK;
+}
+
+void adc1_ulp_enable() {
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+  return analogRead(0);
+}
+
+// I2S, which never installs, see driver/i2s.h
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queueSize, void *queue) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t port) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_set_sample_rates(i2s_port_t port, uint32_t rate) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_adc_enable(i2s_port_t port) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_adc_disable(i2s_port_t port) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t i2s_read(i2s_port_t port, void *dest, size_t size, size_t *bytesRead, uint32_t ticksToWait) {
+  *bytesRead = 0;
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ULP, which never loads, see esp32/ulp.h
+
+esp_err_t ulp_process_macros_and_load(uint32_t loadAddr, const ulp_insn_t *program, size_t *size) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ulp_set_wakeup_period(size_t periodIndex, uint32_t periodUs) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ulp_run(uint32_t entryPoint) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
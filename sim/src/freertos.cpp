@@ -0,0 +1,134 @@
+// Big Mouth Phatt Bass simulator: mock FreeRTOS
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "simulator.h"
+
+struct SimTask {
+  std::string name;
+  UBaseType_t priority;
+  uint32_t stackDepth;
+};
+
+// Queues hold copies of their items. Semaphores are queues with no item data, just a count.
+struct SimQueue {
+  size_t itemSize;
+  UBaseType_t capacity;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t count;
+};
+
+// Turn a FreeRTOS timeout into a deadline on the virtual clock
+int64_t ticksToDeadlineUs(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    return SIM_FOREVER;
+  }
+  return simNowUs() + ticks * portTICK_PERIOD_MS * 1000LL;
+}
+
+// Tasks are recorded but never run, see freertos/FreeRTOS.h
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stackDepth, void *arg,
+    UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  SimTask *created = new SimTask{ name, priority, stackDepth };
+  if (handle) {
+    *handle = created;
+  }
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  delete task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  simAdvanceTo(ticksToDeadlineUs(ticks));
+}
+
+char *pcTaskGetName(TaskHandle_t task) {
+  return const_cast<char *>(task->name.c_str());
+}
+
+// Everything runs on the one thread, see freertos/FreeRTOS.h
+BaseType_t xPortGetCoreID() {
+  return 0;
+}
+
+// No task is ever running, as tasks aren't run, see freertos/FreeRTOS.h
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return nullptr;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+  return task->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return task->stackDepth;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new SimQueue{ itemSize, length, {}, 0 };
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+  if (!simWaitUntil(ticksToDeadlineUs(ticksToWait), [queue] { return queue->items.size() < queue->capacity; })) {
+    return pdFAIL;
+  }
+  const uint8_t *bytes = static_cast<const uint8_t *>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken) {
+  if (higherPriorityTaskWoken) {
+    *higherPriorityTaskWoken = pdFALSE;
+  }
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+  if (!simWaitUntil(ticksToDeadlineUs(ticksToWait), [queue] { return !queue->items.empty(); })) {
+    return pdFAIL;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return new SimQueue{ 0, 1, {}, 0 };
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new SimQueue{ 0, 1, {}, 1 };
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  if (!simWaitUntil(ticksToDeadlineUs(ticksToWait), [semaphore] { return semaphore->count > 0; })) {
+    return pdFAIL;
+  }
+  semaphore->count--;
+  return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if (semaphore->count >= semaphore->capacity) {
+    return pdFAIL;
+  }
+  semaphore->count++;
+  return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken) {
+  if (higherPriorityTaskWoken) {
+    *higherPriorityTaskWoken = pdFALSE;
+  }
+  return xSemaphoreGive(semaphore);
+}
@@ -0,0 +1,95 @@
+// Big Mouth Phatt Bass simulator: mock filesystem, backed by files on the PC
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <sys/stat.h>
+#include "LittleFS.h"
+
+LittleFSFS LittleFS;
+
+size_t fs::File::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t fs::File::write(const uint8_t *buffer, size_t size) {
+  return handle ? fwrite(buffer, 1, size, handle.get()) : 0;
+}
+
+int fs::File::available() {
+  return handle ? size() - position() : 0;
+}
+
+int fs::File::read() {
+  return handle ? fgetc(handle.get()) : -1;
+}
+
+int fs::File::peek() {
+  if (!handle) {
+    return -1;
+  }
+  int b = fgetc(handle.get());
+  if (b >= 0) {
+    ungetc(b, handle.get());
+  }
+  return b;
+}
+
+size_t fs::File::read(uint8_t *buffer, size_t size) {
+  return handle ? fread(buffer, 1, size, handle.get()) : 0;
+}
+
+bool fs::File::seek(uint32_t pos) {
+  return handle && fseek(handle.get(), pos, SEEK_SET) == 0;
+}
+
+size_t fs::File::position() const {
+  return handle ? ftell(handle.get()) : 0;
+}
+
+size_t fs::File::size() const {
+  if (!handle) {
+    return 0;
+  }
+  struct stat info;
+  return fstat(fileno(handle.get()), &info) == 0 ? info.st_size : 0;
+}
+
+void fs::File::close() {
+  handle.reset();
+}
+
+// Arduino file modes are "r", "w" and "a", always binary
+fs::File fs::FS::open(const char *path, const char *mode, bool create) {
+  std::string hostMode = std::string(mode) + "b";
+  FILE *f = fopen(hostPath(path).c_str(), hostMode.c_str());
+  return f ? File(f) : File();
+}
+
+bool fs::FS::exists(const char *path) {
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool fs::FS::remove(const char *path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool fs::FS::rename(const char *from, const char *to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool fs::FS::mkdir(const char *path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+std::string fs::FS::hostPath(const char *path) const {
+  return root + path;
+}
+
+// Mounts if the folder standing in for the partition exists, "data" unless set otherwise
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel) {
+  if (root.empty()) {
+    root = "data";
+  }
+  struct stat info;
+  return stat(root.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
@@ -0,0 +1,183 @@
+// Big Mouth Phatt Bass simulator
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Performs each track against the mock hardware and writes a trace of the motor movements and MP3
+// player traffic for each one. Fails if a track has no choreography, in a file or built in, or if the choreography
+// ran late by more than SIM_MAX_LATE_US, e.g. because something blocked the motion code.
+//
+// Each track is then performed again with the motor lead times in simLeadTimes, into a "-leads"
+// trace. That fails if the motors went through different states, e.g. because a movement with a
+// long lead time overtook the one before it on the same motor.
+//
+// Usage:
+//   program [--data <folder>] [--traces <folder>] [track numbers...]
+
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include <LittleFS.h>
+#include "config.h"
+#include "choreography.h"
+#include "energy.h"
+#include "leadtime.h"
+#include "motors.h"
+#include "mp3player.h"
+#include "timing.h"
+#include "tracks.h"
+#include "simulator.h"
+
+#define SIM_MAX_LATE_US 2000
+
+// Lead times for the second performance of each track. They differ from each other, and mouthOpen's
+// is longer than the gap between most closes and opens, so movements would be reordered if the
+// choreography player let them.
+const struct {
+  const char *action;
+  uint16_t leadMs;
+} simLeadTimes[] = {
+  { "headOut", 45 }, { "tailOut", 15 }, { "headTailRest", 30 },
+  { "mouthOpen", 60 }, { "mouthClose", 0 }, { "mouthRest", 20 },
+};
+
+void trigger(int trackNumber);
+int32_t choreographyLength(int number);
+bool performTrack(int track, const std::string &tracePath, const char *description);
+void setSimLeadTimes(bool enabled);
+std::vector<std::string> motorStates(const std::string &motor);
+
+// Length of a music file in millis, which is as long as its track's choreography, or -1 if it
+// doesn't exist. Other files, like the announcements, are left to the emulator's default (0).
+int32_t trackLengthFromChoreography(int folder, int file) {
+  const Track *track = getTrack(findTrackByFile(folder, file));
+  if (track == nullptr) {
+    return 0;
+  }
+  return choreographyLength(track->choreography);
+}
+
+// Length of a choreography in millis, or -1 if it doesn't exist
+int32_t choreographyLength(int number) {
+  File file;
+  ChoreographyReader reader;
+  if (!openChoreography(number, file, reader)) {
+    return -1;
+  }
+  reader.end();
+  return reader.durationMs;
+}
+
+int main(int argc, char **argv) {
+  std::string dataFolder = "data";
+  std::string traceFolder = "sim-traces";
+  std::vector<int> tracks;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--data" && i + 1 < argc) {
+      dataFolder = argv[++i];
+    } else if (arg == "--traces" && i + 1 < argc) {
+      traceFolder = argv[++i];
+    } else if (atoi(arg.c_str()) >= 1) {
+      tracks.push_back(atoi(arg.c_str()));
+    } else {
+      fprintf(stderr, "Usage: %s [--data <folder>] [--traces <folder>] [track numbers...]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // The parts of setup() that don't need the tasks. The comms task's polling is done by a
+  // background event instead.
+  LittleFS.setRoot(dataFolder);
+  setupTiming();
+  setupEnergy();
+  setupMotors();
+  setupLeadTimes();
+  if (!setupChoreography()) {
+    fprintf(stderr, "Can't find the data folder %s, using the built-in choreography\n", dataFolder.c_str());
+  }
+  setupTracks();
+  if (tracks.empty()) {
+    for (int track = 1; track <= getTrackCount(); track++) {
+      tracks.push_back(track);
+    }
+  }
+  mp3EmulatorSetTrackLengths(trackLengthFromChoreography);
+  setupMP3Player();
+  simEvery(COMMS_TASK_POLL_MILLIS * 1000LL, pollMP3Player);
+  mkdir(traceFolder.c_str(), 0755);
+
+  int failures = 0;
+  for (int track : tracks) {
+    if (getTrack(track) == nullptr) {
+      printf("Track %d: no such track, there are %d\n", track, getTrackCount());
+      failures++;
+      continue;
+    }
+    if (choreographyLength(getTrack(track)->choreography) < 0) {
+      printf("Track %d: no choreography in %s or built in\n", track, dataFolder.c_str());
+      failures++;
+      continue;
+    }
+
+    char name[24];
+    snprintf(name, sizeof(name), "%03d.trace", track);
+    if (!performTrack(track, traceFolder + "/" + name, "")) {
+      failures++;
+    }
+    std::vector<std::string> headTailStates = motorStates("headtail");
+    std::vector<std::string> mouthStates = motorStates("mouth");
+
+    setSimLeadTimes(true);
+    snprintf(name, sizeof(name), "%03d-leads.trace", track);
+    if (!performTrack(track, traceFolder + "/" + name, " with lead times")) {
+      failures++;
+    }
+    setSimLeadTimes(false);
+    if (motorStates("headtail") != headTailStates || motorStates("mouth") != mouthStates) {
+      printf("Track %d: the lead times changed which movements were made, compare the traces\n", track);
+      failures++;
+    }
+  }
+  return failures > 0 ? 1 : 0;
+}
+
+// Perform a track, tracing it, and report how it went. Returns false if it ran too late.
+bool performTrack(int track, const std::string &tracePath, const char *description) {
+  simTraceOpen(tracePath.c_str());
+  int64_t startUs = simNowUs();
+  uint32_t startFrames = mp3EmulatorFrameCount();
+  auto wallStart = std::chrono::steady_clock::now();
+
+  trigger(track);
+  simWaitUntil(SIM_FOREVER, [] { return !isMP3PlayerBusy(); });
+
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  simTraceClose();
+  WakeStats stats = getWakeStats();
+  bool late = stats.maxLateUs > SIM_MAX_LATE_US;
+  printf("Track %d%s: %.1f s simulated in %.1f ms, %u motor moves, %u MP3 frames, max lateness %d us%s, trace %s\n",
+      track, description, (simNowUs() - startUs) / 1e6, wallMs, (unsigned) simTraceMotorMoves(),
+      (unsigned) (mp3EmulatorFrameCount() - startFrames), (int) stats.maxLateUs, late ? " (too late)" : "",
+      tracePath.c_str());
+  return !late;
+}
+
+// Set the lead times to simLeadTimes, or back to zero
+void setSimLeadTimes(bool enabled) {
+  for (const auto &lead : simLeadTimes) {
+    setLeadTimeMs(lead.action, enabled ? lead.leadMs : 0);
+  }
+}
+
+// One motor's states in the last trace, in order. Movements of different motors can change places
+// when their lead times differ, but each motor's own shouldn't.
+std::vector<std::string> motorStates(const std::string &motor) {
+  std::vector<std::string> states;
+  for (const std::string &state : simTraceMotorStates()) {
+    if (state.compare(0, motor.size() + 1, motor + " ") == 0) {
+      states.push_back(state);
+    }
+  }
+  return states;
+}
@@ -0,0 +1,159 @@
+// Big Mouth Phatt Bass simulator: MP3 player
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Behaves like an MP3-TF-16P on the other end of Serial2: it acknowledges commands that ask for
+// feedback, starts playing a little after a play command, and reports when the track finishes.
+// Serial transmission times at MP3_PLAYER_BAUD_RATE are included.
+
+#include <deque>
+#include "Arduino.h"
+#include "config.h"
+#include "simulator.h"
+
+// How long the player takes to act on a command once it has arrived
+#define SIM_MP3_REPLY_US 10000
+// How long from a play command arriving to the music starting
+#define SIM_MP3_PLAY_START_US 40000
+// Length of files that aren't music tracks, e.g. the announcements
+#define SIM_MP3_OTHER_TRACK_MS 1500
+// Time to send one byte at 8N1
+#define SIM_MP3_BYTE_US (10 * 1000000LL / MP3_PLAYER_BAUD_RATE)
+
+void mp3EmulatorHandleFrame(const uint8_t *frame, int64_t arrivedUs);
+void mp3EmulatorReply(uint8_t command, uint16_t data, int64_t atUs);
+const char *mp3CommandName(uint8_t command);
+
+std::function<int32_t(int folder, int track)> trackLengthMs;
+uint8_t txFrame[10];
+int txLength = 0;
+int64_t txLineFreeUs = 0; // When the last byte written will have finished sending
+std::deque<uint8_t> rxBytes;
+bool playing = false;
+SimEventId trackFinishedEvent = 0;
+uint32_t frameCount = 0;
+
+// Tell the player how long each file is, in millis, 0 for the default length of files that aren't
+// music tracks, or negative if it doesn't exist
+void mp3EmulatorSetTrackLengths(std::function<int32_t(int folder, int track)> lengthMs) {
+  trackLengthMs = lengthMs;
+}
+
+// A byte written to Serial2 by the firmware
+void mp3EmulatorReceive(uint8_t b) {
+  txLineFreeUs = max(txLineFreeUs, simNowUs()) + SIM_MP3_BYTE_US;
+  if (txLength == 0 && b != 0x7E) {
+    return;
+  }
+  txFrame[txLength++] = b;
+  if (txLength == (int) sizeof(txFrame)) {
+    mp3EmulatorHandleFrame(txFrame, txLineFreeUs);
+    txLength = 0;
+  }
+}
+
+// Bytes the player has sent that the firmware hasn't read yet
+int mp3EmulatorAvailable() {
+  return rxBytes.size();
+}
+
+int mp3EmulatorRead() {
+  if (rxBytes.empty()) {
+    return -1;
+  }
+  int b = rxBytes.front();
+  rxBytes.pop_front();
+  return b;
+}
+
+int mp3EmulatorPeek() {
+  return rxBytes.empty() ? -1 : rxBytes.front();
+}
+
+// Frames sent either way so far
+uint32_t mp3EmulatorFrameCount() {
+  return frameCount;
+}
+
+// Act on a complete command frame, which finishes arriving at arrivedUs
+void mp3EmulatorHandleFrame(const uint8_t *frame, int64_t arrivedUs) {
+  uint8_t command = frame[3];
+  bool feedback = frame[4] == 0x01;
+  uint16_t data = (frame[5] << 8) | frame[6];
+  uint16_t sum = frame[1] + frame[2] + frame[3] + frame[4] + frame[5] + frame[6];
+  bool valid = frame[9] == 0xEF && (uint16_t) (sum + ((frame[7] << 8) | frame[8])) == 0;
+  frameCount++;
+
+  simSchedule(arrivedUs, [=] {
+    simTrace("uart-tx", "%s %d%s", mp3CommandName(command), data, valid ? "" : " (bad checksum)");
+    if (!valid) {
+      return;
+    }
+    if (command == 0x0F) {
+      int folder = data >> 8;
+      int track = data & 0xFF;
+      int32_t lengthMs = trackLengthMs ? trackLengthMs(folder, track) : -1;
+      if (lengthMs == 0) {
+        lengthMs = SIM_MP3_OTHER_TRACK_MS;
+      }
+      if (lengthMs < 0) {
+        mp3EmulatorReply(0x40, 0x06, arrivedUs + SIM_MP3_REPLY_US); // File not found
+        return;
+      }
+      simCancel(trackFinishedEvent);
+      playing = true;
+      int64_t startUs = arrivedUs + SIM_MP3_PLAY_START_US;
+      simSchedule(startUs, [folder, track] { simTrace("player", "start %02d/%03d", folder, track); });
+      trackFinishedEvent = simSchedule(startUs + lengthMs * 1000LL, [track] {
+        playing = false;
+        simTrace("player", "finished");
+        mp3EmulatorReply(0x3D, track, simNowUs());
+      });
+    } else if (command == 0x16 && playing) {
+      simCancel(trackFinishedEvent);
+      playing = false;
+      simSchedule(arrivedUs + SIM_MP3_REPLY_US, [] { simTrace("player", "stopped"); });
+    }
+    if (feedback) {
+      mp3EmulatorReply(0x41, 0, arrivedUs + SIM_MP3_REPLY_US);
+    }
+  });
+}
+
+// Send a feedback frame, starting at atUs. It arrives in the firmware's receive buffer a byte at a time.
+void mp3EmulatorReply(uint8_t command, uint16_t data, int64_t atUs) {
+  uint8_t frame[10] = { 0x7E, 0xFF, 0x06, command, 0x00, highByte(data), lowByte(data), 0, 0, 0xEF };
+  uint16_t checkSum = -(frame[1] + frame[2] + frame[3] + frame[4] + frame[5] + frame[6]);
+  frame[7] = highByte(checkSum);
+  frame[8] = lowByte(checkSum);
+  frameCount++;
+  for (int i = 0; i < (int) sizeof(frame); i++) {
+    uint8_t b = frame[i];
+    simSchedule(atUs + (i + 1) * SIM_MP3_BYTE_US, [b] { rxBytes.push_back(b); });
+  }
+  simSchedule(atUs + sizeof(frame) * SIM_MP3_BYTE_US, [command, data] {
+    simTrace("uart-rx", "%s %d", mp3CommandName(command), data);
+  });
+}
+
+// Name of a command or feedback code, for the trace
+const char *mp3CommandName(uint8_t command) {
+  switch (command) {
+    case 0x06:
+      return "volume";
+    case 0x0F:
+      return "play-folder-track";
+    case 0x11:
+      return "repeat";
+    case 0x16:
+      return "stop";
+    case 0x3D:
+      return "track-finished";
+    case 0x40:
+      return "error";
+    case 0x41:
+      return "ack";
+  }
+  static char name[8];
+  snprintf(name, sizeof(name), "0x%02X", command);
+  return name;
+}
@@ -0,0 +1,45 @@
+// Big Mouth Phatt Bass simulator: mock NVS preferences
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <string.h>
+#include <Preferences.h>
+
+std::map<std::string, uint16_t> preferenceValues; // By namespace and key
+std::map<std::string, std::string> preferenceBytes;
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  space = name;
+  return true;
+}
+
+void Preferences::end() {
+}
+
+uint16_t Preferences::getUShort(const char *key, uint16_t defaultValue) {
+  auto value = preferenceValues.find(space + "/" + key);
+  return value != preferenceValues.end() ? value->second : defaultValue;
+}
+
+size_t Preferences::putUShort(const char *key, uint16_t value) {
+  preferenceValues[space + "/" + key] = value;
+  return sizeof(value);
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  auto value = preferenceBytes.find(space + "/" + key);
+  return value != preferenceBytes.end() ? value->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength) {
+  auto value = preferenceBytes.find(space + "/" + key);
+  if (value == preferenceBytes.end() || value->second.size() > maxLength) {
+    return 0;
+  }
+  memcpy(buffer, value->second.data(), value->second.size());
+  return value->second.size();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length) {
+  preferenceBytes[space + "/" + key] = std::string((const char *) value, length);
+  return length;
+}
@@ -0,0 +1,197 @@
+// Big Mouth Phatt Bass simulator
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include "config.h"
+#include "simulator.h"
+
+using std::max;
+
+#define SIM_DEADLOCK_US (3600 * 1000000LL)
+
+void simFlushMotors();
+
+int64_t nowUs = 0;
+int eventDepth = 0; // Events running, which nothing else can interrupt
+uint64_t nextEventSequence = 0;
+std::map<std::pair<int64_t, uint64_t>, std::function<void()>> events; // By time, then in order scheduled
+std::map<SimEventId, int64_t> eventTimes;
+
+FILE *traceFile = nullptr;
+int64_t traceStartUs = 0;
+uint32_t traceMotorMoves = 0;
+std::vector<std::string> traceMotorStates; // Each motor state in the current trace, in order
+uint8_t pinLevels[40];
+int64_t pinsChangedUs = -1; // When a motor pin last changed, or -1 if the change has been traced
+const char *tracedHeadTail = "rest";
+const char *tracedMouth = "rest";
+
+// Current virtual time in micros
+int64_t simNowUs() {
+  return nowUs;
+}
+
+// Spend some time running code that doesn't block, like a busy wait. Events that fall due meanwhile
+// run as if on another core or from an interrupt, unless this is an event itself.
+void simSpendUs(int64_t us) {
+  simFlushMotors();
+  nowUs += us;
+  if (eventDepth == 0) {
+    simAdvanceTo(nowUs);
+  }
+}
+
+// Run events in time order until the condition is true, or the next event is after the deadline.
+// Returns the condition, so false means the wait timed out, with the clock at the deadline.
+bool simWaitUntil(int64_t deadlineUs, const std::function<bool()> &condition) {
+  int64_t startUs = nowUs;
+  simFlushMotors();
+  while (!condition()) {
+    if (events.empty() || events.begin()->first.first > deadlineUs) {
+      if (deadlineUs == SIM_FOREVER) {
+        fprintf(stderr, "sim: waiting forever for something that can't happen\n");
+        exit(2);
+      }
+      nowUs = max(nowUs, deadlineUs);
+      return condition();
+    }
+    if (deadlineUs == SIM_FOREVER && nowUs - startUs > SIM_DEADLOCK_US) {
+      fprintf(stderr, "sim: waited over an hour for something that hasn't happened\n");
+      exit(2);
+    }
+    auto next = events.begin();
+    std::function<void()> event = std::move(next->second);
+    nowUs = max(nowUs, next->first.first);
+    eventTimes.erase(next->first.second);
+    events.erase(next);
+    eventDepth++;
+    event();
+    eventDepth--;
+    simFlushMotors();
+  }
+  return true;
+}
+
+// Let time pass until the deadline, running whatever happens on the way
+void simAdvanceTo(int64_t deadlineUs) {
+  simWaitUntil(deadlineUs, [] { return false; });
+}
+
+// Run an event at a given time. Returns an id that can be used to cancel it.
+SimEventId simSchedule(int64_t atUs, std::function<void()> event) {
+  SimEventId id = nextEventSequence++;
+  events[{ atUs, id }] = std::move(event);
+  eventTimes[id] = atUs;
+  return id;
+}
+
+// Cancel a scheduled event, if it hasn't happened yet
+void simCancel(SimEventId id) {
+  auto time = eventTimes.find(id);
+  if (time != eventTimes.end()) {
+    events.erase({ time->second, id });
+    eventTimes.erase(time);
+  }
+}
+
+// Run an event regularly, like a task that polls something
+void simEvery(int64_t periodUs, std::function<void()> event) {
+  simSchedule(nowUs + periodUs, [periodUs, event] {
+    event();
+    simEvery(periodUs, event);
+  });
+}
+
+// Start writing a trace file. Times in it are from now.
+bool simTraceOpen(const char *path) {
+  simTraceClose();
+  traceFile = fopen(path, "w");
+  traceStartUs = nowUs;
+  traceMotorMoves = 0;
+  traceMotorStates.clear();
+  if (traceFile) {
+    fprintf(traceFile, "# time (ms)  source    event\n");
+  }
+  return traceFile != nullptr;
+}
+
+// Finish the current trace file
+void simTraceClose() {
+  simFlushMotors();
+  if (traceFile) {
+    fclose(traceFile);
+    traceFile = nullptr;
+  }
+}
+
+// Write a line to the trace, timestamped now
+void simTrace(const char *source, const char *format, ...) {
+  if (!traceFile) {
+    return;
+  }
+  fprintf(traceFile, "%12.3f  %-8s  ", (nowUs - traceStartUs) / 1000.0, source);
+  va_list args;
+  va_start(args, format);
+  vfprintf(traceFile, format, args);
+  va_end(args);
+  fputc('\n', traceFile);
+}
+
+// Record a pin changing. Motor states are traced once the clock moves on, so the moment between
+// setting a motor's two pins doesn't show up as a movement.
+void simTracePin(uint8_t pin, uint8_t level) {
+  if (pin >= sizeof(pinLevels)) {
+    return;
+  }
+  pinLevels[pin] = level;
+  pinsChangedUs = nowUs;
+}
+
+// Motor moves in the current trace, for the summary
+uint32_t simTraceMotorMoves() {
+  return traceMotorMoves;
+}
+
+// Motor states in the current trace, in order, as "headtail headOut", "mouth open" and so on.
+// Comparing them shows whether a change altered which movements were made, rather than when.
+const std::vector<std::string> &simTraceMotorStates() {
+  return traceMotorStates;
+}
+
+// Name a motor state from its driver's two input pins
+const char *motorState(uint8_t pin1, uint8_t pin2, const char *forward, const char *reverse) {
+  if (pinLevels[pin1] == pinLevels[pin2]) {
+    return "rest";
+  }
+  return pinLevels[pin2] ? forward : reverse;
+}
+
+// Trace any motor state changes since the clock last moved
+void simFlushMotors() {
+  if (pinsChangedUs < 0) {
+    return;
+  }
+  int64_t savedNowUs = nowUs;
+  nowUs = pinsChangedUs;
+  pinsChangedUs = -1;
+  const char *headTail = motorState(HEADTAIL_MOTOR_PIN_1, HEADTAIL_MOTOR_PIN_2, "headOut", "tailOut");
+  const char *mouth = motorState(MOUTH_MOTOR_PIN_1, MOUTH_MOTOR_PIN_2, "open", "close");
+  if (headTail != tracedHeadTail) {
+    tracedHeadTail = headTail;
+    traceMotorMoves++;
+    traceMotorStates.push_back(std::string("headtail ") + headTail);
+    simTrace("headtail", "%s", headTail);
+  }
+  if (mouth != tracedMouth) {
+    tracedMouth = mouth;
+    traceMotorMoves++;
+    traceMotorStates.push_back(std::string("mouth ") + mouth);
+    simTrace("mouth", "%s", mouth);
+  }
+  nowUs = savedNowUs;
+}
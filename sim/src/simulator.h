@@ -0,0 +1,44 @@
+// Big Mouth Phatt Bass simulator
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Runs the firmware on a PC against mock hardware, with a virtual clock so a whole song takes a
+// few milliseconds. Everything happens on one thread: the firmware's blocking calls advance the
+// clock, running any timer callbacks, background polls and MP3 player replies that fall due on
+// the way. Motor movements and MP3 player traffic are written to a timestamped trace.
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define SIM_FOREVER INT64_MAX
+
+// Virtual clock
+int64_t simNowUs();
+void simSpendUs(int64_t us);
+bool simWaitUntil(int64_t deadlineUs, const std::function<bool()> &condition);
+void simAdvanceTo(int64_t deadlineUs);
+
+// Events, run in time order as the clock advances
+typedef uint64_t SimEventId;
+SimEventId simSchedule(int64_t atUs, std::function<void()> event);
+void simCancel(SimEventId id);
+void simEvery(int64_t periodUs, std::function<void()> event);
+
+// Trace of what the fish did
+bool simTraceOpen(const char *path);
+void simTraceClose();
+void simTrace(const char *source, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void simTracePin(uint8_t pin, uint8_t level);
+uint32_t simTraceMotorMoves();
+const std::vector<std::string> &simTraceMotorStates();
+
+// Simulated MP3 player on Serial2
+void mp3EmulatorSetTrackLengths(std::function<int32_t(int folder, int track)> lengthMs);
+void mp3EmulatorReceive(uint8_t b);
+int mp3EmulatorAvailable();
+int mp3EmulatorRead();
+int mp3EmulatorPeek();
+uint32_t mp3EmulatorFrameCount();
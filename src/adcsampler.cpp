@@ -0,0 +1,76 @@
+// Big Mouth Phatt Bass ADC sampling
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include "config.h"
+#include "adcsampler.h"
+#include "timing.h"
+
+bool adcSamplerInstalled = false;
+SemaphoreHandle_t adcSamplerMutex = nullptr; // Held by whoever is sampling
+
+// Set up the I2S peripheral to read the ADC. Can be called again after releaseAdcSampler().
+void setupAdcSampler() {
+  if (adcSamplerMutex == nullptr) {
+    adcSamplerMutex = xSemaphoreCreateMutex();
+  }
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t) (I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = SENSOR_SAMPLE_RATE;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.dma_buf_count = ADC_DMA_BUFFER_COUNT;
+  config.dma_buf_len = ADC_DMA_BUFFER_SAMPLES;
+  adcSamplerInstalled = i2s_driver_install(ADC_I2S_PORT, &config, 0, nullptr) == ESP_OK;
+  if (!adcSamplerInstalled) {
+    Serial.println("Could not set up the ADC sampler");
+  }
+}
+
+// Start sampling a channel, waiting up to waitMs if someone else is using the sampler. Returns
+// false if it couldn't be started, otherwise call stopAdcSampling() when finished. Light sleep is
+// held off while sampling, as it would stop the DMA.
+bool startAdcSampling(adc1_channel_t channel, uint32_t sampleRate, uint32_t waitMs) {
+  if (!adcSamplerInstalled || xSemaphoreTake(adcSamplerMutex, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+    return false;
+  }
+  if (i2s_set_adc_mode(ADC_UNIT_1, channel) != ESP_OK || i2s_set_sample_rates(ADC_I2S_PORT, sampleRate) != ESP_OK) {
+    xSemaphoreGive(adcSamplerMutex);
+    return false;
+  }
+  inhibitLightSleep();
+  i2s_adc_enable(ADC_I2S_PORT);
+  return true;
+}
+
+// Read up to count samples, waiting up to timeoutMs for them. Returns how many were read. The
+// samples are raw 12 bit ADC readings.
+size_t readAdcSamples(uint16_t *samples, size_t count, uint32_t timeoutMs) {
+  size_t bytesRead = 0;
+  if (i2s_read(ADC_I2S_PORT, samples, count * sizeof(uint16_t), &bytesRead, pdMS_TO_TICKS(timeoutMs)) != ESP_OK) {
+    return 0;
+  }
+  size_t samplesRead = bytesRead / sizeof(uint16_t);
+  for (size_t i = 0; i < samplesRead; i++) {
+    // The top four bits of each sample are the channel number
+    samples[i] &= 0x0FFF;
+  }
+  return samplesRead;
+}
+
+// Stop sampling, after startAdcSampling(), so someone else can use the sampler
+void stopAdcSampling() {
+  i2s_adc_disable(ADC_I2S_PORT);
+  releaseLightSleep();
+  xSemaphoreGive(adcSamplerMutex);
+}
+
+// Remove the I2S driver, so ADC1 can be handed to something else such as the ULP
+void releaseAdcSampler() {
+  if (adcSamplerInstalled) {
+    i2s_driver_uninstall(ADC_I2S_PORT);
+    adcSamplerInstalled = false;
+  }
+}
@@ -0,0 +1,18 @@
+// Big Mouth Phatt Bass ADC sampling
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// The LDR and the MP3 player's audio output are both sampled by the I2S peripheral's built-in ADC
+// mode, which DMAs samples into memory without the CPU having to read each one. There is only one
+// such peripheral, so it is shared: one user at a time, each choosing its own channel and sample
+// rate when it starts.
+
+#pragma once
+
+#include <Arduino.h>
+#include <driver/adc.h>
+
+void setupAdcSampler();
+bool startAdcSampling(adc1_channel_t channel, uint32_t sampleRate, uint32_t waitMs);
+size_t readAdcSamples(uint16_t *samples, size_t count, uint32_t timeoutMs);
+void stopAdcSampling();
+void releaseAdcSampler();
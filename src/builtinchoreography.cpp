@@ -0,0 +1,677 @@
+// Big Mouth Phatt Bass built-in choreography, generated by tools/choreo.py from the scripts in
+// the "choreography" folder. Don't edit it; it's regenerated from the scripts on every build.
+
+#include "choreographydsl.h"
+
+namespace dsl {
+
+// 001-phatt-bass.txt
+constexpr Step track001[] = {
+  // length 40800
+  sleep(3000), // *sirens*
+  headOut(),
+  sleep(1000),
+  mouthOpenFor(1000), // Listen
+  sleep(1000),
+  mouthOpenFor(500), // to the
+  sleep(300),
+  mouthOpenFor(300), // phatt
+  sleep(200),
+  flapMouthFor(3500, 250), // bass... bass... bass... bass...
+  tailOut(),
+  mouthOpenFor(300), // bass...
+  headTailRest(),
+  mouthOpenFor(300), // bass...
+  tailOut(),
+  mouthOpenFor(300), // bass...
+  headTailRest(),
+  sleep(300),
+  // tempo 150: Matches the original flap timing
+  tailOut(), // bopTailFor 10800, expanded: *early 2000s techno noises*
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  tailOut(),
+  sleep(200),
+  headTailRest(),
+  sleep(200),
+  headOut(),
+  sleep(200),
+  mouthOpenFor(600), // phatt
+  sleep(600),
+  mouthOpenFor(600), // bass
+  repeat(10), // rest of music
+    flapTailFor(800, 200),
+    flapHeadFor(800, 200),
+  end(),
+};
+
+// 002-all-about-that-bass.txt
+constexpr Step track002[] = {
+  // length 31100
+  sleep(300),
+  headOut(),
+  sleep(1000),
+  flapMouthFor(4500, 250), // Because you know I'm all about that bass, 'bout that bass, no treble
+  headTailRest(),
+  flapMouthFor(3500, 250), // I'm all about that bass, 'bout that bass, no treble
+  headOut(),
+  flapMouthFor(3500, 250), // I'm all about that bass, 'bout that bass, no treble
+  headTailRest(),
+  flapMouthFor(2500, 250), // I'm all about that bass, 'bout that
+  flapMouthFor(1000, 125), // bass bass bass bass
+  sleep(500),
+  repeat(12), // Yeah, it's pretty clear, I ain't no size two, but I can shake it, shake it, like I'm supposed to do
+    tailOut(),
+    mouthOpen(),
+    sleep(150),
+    mouthClose(),
+    sleep(150),
+    headTailRest(),
+    mouthOpen(),
+    sleep(150),
+    mouthClose(),
+    sleep(150),
+  end(),
+  repeat(10), // 'Cause I got that boom boom that all the boys chase, and all the right junk in all the right
+    headOut(),
+    mouthOpen(),
+    sleep(150),
+    mouthClose(),
+    sleep(150),
+    headTailRest(),
+    mouthOpen(),
+    sleep(150),
+    mouthClose(),
+    sleep(150),
+  end(),
+  repeat(2), // basses
+    tailOut(),
+    mouthOpen(),
+    sleep(150),
+    mouthClose(),
+    sleep(150),
+    headTailRest(),
+  end(),
+  sleep(500),
+};
+
+// 003-mr-scruff-fish.txt
+constexpr Step track003[] = {
+  // length 37020
+  sleep(300),
+  headOut(),
+  mouthOpenFor(2400), // Now listen to me young fellow
+  sleep(300),
+  mouthOpenFor(2400), // What need is there for fish to sing
+  sleep(300),
+  mouthOpenFor(3000), // When I can roar and bellow?
+  headTailRest(),
+  sleep(1000),
+  repeat(4), // Fish x8
+    tailOut(),
+    mouthOpenFor(340),
+    sleep(100),
+    headTailRest(),
+    mouthOpenFor(340),
+    sleep(100),
+  end(),
+  mouthOpenFor(340), // Fish
+  sleep(100),
+  headOut(),
+  sleep(100),
+  mouthOpenFor(1300), // Eating fish
+  headTailRest(),
+  sleep(400),
+  repeat(2), // *ununtelligible noises*
+    mouthOpenFor(700),
+    sleep(300),
+  end(),
+  sleep(1400),
+  repeat(4), // Fish x8
+    tailOut(),
+    mouthOpenFor(340),
+    sleep(100),
+    headTailRest(),
+    mouthOpenFor(340),
+    sleep(100),
+  end(),
+  mouthOpenFor(340), // Fish
+  sleep(100),
+  headOut(),
+  sleep(100),
+  mouthOpenFor(1300), // Eating fish
+  headTailRest(),
+  sleep(3800),
+  mouthOpenFor(2600), // Fish are really (something??)
+  sleep(1800),
+  mouthOpenFor(2600), // Fish are really (something??)
+  sleep(2000),
+};
+
+// 004-chop-suey.txt
+constexpr Step track004[] = {
+  // length 40100
+  headOut(),
+  mouthOpenFor(300), // Wake up
+  headTailRest(),
+  sleep(100),
+  mouthOpenFor(300), // *whisper* Wake up
+  sleep(100),
+  headOut(),
+  mouthOpenFor(1500), // Grab a brush and put a little make-up
+  headTailRest(),
+  sleep(600),
+  headOut(),
+  mouthOpenFor(1320), // Hide the scars to fade away the shake-up
+  headTailRest(),
+  sleep(50),
+  mouthOpenFor(500), // *whisper* Hide the scars to fade away the
+  sleep(50),
+  headOut(),
+  mouthOpenFor(1320), // Why'd you leave the keys upon the table?
+  headTailRest(),
+  sleep(550),
+  headOut(),
+  mouthOpenFor(1320), // Here you go create another fable
+  headTailRest(),
+  sleep(50),
+  mouthOpenFor(500), // You wanted to
+  sleep(50),
+  headOut(),
+  mouthOpenFor(1250), // Grab a brush and put a little make-up
+  headTailRest(),
+  sleep(50),
+  mouthOpenFor(500), // You wanted to
+  sleep(50),
+  headOut(),
+  mouthOpenFor(1320), // Hide the scars to fade away the shake-up
+  headTailRest(),
+  sleep(50),
+  mouthOpenFor(500), // You wanted to
+  sleep(50),
+  headOut(),
+  mouthOpenFor(1320), // Why'd you leave the keys upon the table?
+  headTailRest(),
+  sleep(50),
+  mouthOpenFor(500), // You wanted to
+  sleep(50),
+  mouthOpenFor(1500), // I don't think you trust
+  sleep(1500),
+  mouthOpenFor(700), // in
+  sleep(1200),
+  mouthOpenFor(800), // my
+  sleep(1100),
+  mouthOpenFor(2800), // Self-righteous suicide
+  sleep(1000),
+  mouthOpenFor(700), // I
+  sleep(1200),
+  mouthOpenFor(900), // cry
+  sleep(850),
+  mouthOpenFor(1900), // when angels deserve to
+  sleep(50),
+  headOut(),
+  mouthOpenFor(3200), // DDDDIIIIIIEEEEE
+  headTailRest(),
+  sleep(50),
+  flapTailFor(4000, 125),
+  sleep(50),
+  headOut(),
+  mouthOpenFor(1800), // *roar*
+  headTailRest(),
+  sleep(500),
+};
+
+// 005-smells-like-teen-spirit.txt
+constexpr Step track005[] = {
+  // length 27800
+  mouthOpenFor(500), // Hello
+  sleep(500),
+  mouthOpenFor(500), // Hello
+  headOut(),
+  sleep(400),
+  flapMouthFor(1400, 175), // With the lights out
+  sleep(300),
+  flapMouthFor(1400, 175), // It's less dangerous
+  sleep(400),
+  headTailRest(),
+  sleep(400),
+  flapMouthAndTailTogetherFor(1400, 175), // Here we are now
+  sleep(400),
+  flapMouthAndTailTogetherFor(1400, 175), // Entertain us
+  sleep(300),
+  headOut(),
+  sleep(600),
+  flapMouthFor(1400, 175), // I feel stupid
+  sleep(600),
+  flapMouthFor(1400, 175), // and contagious
+  sleep(200),
+  headTailRest(),
+  sleep(500),
+  flapMouthAndTailTogetherFor(1400, 175), // Here we are now
+  sleep(500),
+  flapMouthAndTailTogetherFor(1400, 175), // Entertain us
+  sleep(700),
+  flapMouthAndTailTogetherFor(1400, 175), // A mulatto
+  headOut(),
+  sleep(700),
+  flapMouthFor(1400, 175), // An albino
+  headTailRest(),
+  sleep(700),
+  flapMouthAndTailTogetherFor(1400, 175), // A mosquito
+  headOut(),
+  sleep(700),
+  flapMouthFor(1400, 175), // My libido
+  headTailRest(),
+  sleep(800),
+  mouthOpenFor(800), // Yeah
+  sleep(500),
+};
+
+// 006-killing-in-the-name.txt
+constexpr Step track006[] = {
+  // length 38950
+  headOut(),
+  sleep(250),
+  repeat(8),
+    flapMouthFor(2250, 125), // Fuck you I won't do what you tell me
+    sleep(400),
+  end(),
+  flapMouthFor(2250, 125), // Fuck you I won't do what you tell me
+  headTailRest(),
+  sleep(2000),
+  headOut(),
+  sleep(250),
+  mouthOpenFor(300), // Mother
+  sleep(200),
+  mouthOpenFor(1000), // Fuckeeerrrrr
+  headTailRest(),
+  sleep(1200),
+  mouthOpenFor(300), // Ugh
+  flapTailFor(5500, 250),
+  flapTailFor(3000, 125),
+  flapTailFor(500, 250),
+  flapHeadFor(500, 250),
+  flapTailFor(500, 250),
+};
+
+// 007-enter-sandman.txt
+constexpr Step track007[] = {
+  // length 43000
+  sleep(400),
+  flapMouthFor(3000, 300), // Hush little baby, don't say a word
+  sleep(900),
+  flapMouthFor(3000, 300), // And never mind that noise you heard
+  sleep(1100),
+  flapMouthAndTailTogetherFor(3000, 300), // It's just the beast under your bed
+  sleep(900),
+  flapMouthAndTailTogetherFor(3000, 300), // In your closet, in your head
+  headOut(),
+  sleep(1000),
+  flapMouthFor(1200, 300), // Exit
+  mouthOpenFor(1000), // light
+  sleep(1700),
+  flapMouthFor(1200, 300), // Enter
+  mouthOpenFor(1000), // night
+  sleep(1100),
+  mouthOpenFor(1000), // Grain
+  sleep(200),
+  mouthOpenFor(200), // of
+  sleep(200),
+  mouthOpenFor(2000), // sand
+  sleep(500),
+  flapMouthFor(1200, 300), // Exit
+  mouthOpenFor(1000), // light
+  sleep(1600),
+  flapMouthFor(1200, 300), // Enter
+  mouthOpenFor(1000), // night
+  sleep(1500),
+  mouthOpenFor(1000), // Take
+  sleep(200),
+  mouthOpenFor(200), // my
+  sleep(200),
+  mouthOpenFor(2000), // hand
+  headTailRest(),
+  sleep(200),
+  flapMouthFor(1600, 200), // We're off to never never
+  mouthOpenFor(1500), // laaaaand
+  sleep(1000),
+};
+
+// 008-closer.txt
+constexpr Step track008[] = {
+  // length 30880
+  headOut(),
+  sleep(200),
+  flapMouthFor(2970, 165), // I wanna fuck you like an animal
+  headTailRest(),
+  sleep(200),
+  flapTailFor(1600, 200), // (instrumental)
+  headOut(),
+  sleep(200),
+  flapMouthFor(2640, 165), // I wanna feel you from the
+  mouthOpenFor(500), // in
+  sleep(100),
+  mouthOpenFor(800), // side
+  headTailRest(),
+  sleep(200),
+  flapTailFor(1200, 200), // (instrumental)
+  headOut(),
+  sleep(200),
+  flapMouthFor(2970, 165), // I wanna fuck you like an animal
+  headTailRest(),
+  sleep(200),
+  flapTailFor(1600, 200), // (instrumental)
+  sleep(400),
+  headOut(),
+  sleep(200),
+  flapMouthFor(1800, 150), // My whole existence is
+  mouthOpenFor(800), // flawed
+  headTailRest(),
+  sleep(200),
+  flapTailFor(2000, 200), // (instrumental)
+  sleep(400),
+  headOut(),
+  sleep(200),
+  flapMouthFor(1800, 150), // You get me closer to
+  mouthOpenFor(1000), // God
+  headTailRest(),
+  sleep(200),
+  // tempo 85.714: Matches the original flap timing
+  tailOut(), // bopTailFor 6300, expanded: (instrumental)
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+  tailOut(),
+  sleep(350),
+  headTailRest(),
+  sleep(350),
+};
+
+// 009-i-am-just-a-fish.txt
+constexpr Step track009[] = {
+  // length 32000
+  headOut(),
+  sleep(200),
+  mouthOpenFor(700), // Don't
+  sleep(500),
+  mouthOpenFor(700), // Cry
+  sleep(700),
+  flapMouthFor(1200, 150), // I am just a
+  mouthOpenFor(500), // Fish
+  headTailRest(),
+  sleep(200),
+  repeat(2), // (instrumental)
+    tailOut(),
+    sleep(500),
+    headTailRest(),
+    sleep(700),
+  end(),
+  tailOut(),
+  sleep(500),
+  headTailRest(),
+  sleep(100),
+  repeat(3),
+    headOut(),
+    sleep(400),
+    flapMouthFor(1200, 150), // I am just a
+    mouthOpenFor(500), // Fish
+    headTailRest(),
+    sleep(200),
+    repeat(2), // (instrumental)
+      tailOut(),
+      sleep(500),
+      headTailRest(),
+      sleep(700),
+    end(),
+    tailOut(),
+    sleep(500),
+    headTailRest(),
+    sleep(100),
+  end(),
+  flapHeadFor(2400, 600),
+  repeat(5),
+    tailOut(),
+    sleep(500),
+    headTailRest(),
+    sleep(700),
+  end(),
+};
+
+// 010-basket-case.txt
+constexpr Step track010[] = {
+  // length 48340
+  headOut(),
+  sleep(400),
+  mouthOpenFor(300), // Do
+  sleep(100),
+  flapMouthFor(900, 150), // you have the
+  mouthOpenFor(400), // time
+  flapTailFor(600, 100),
+  headOut(),
+  sleep(400),
+  mouthOpenFor(300), // To
+  sleep(200),
+  flapMouthFor(900, 150), // listen to me
+  mouthOpenFor(400), // whine
+  flapTailFor(600, 100),
+  headOut(),
+  sleep(400),
+  flapMouthFor(2560, 160), // About nothing and everything
+  mouthOpenFor(600), // all at
+  sleep(200),
+  mouthOpenFor(200), // once
+  flapTailFor(1800, 100),
+  headOut(),
+  sleep(400),
+  mouthOpenFor(300), // I
+  sleep(100),
+  flapMouthFor(900, 150), // am one of those
+  mouthOpenFor(400), // those
+  flapTailFor(600, 100),
+  headOut(),
+  sleep(400),
+  mouthOpenFor(300), // Me-
+  sleep(200),
+  flapMouthFor(900, 150), // lodromatic
+  mouthOpenFor(400), // fools
+  flapTailFor(600, 100),
+  headOut(),
+  sleep(400),
+  flapMouthFor(2560, 160), // Neurotic to the bone, no
+  mouthOpenFor(600), // doubt about
+  sleep(100),
+  mouthOpenFor(100), // it
+  flapTailFor(3000, 100),
+  headOut(),
+  sleep(400),
+  flapMouthFor(1440, 120), // Sometimes I give myself
+  mouthOpenFor(600), // the
+  sleep(200),
+  mouthOpenFor(500), // creeps
+  flapTailFor(2400, 100),
+  headOut(),
+  sleep(400),
+  flapMouthFor(1680, 120), // Sometimes my mind plays tricks
+  mouthOpenFor(600), // on
+  sleep(200),
+  mouthOpenFor(500), // me
+  flapTailFor(1600, 100),
+  headOut(),
+  sleep(400),
+  flapMouthFor(1800, 150), // At all keeps adding up
+  flapTailFor(600, 100),
+  headOut(),
+  sleep(300),
+  flapMouthFor(1500, 150), // I think I'm cracking
+  mouthOpenFor(800), // up
+  sleep(500),
+  mouthOpenFor(200), // Am
+  sleep(200),
+  flapMouthFor(1500, 150), // I just paranoid
+  flapMouthFor(600, 100), // Or am I just
+  mouthOpenFor(800), // stoned
+  headTailRest(),
+  sleep(300),
+  repeat(3),
+    tailOut(),
+    sleep(800),
+    headTailRest(),
+    sleep(800),
+  end(),
+};
+
+} // namespace dsl
+
+BUILTIN_CHOREOGRAPHY(track001, 40800);
+BUILTIN_CHOREOGRAPHY(track002, 31100);
+BUILTIN_CHOREOGRAPHY(track003, 37020);
+BUILTIN_CHOREOGRAPHY(track004, 40100);
+BUILTIN_CHOREOGRAPHY(track005, 27800);
+BUILTIN_CHOREOGRAPHY(track006, 38950);
+BUILTIN_CHOREOGRAPHY(track007, 43000);
+BUILTIN_CHOREOGRAPHY(track008, 30880);
+BUILTIN_CHOREOGRAPHY(track009, 32000);
+BUILTIN_CHOREOGRAPHY(track010, 48340);
+
+const BuiltinChoreography builtinChoreographies[] = {
+  { 1, track001Data.data(), track001Data.size() },
+  { 2, track002Data.data(), track002Data.size() },
+  { 3, track003Data.data(), track003Data.size() },
+  { 4, track004Data.data(), track004Data.size() },
+  { 5, track005Data.data(), track005Data.size() },
+  { 6, track006Data.data(), track006Data.size() },
+  { 7, track007Data.data(), track007Data.size() },
+  { 8, track008Data.data(), track008Data.size() },
+  { 9, track009Data.data(), track009Data.size() },
+  { 10, track010Data.data(), track010Data.size() },
+};
+const size_t builtinChoreographyCount = sizeof(builtinChoreographies) / sizeof(builtinChoreographies[0]);
@@ -0,0 +1,236 @@
+// Big Mouth Phatt Bass button handling
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <driver/uart.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include "button.h"
+#include "config.h"
+#include "energy.h"
+#include "timing.h"
+#include "trace.h"
+
+void IRAM_ATTR buttonIsr();
+void IRAM_ATTR updateButton(int64_t nowUs, bool fromIsr);
+void IRAM_ATTR postButtonEvent(ButtonEventType type, int64_t pressedUs, int64_t atUs, bool fromIsr);
+void buttonDebounceTimerCallback(void *arg);
+void buttonHoldTimerCallback(void *arg);
+
+QueueHandle_t buttonQueue;
+esp_timer_handle_t buttonDebounceTimer;
+esp_timer_handle_t buttonHoldTimer;
+portMUX_TYPE buttonMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool buttonDown = false;     // Debounced button state
+volatile bool buttonSettling = false; // True while ignoring bounces after a change
+volatile int64_t buttonPressedUs = 0; // When the current press started
+volatile int buttonHoldStage = 0;     // 0 = not yet long, 1 = long press sent, 2 = held sent
+
+// Set up the button interrupt, timers and event queue. Call from a task on the core that should
+// service the interrupt.
+void setupButton() {
+  buttonQueue = xQueueCreate(BUTTON_EVENT_QUEUE_SIZE, sizeof(ButtonEvent));
+
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = buttonDebounceTimerCallback;
+  timerArgs.name = "debounce";
+  esp_timer_create(&timerArgs, &buttonDebounceTimer);
+  timerArgs.callback = buttonHoldTimerCallback;
+  timerArgs.name = "hold";
+  esp_timer_create(&timerArgs, &buttonHoldTimer);
+
+  // After deep sleeping, the pin has to be handed back from the RTC to the digital GPIO
+  rtc_gpio_deinit((gpio_num_t) BUTTON_PIN);
+  buttonDown = isButtonPushed();
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonIsr, CHANGE);
+
+  // If the button woke us from deep sleep, the press started before we booted. Classify it as if
+  // it went down when the timer started, which is as close as we can tell; the bootloader's time
+  // is on top of that. If it's already been released, it was a short press.
+  if (wasWokenByButton()) {
+    int64_t nowUs = esp_timer_get_time();
+    buttonPressedUs = 0;
+    if (buttonDown) {
+      esp_timer_start_once(buttonHoldTimer, max(LONG_PRESS_DURATION_MILLIS * 1000 - nowUs, (int64_t) 1));
+    } else {
+      postButtonEvent(BUTTON_SHORT_PRESS, 0, nowUs, false);
+    }
+  }
+}
+
+// Return true if button is pushed
+boolean isButtonPushed() {
+  return digitalRead(BUTTON_PIN) == 0;
+}
+
+// True if the button is pushed or still settling, i.e. a press is in progress
+bool isButtonBusy() {
+  return buttonDown || buttonSettling;
+}
+
+// Wait up to timeoutMs for a button event. Returns false if there wasn't one.
+bool waitForButtonEvent(ButtonEvent &event, uint32_t timeoutMs) {
+  startTaskWait();
+  bool received = xQueueReceive(buttonQueue, &event, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  endTaskWait();
+  return received;
+}
+
+// Light sleep until the button is pushed, or until wakeAtUs (see timeNowUs()) if it's not negative,
+// unless something has inhibited light sleep. The button interrupt can't be used as a wakeup
+// source, so the pin is switched over to level-triggered wakeup for the duration. The press that
+// woke us is then handled as if it was an interrupt. Activity on USB serial wakes us too, so
+// console commands and uploads can get through, although the characters that woke us are lost.
+void lightSleepUntilButtonPushed(int64_t wakeAtUs) {
+  if (isLightSleepInhibited() || isButtonBusy()) {
+    return;
+  }
+  if (wakeAtUs >= 0) {
+    esp_sleep_enable_timer_wakeup(max(wakeAtUs - timeNowUs(), (int64_t) 1));
+  } else {
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  }
+  gpio_intr_disable((gpio_num_t) BUTTON_PIN);
+  gpio_wakeup_enable((gpio_num_t) BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  uart_set_wakeup_threshold(UART_NUM_0, CONSOLE_UART_WAKE_EDGES);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+  TRACE(TRACE_WAIT_START, TRACE_WAIT_BUTTON, 0);
+  int64_t sleptAtUs = timeNowUs();
+  startTaskWait();
+  esp_light_sleep_start();
+  endTaskWait();
+  addEnergyTime(ENERGY_LIGHT_SLEEP, timeNowUs() - sleptAtUs);
+  TRACE(TRACE_WAIT_END, TRACE_WAIT_BUTTON, 0);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_UART);
+  gpio_wakeup_disable((gpio_num_t) BUTTON_PIN);
+  gpio_set_intr_type((gpio_num_t) BUTTON_PIN, GPIO_INTR_ANYEDGE);
+  gpio_intr_enable((gpio_num_t) BUTTON_PIN);
+  updateButton(timeNowUs(), false);
+}
+
+// Deep sleep until the button is pushed, using ext0 wakeup on the button's RTC GPIO. The digital
+// pull-up is off in deep sleep, so the RTC one holds the pin high instead. Waking up restarts the
+// program, and setupButton() carries on with the press that woke us. Returns straight away if a
+// press is already in progress.
+void deepSleepUntilButtonPushed() {
+  if (isButtonBusy()) {
+    return;
+  }
+  rtc_gpio_pullup_en((gpio_num_t) BUTTON_PIN);
+  rtc_gpio_pulldown_dis((gpio_num_t) BUTTON_PIN);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  esp_sleep_enable_ext0_wakeup((gpio_num_t) BUTTON_PIN, 0);
+
+  prepareEnergyForDeepSleep();
+  Serial.println("Deep sleeping until the button is pushed");
+  Serial.flush();
+  esp_deep_sleep_start();
+}
+
+// True if we have just been woken from deep sleep by the button
+bool wasWokenByButton() {
+  return getBootWakeupCause() == ESP_SLEEP_WAKEUP_EXT0;
+}
+
+// Human-readable name of a button event, for reporting
+const char *buttonEventName(ButtonEventType type) {
+  switch (type) {
+    case BUTTON_SHORT_PRESS:
+      return "short press";
+    case BUTTON_LONG_PRESS:
+      return "long press";
+    case BUTTON_HELD:
+      return "held";
+  }
+  return "unknown";
+}
+
+// Button interrupt, on either edge
+void IRAM_ATTR buttonIsr() {
+  updateButton(esp_timer_get_time(), true);
+}
+
+// Check the button level and act on a change. Bounces are ignored while settling, after which
+// the debounce timer checks the level again in case the final bounce left it changed.
+void IRAM_ATTR updateButton(int64_t nowUs, bool fromIsr) {
+  bool pressed = false;
+  bool released = false;
+  int64_t pressedUs = 0;
+  bool shortPress = false;
+
+  portENTER_CRITICAL_SAFE(&buttonMux);
+  bool down = digitalRead(BUTTON_PIN) == 0;
+  if (!buttonSettling && down != buttonDown) {
+    buttonDown = down;
+    buttonSettling = true;
+    if (down) {
+      buttonPressedUs = nowUs;
+      buttonHoldStage = 0;
+      pressed = true;
+    } else {
+      released = true;
+      shortPress = buttonHoldStage == 0;
+    }
+    pressedUs = buttonPressedUs;
+  }
+  portEXIT_CRITICAL_SAFE(&buttonMux);
+
+  if (pressed || released) {
+    esp_timer_start_once(buttonDebounceTimer, BUTTON_DEBOUNCE_MILLIS * 1000);
+  }
+  if (pressed) {
+    esp_timer_start_once(buttonHoldTimer, LONG_PRESS_DURATION_MILLIS * 1000);
+  }
+  if (released) {
+    esp_timer_stop(buttonHoldTimer);
+  }
+  if (shortPress) {
+    postButtonEvent(BUTTON_SHORT_PRESS, pressedUs, nowUs, fromIsr);
+  }
+}
+
+// End of the debounce period. Stop ignoring edges, and catch any change the bounces hid.
+void buttonDebounceTimerCallback(void *arg) {
+  portENTER_CRITICAL(&buttonMux);
+  buttonSettling = false;
+  portEXIT_CRITICAL(&buttonMux);
+  updateButton(esp_timer_get_time(), false);
+}
+
+// The button has been held long enough to be a long press, or longer still to count as held
+void buttonHoldTimerCallback(void *arg) {
+  int64_t nowUs = esp_timer_get_time();
+  int stage = 0;
+  int64_t pressedUs = 0;
+
+  portENTER_CRITICAL(&buttonMux);
+  if (buttonDown && buttonHoldStage < 2) {
+    stage = ++buttonHoldStage;
+    pressedUs = buttonPressedUs;
+  }
+  portEXIT_CRITICAL(&buttonMux);
+
+  if (stage == 1) {
+    postButtonEvent(BUTTON_LONG_PRESS, pressedUs, nowUs, false);
+    esp_timer_start_once(buttonHoldTimer, (BUTTON_HELD_DURATION_MILLIS - LONG_PRESS_DURATION_MILLIS) * 1000);
+  } else if (stage == 2) {
+    postButtonEvent(BUTTON_HELD, pressedUs, nowUs, false);
+  }
+}
+
+// Add an event to the queue. If the queue is full the event is dropped.
+void IRAM_ATTR postButtonEvent(ButtonEventType type, int64_t pressedUs, int64_t atUs, bool fromIsr) {
+  ButtonEvent event = { type, pressedUs, atUs };
+  if (fromIsr) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xQueueSendFromISR(buttonQueue, &event, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) {
+      portYIELD_FROM_ISR();
+    }
+  } else {
+    xQueueSend(buttonQueue, &event, 0);
+  }
+}
@@ -0,0 +1,35 @@
+// Big Mouth Phatt Bass button handling
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// The button is handled by a GPIO interrupt, which timestamps each edge. The first edge of a
+// change is acted on straight away, then bounces are ignored until a debounce timer checks the
+// settled level. Presses are classified by timers and posted to an event queue for the input task.
+//
+// In normal mode the chip can deep sleep between performances, woken by the button through ext0.
+// That restarts the program, so the press that woke us is picked up again by setupButton().
+
+#pragma once
+
+#include <Arduino.h>
+
+enum ButtonEventType {
+  BUTTON_SHORT_PRESS, // Released before LONG_PRESS_DURATION_MILLIS
+  BUTTON_LONG_PRESS,  // Still held at LONG_PRESS_DURATION_MILLIS
+  BUTTON_HELD         // Still held at BUTTON_HELD_DURATION_MILLIS
+};
+
+// A classified button press. Times are in micros (see timeNowUs()).
+struct ButtonEvent {
+  ButtonEventType type;
+  int64_t pressedUs; // When the button went down
+  int64_t atUs;      // When the press was classified
+};
+
+void setupButton();
+boolean isButtonPushed();
+bool isButtonBusy();
+bool waitForButtonEvent(ButtonEvent &event, uint32_t timeoutMs);
+void lightSleepUntilButtonPushed(int64_t wakeAtUs = -1);
+void deepSleepUntilButtonPushed();
+bool wasWokenByButton();
+const char *buttonEventName(ButtonEventType type);
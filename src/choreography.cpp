@@ -0,0 +1,309 @@
+// Big Mouth Phatt Bass choreography player
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "choreography.h"
+#include "leadtime.h"
+#include "motors.h"
+#include "mp3player.h"
+#include "timing.h"
+#include "upload.h"
+
+// Mount the LittleFS partition holding the choreography files. Returns false if it could not be mounted.
+bool setupChoreography() {
+  return LittleFS.begin(false);
+}
+
+// Start reading a choreography by number (see tracks.h): one uploaded into RAM if there is one, else
+// its file on LittleFS if there is a valid one, otherwise the copy built into the firmware. Call
+// reader.end() when done, which closes the file or lets an upload be replaced. Returns false if the
+// track doesn't exist in any of them.
+bool openChoreography(int number, File &file, ChoreographyReader &reader) {
+  size_t size;
+  const uint8_t *uploaded = acquireUploadedChoreography(number, size);
+  if (uploaded != nullptr) {
+    return reader.begin(uploaded, size); // Checked when it was uploaded
+  }
+
+  char path[32];
+  snprintf(path, sizeof(path), CHOREOGRAPHY_PATH_FORMAT, number);
+  file = LittleFS.open(path, "r");
+  if (file) {
+    if (reader.begin(file)) {
+      return true;
+    }
+    file.close();
+  }
+
+  for (size_t i = 0; i < builtinChoreographyCount; i++) {
+    if (builtinChoreographies[i].number == number) {
+      return reader.begin(builtinChoreographies[i].data, builtinChoreographies[i].size);
+    }
+  }
+  return false;
+}
+
+// Play a choreography by number, operating the motors in time to music. The music is already
+// playing at this point so we just have to move motors accordingly. Event times are measured from
+// epochUs (from timeNowUs()), the moment the music started. The performance ends when the MP3
+// player reports the track has finished, rather than after the choreography's fixed tail, unless
+// the player doesn't give feedback, or when it is cancelled (see requestCancel()). Returns false if
+// there is no such choreography, see openChoreography().
+//
+// Each motor is switched on early by its lead time (see leadtime.h), so the movement lands on the
+// event time. Lead times differ, so events are read a little ahead and fired in order of when the
+// motor has to be switched on, rather than the order in the file. A motor's own movements are never
+// reordered, though: if a longer lead time would switch one on before the movement ahead of it, it
+// is held back until just after that one, so the motor still goes through every state in turn.
+//
+// A move that puts a motor straight back as it was, at the same moment, cancels the move before it,
+// e.g. the close and the reopen from one mouthOpenFor straight after another. Neither is fired, so
+// the mouth stays open, as it did in the original firmware, whatever the lead times.
+bool playChoreography(int number, int64_t epochUs) {
+  File file;
+  ChoreographyReader reader;
+  if (!openChoreography(number, file, reader)) {
+    return false;
+  }
+
+  ChoreographyEvent event;
+  PendingChoreographyEvent pending[CHOREOGRAPHY_LOOKAHEAD_EVENTS];
+  int pendingCount = 0;
+  int64_t eventTimeUs = epochUs; // Time of the last event read
+  int64_t endUs = -1;            // Time of the end event, once read
+  int64_t startUs = timeNowUs(); // Events at the very start can't be fired any earlier than this
+  int64_t lastFireUs[2] = { startUs, startUs }; // Latest fire time read for each actuator
+  int64_t fireBeforeUs[2] = { startUs, startUs }; // ...and before its last event, for cancelling that
+  int64_t lastEventUs[2] = { -1, -1 };             // Time of each actuator's last event
+  uint8_t state[2] = { CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST };
+  uint8_t stateBefore[2] = { CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST };
+  bool ended = false;
+  while (true) {
+    // Read ahead until no unread event could need firing before the earliest pending one
+    while (!ended && pendingCount < CHOREOGRAPHY_LOOKAHEAD_EVENTS
+        && (pendingCount == 0 || eventTimeUs - getMaxLeadTimeUs() <= pending[nextPendingEvent(pending, pendingCount)].fireUs)) {
+      if (!reader.next(event)) {
+        ended = true;
+        break;
+      }
+      eventTimeUs += event.deltaMs * 1000LL;
+      if (event.action == CHOREOGRAPHY_ACTION_END) {
+        endUs = eventTimeUs;
+        ended = true;
+        break;
+      }
+      int actuator = choreographyActuator(event.action);
+      if (eventTimeUs == lastEventUs[actuator] && event.action == stateBefore[actuator]
+          && cancelPendingEvent(pending, pendingCount, state[actuator])) {
+        state[actuator] = stateBefore[actuator];
+        lastFireUs[actuator] = fireBeforeUs[actuator];
+        continue;
+      }
+      if (eventTimeUs != lastEventUs[actuator]) {
+        stateBefore[actuator] = state[actuator];
+        lastEventUs[actuator] = eventTimeUs;
+      }
+      state[actuator] = event.action;
+      fireBeforeUs[actuator] = lastFireUs[actuator];
+      lastFireUs[actuator] = max(eventTimeUs - getLeadTimeUs(event.action), lastFireUs[actuator]);
+      pending[pendingCount++] = { lastFireUs[actuator], event.action };
+    }
+    if (pendingCount == 0) {
+      if (endUs >= 0) {
+        waitForTrackEnd(epochUs, endUs);
+      }
+      break;
+    }
+
+    // Events due at the same moment, like the head and mouth moving together, are committed as one
+    // frame. Two for the same actuator go in separate frames, one straight after the other.
+    int64_t fireUs = pending[nextPendingEvent(pending, pendingCount)].fireUs;
+    sleepUntil(fireUs);
+    if (isCancelRequested() || hasMP3TrackFinishedSince(epochUs)) {
+      break;
+    }
+    ActuatorFrame frame = getActuatorFrame();
+    bool moved[2] = { false, false };
+    int next;
+    while (pendingCount > 0 && pending[next = nextPendingEvent(pending, pendingCount)].fireUs == fireUs
+        && !moved[choreographyActuator(pending[next].action)]) {
+      moved[choreographyActuator(pending[next].action)] = true;
+      applyChoreographyAction(frame, pending[next].action);
+      memmove(&pending[next], &pending[next + 1], (pendingCount - next - 1) * sizeof(pending[0]));
+      pendingCount--;
+    }
+    commitActuatorFrame(frame);
+  }
+  reader.end();
+  return true;
+}
+
+// Index of the pending event to fire first: the earliest, or the first read if there's a tie
+int nextPendingEvent(const PendingChoreographyEvent *pending, int count) {
+  int next = 0;
+  for (int i = 1; i < count; i++) {
+    if (pending[i].fireUs < pending[next].fireUs) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+// Remove the last pending event for the actuator that an action moves, if it is that action, see
+// playChoreography(). Returns false if it isn't, e.g. because it has already been fired.
+bool cancelPendingEvent(PendingChoreographyEvent *pending, int &count, uint8_t action) {
+  for (int i = count - 1; i >= 0; i--) {
+    if (choreographyActuator(pending[i].action) == choreographyActuator(action)) {
+      if (pending[i].action != action) {
+        return false;
+      }
+      memmove(&pending[i], &pending[i + 1], (count - i - 1) * sizeof(pending[0]));
+      count--;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Wait for the MP3 player to report that the track started at epochUs has finished. If the player
+// has never given us feedback, we just wait until endUs, the end of the choreography. Returns early
+// if the performance is cancelled.
+void waitForTrackEnd(int64_t epochUs, int64_t endUs) {
+  int64_t timeoutUs = endUs;
+  if (getMP3PlayerStatus().acks > 0) {
+    timeoutUs += MP3_TRACK_END_TIMEOUT_MILLIS * 1000LL;
+  }
+  while (timeNowUs() < timeoutUs) {
+    if (hasMP3TrackFinishedSince(epochUs) || !waitUntilOrCancelled(timeNowUs() + 10000)) {
+      return;
+    }
+  }
+}
+
+// Which motor a choreography action moves: 0 for the head and tail, 1 for the mouth
+int choreographyActuator(uint8_t action) {
+  return (action & 0xF0) == 0x00 ? 0 : 1;
+}
+
+// Move the motors as instructed by a choreography action
+void performChoreographyAction(uint8_t action) {
+  ActuatorFrame frame = getActuatorFrame();
+  applyChoreographyAction(frame, action);
+  commitActuatorFrame(frame);
+}
+
+// Update a frame of motor states with a choreography action, without moving anything yet
+void applyChoreographyAction(ActuatorFrame &frame, uint8_t action) {
+  switch (action) {
+    case CHOREOGRAPHY_ACTION_HEADTAIL_REST:
+    case CHOREOGRAPHY_ACTION_HEAD_OUT:
+    case CHOREOGRAPHY_ACTION_TAIL_OUT:
+      frame.headTail = action;
+      break;
+    case CHOREOGRAPHY_ACTION_MOUTH_REST:
+    case CHOREOGRAPHY_ACTION_MOUTH_OPEN:
+    case CHOREOGRAPHY_ACTION_MOUTH_CLOSE:
+      frame.mouth = action;
+      frame.mouthAmplitude = MOTOR_AMPLITUDE_FULL;
+      break;
+    default:
+      if ((action & 0xF0) == CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY) {
+        frame.mouth = CHOREOGRAPHY_ACTION_MOUTH_OPEN;
+        frame.mouthAmplitude = (action & 0x0F) * 10;
+      }
+      break;
+  }
+}
+
+// Start reading a choreography file, checking its header. Returns false if the file is not a
+// choreography file this version of the code understands.
+bool ChoreographyReader::begin(File &choreographyFile) {
+  file = &choreographyFile;
+  data = nullptr;
+  bufferLength = 0;
+  bufferPosition = 0;
+  return readHeader();
+}
+
+// Start reading a choreography held in memory, such as a built-in one. The data isn't copied, so
+// it has to outlive the reader. Returns false if it's not a choreography we understand.
+bool ChoreographyReader::begin(const uint8_t *choreographyData, size_t size) {
+  file = nullptr;
+  data = choreographyData;
+  dataSize = size;
+  bufferPosition = 0;
+  return readHeader();
+}
+
+// Finish reading: close the file, or let go of an uploaded choreography so it can be replaced
+void ChoreographyReader::end() {
+  if (file != nullptr) {
+    file->close();
+    file = nullptr;
+  }
+  if (data != nullptr) {
+    releaseUploadedChoreography(data);
+    data = nullptr;
+  }
+}
+
+// Read and check the header, see begin()
+bool ChoreographyReader::readHeader() {
+  uint8_t header[CHOREOGRAPHY_HEADER_SIZE];
+  for (int i = 0; i < CHOREOGRAPHY_HEADER_SIZE; i++) {
+    int b = readByte();
+    if (b < 0) {
+      return false;
+    }
+    header[i] = b;
+  }
+  if (memcmp(header, CHOREOGRAPHY_MAGIC, 4) != 0 || header[4] != CHOREOGRAPHY_VERSION) {
+    return false;
+  }
+  durationMs = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t) header[11] << 24);
+  return true;
+}
+
+// Read the next event. Returns false at the end of the file, or if the file is truncated or has a
+// partial mouth opening with an amplitude outside 1-9 tenths, which would drive the motor at no
+// duty or more than full.
+bool ChoreographyReader::next(ChoreographyEvent &event) {
+  // Delta time is an unsigned LEB128 varint, seven bits per byte, least significant first
+  uint32_t delta = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    int b = readByte();
+    if (b < 0) {
+      return false;
+    }
+    delta |= (uint32_t) (b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      int action = readByte();
+      if (action < 0 || ((action & 0xF0) == CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY
+          && ((action & 0x0F) < 1 || (action & 0x0F) > 9))) {
+        return false;
+      }
+      event.deltaMs = delta;
+      event.action = action;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read a single byte from the file, refilling the buffer as needed, or from the data if reading
+// from memory. Returns -1 at the end.
+int ChoreographyReader::readByte() {
+  if (file == nullptr) {
+    return bufferPosition < dataSize ? data[bufferPosition++] : -1;
+  }
+  if (bufferPosition >= bufferLength) {
+    bufferLength = file->read(buffer, sizeof(buffer));
+    bufferPosition = 0;
+    if (bufferLength == 0) {
+      return -1;
+    }
+  }
+  return buffer[bufferPosition++];
+}
@@ -0,0 +1,100 @@
+// Big Mouth Phatt Bass choreography player
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Each song's motor movements are stored as a choreography file on the LittleFS partition, built
+// from the scripts in the "choreography" folder by tools/choreo.py. The file format is:
+//
+//   Header (12 bytes):
+//     "BMPC"          Magic number
+//     uint8           Format version (CHOREOGRAPHY_VERSION)
+//     uint8[3]        Reserved, zero
+//     uint32 LE       Total duration in millis
+//   Events, repeated until an end event:
+//     varint          Time in millis since the previous event (unsigned LEB128)
+//     uint8           Action, with the actuator in the high nibble and its new state in the low nibble
+//
+// The final event is always CHOREOGRAPHY_ACTION_END, whose delta holds the tail of the song after
+// the last movement. It is only used if the MP3 player can't tell us when the track finishes.
+//
+// The same songs are also built into the firmware as const tables (see choreographydsl.h and
+// builtinchoreography.cpp, generated from the scripts), so the fish can still perform with an
+// empty or unmounted filesystem. A file on LittleFS takes precedence over the built-in copy, so
+// songs can still be updated without reflashing the firmware. A choreography uploaded into RAM over
+// USB serial (see upload.h) takes precedence over both, for tuning a routine.
+//
+// CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY opens the mouth part of the way, with the amplitude in
+// tenths (1-9) in its low nibble. Firmware from before it was added ignores it. Any other amplitude
+// is refused by ChoreographyReader, as if the file were corrupt.
+
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+#include "motors.h"
+
+#define CHOREOGRAPHY_MAGIC "BMPC"
+#define CHOREOGRAPHY_VERSION 1
+#define CHOREOGRAPHY_HEADER_SIZE 12
+
+#define CHOREOGRAPHY_ACTION_HEADTAIL_REST 0x00
+#define CHOREOGRAPHY_ACTION_HEAD_OUT 0x01
+#define CHOREOGRAPHY_ACTION_TAIL_OUT 0x02
+#define CHOREOGRAPHY_ACTION_MOUTH_REST 0x10
+#define CHOREOGRAPHY_ACTION_MOUTH_OPEN 0x11
+#define CHOREOGRAPHY_ACTION_MOUTH_CLOSE 0x12
+#define CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY 0x20
+#define CHOREOGRAPHY_ACTION_END 0xFF
+
+// A single choreography event: wait deltaMs after the previous event, then perform action
+struct ChoreographyEvent {
+  uint32_t deltaMs;
+  uint8_t action;
+};
+
+// An event read ahead, waiting for the time to switch its motor on
+struct PendingChoreographyEvent {
+  int64_t fireUs;
+  uint8_t action;
+};
+
+// A song built into the firmware, see builtinchoreography.cpp
+struct BuiltinChoreography {
+  int number;
+  const uint8_t *data;
+  size_t size;
+};
+
+extern const BuiltinChoreography builtinChoreographies[];
+extern const size_t builtinChoreographyCount;
+
+// Reads choreography events from a file through a small fixed-size buffer, or straight from a
+// built-in table
+class ChoreographyReader {
+public:
+  bool begin(File &file);
+  bool begin(const uint8_t *data, size_t size);
+  bool next(ChoreographyEvent &event);
+  void end();
+  uint32_t durationMs = 0;
+
+private:
+  bool readHeader();
+  int readByte();
+  File *file = nullptr;
+  const uint8_t *data = nullptr;
+  size_t dataSize = 0;
+  uint8_t buffer[CHOREOGRAPHY_READ_BUFFER_SIZE];
+  size_t bufferLength = 0;
+  size_t bufferPosition = 0;
+};
+
+bool setupChoreography();
+bool openChoreography(int number, File &file, ChoreographyReader &reader);
+bool playChoreography(int number, int64_t epochUs);
+int nextPendingEvent(const PendingChoreographyEvent *pending, int count);
+bool cancelPendingEvent(PendingChoreographyEvent *pending, int &count, uint8_t action);
+void waitForTrackEnd(int64_t epochUs, int64_t endUs);
+int choreographyActuator(uint8_t action);
+void performChoreographyAction(uint8_t action);
+void applyChoreographyAction(ActuatorFrame &frame, uint8_t action);
@@ -0,0 +1,312 @@
+// Big Mouth Phatt Bass built-in choreography
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// A compile time version of the choreography scripts (see tools/choreo.py), so songs can be built
+// into the firmware as const tables in flash, in the same format as the files on LittleFS. Each
+// song is a list of steps mirroring the script statements:
+//
+//   constexpr Step phattBass[] = { sleep(3000), headOut(), mouthOpenFor(1000), repeat(10),
+//       flapTailFor(800, 200), end() };
+//   BUILTIN_CHOREOGRAPHY(phattBass, 180000);
+//
+// which checks the steps and defines phattBassData, a std::array holding the encoded song. The
+// checks are static_asserts, so a mistake stops the build rather than spoiling a performance:
+// repeats must have matching ends, flap runtimes must be a whole number of flaps, a motor can't be
+// moved two ways at the same moment (unless the second puts it back as it was), and the choreography must fit in the track's length.
+//
+// Steps and songs are declared inside namespace dsl, as the step names would otherwise clash with
+// the motor functions. Beat-locked bops aren't supported; tools/choreo.py writes them out as
+// individual moves when it exports the scripts.
+
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include "choreography.h"
+
+#define DSL_MAX_REPEAT_DEPTH 8
+
+// Check a song's steps and encode them, as described above
+#define BUILTIN_CHOREOGRAPHY(steps, lengthMs) \
+  static_assert(dsl::checkRepeats(dsl::steps), #steps ": every repeat needs an end, nested at most 8 deep"); \
+  static_assert(dsl::checkFlaps(dsl::steps), #steps ": flap runtimes must be a multiple of twice the interval"); \
+  static_assert(dsl::checkOverlaps(dsl::steps), #steps ": a motor is moved two ways at the same moment"); \
+  static_assert(dsl::durationMs(dsl::steps) <= (lengthMs), #steps ": the choreography is longer than the track"); \
+  constexpr auto steps##Data = dsl::encode<dsl::encodedSize(dsl::steps, (lengthMs))>(dsl::steps, (lengthMs))
+
+namespace dsl {
+
+enum StepType : uint8_t {
+  STEP_SLEEP,  // Wait runtimeMs
+  STEP_MOVE,   // Perform the out actions
+  STEP_FOR,    // Perform the out actions, wait runtimeMs, perform the in actions
+  STEP_FLAP,   // Out, wait intervalMs, in, wait intervalMs, for runtimeMs
+  STEP_REPEAT, // Run the steps up to the matching STEP_END runtimeMs times
+  STEP_END,
+};
+
+constexpr uint8_t NO_ACTION = 0xFE;
+
+struct Step {
+  StepType type;
+  uint32_t runtimeMs;
+  uint32_t intervalMs;
+  uint8_t out[2];
+  uint8_t in[2];
+};
+
+// The action that opens the mouth to an amplitude in percent, rounded to the nearest 10
+constexpr uint8_t mouthOpenAction(uint8_t amplitudePercent) {
+  return (amplitudePercent + 5) / 10 >= 10 ? CHOREOGRAPHY_ACTION_MOUTH_OPEN
+      : CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY | ((amplitudePercent + 5) / 10);
+}
+
+// Steps, as in the scripts
+
+constexpr Step sleep(uint32_t timeMs) {
+  return { STEP_SLEEP, timeMs, 0, { NO_ACTION, NO_ACTION }, { NO_ACTION, NO_ACTION } };
+}
+
+constexpr Step move(uint8_t action) {
+  return { STEP_MOVE, 0, 0, { action, NO_ACTION }, { NO_ACTION, NO_ACTION } };
+}
+
+constexpr Step headOut() {
+  return move(CHOREOGRAPHY_ACTION_HEAD_OUT);
+}
+
+constexpr Step tailOut() {
+  return move(CHOREOGRAPHY_ACTION_TAIL_OUT);
+}
+
+constexpr Step headTailRest() {
+  return move(CHOREOGRAPHY_ACTION_HEADTAIL_REST);
+}
+
+constexpr Step mouthOpen(uint8_t amplitudePercent = 100) {
+  return move(mouthOpenAction(amplitudePercent));
+}
+
+constexpr Step mouthClose() {
+  return move(CHOREOGRAPHY_ACTION_MOUTH_CLOSE);
+}
+
+constexpr Step mouthRest() {
+  return move(CHOREOGRAPHY_ACTION_MOUTH_REST);
+}
+
+constexpr Step mouthOpenFor(uint32_t runtimeMs, uint8_t amplitudePercent = 100) {
+  return { STEP_FOR, runtimeMs, 0, { mouthOpenAction(amplitudePercent), NO_ACTION },
+      { CHOREOGRAPHY_ACTION_MOUTH_CLOSE, NO_ACTION } };
+}
+
+constexpr Step flapMouthFor(uint32_t runtimeMs, uint32_t intervalMs, uint8_t amplitudePercent = 100) {
+  return { STEP_FLAP, runtimeMs, intervalMs, { mouthOpenAction(amplitudePercent), NO_ACTION },
+      { CHOREOGRAPHY_ACTION_MOUTH_CLOSE, NO_ACTION } };
+}
+
+constexpr Step flapMouthAndTailTogetherFor(uint32_t runtimeMs, uint32_t intervalMs) {
+  return { STEP_FLAP, runtimeMs, intervalMs, { CHOREOGRAPHY_ACTION_MOUTH_OPEN, CHOREOGRAPHY_ACTION_TAIL_OUT },
+      { CHOREOGRAPHY_ACTION_MOUTH_CLOSE, CHOREOGRAPHY_ACTION_HEADTAIL_REST } };
+}
+
+constexpr Step flapHeadFor(uint32_t runtimeMs, uint32_t intervalMs) {
+  return { STEP_FLAP, runtimeMs, intervalMs, { CHOREOGRAPHY_ACTION_HEAD_OUT, NO_ACTION },
+      { CHOREOGRAPHY_ACTION_HEADTAIL_REST, NO_ACTION } };
+}
+
+constexpr Step flapTailFor(uint32_t runtimeMs, uint32_t intervalMs) {
+  return { STEP_FLAP, runtimeMs, intervalMs, { CHOREOGRAPHY_ACTION_TAIL_OUT, NO_ACTION },
+      { CHOREOGRAPHY_ACTION_HEADTAIL_REST, NO_ACTION } };
+}
+
+constexpr Step repeat(uint32_t count) {
+  return { STEP_REPEAT, count, 0, { NO_ACTION, NO_ACTION }, { NO_ACTION, NO_ACTION } };
+}
+
+constexpr Step end() {
+  return { STEP_END, 0, 0, { NO_ACTION, NO_ACTION }, { NO_ACTION, NO_ACTION } };
+}
+
+// Compiling
+
+// Call visit(timeMs, action) for each action a song performs, in order, as choreo.py executes a
+// script. Returns the song's duration. Flaps round their runtime down to a whole number of flaps,
+// as in the scripts; checkFlaps() makes sure there's nothing to round.
+template <size_t N, typename Visitor>
+constexpr uint32_t expand(const Step (&steps)[N], Visitor &&visit) {
+  uint32_t timeMs = 0;
+  size_t loopStart[DSL_MAX_REPEAT_DEPTH] = {};
+  uint32_t loopsLeft[DSL_MAX_REPEAT_DEPTH] = {};
+  int depth = 0;
+  for (size_t i = 0; i < N; i++) {
+    const Step &step = steps[i];
+    switch (step.type) {
+      case STEP_SLEEP:
+        timeMs += step.runtimeMs;
+        break;
+      case STEP_MOVE:
+      case STEP_FOR:
+        for (uint8_t action : step.out) {
+          if (action != NO_ACTION) {
+            visit(timeMs, action);
+          }
+        }
+        if (step.type == STEP_FOR) {
+          timeMs += step.runtimeMs;
+          for (uint8_t action : step.in) {
+            if (action != NO_ACTION) {
+              visit(timeMs, action);
+            }
+          }
+        }
+        break;
+      case STEP_FLAP:
+        for (uint32_t flap = 0; step.intervalMs > 0 && flap < step.runtimeMs / step.intervalMs / 2; flap++) {
+          for (uint8_t action : step.out) {
+            if (action != NO_ACTION) {
+              visit(timeMs, action);
+            }
+          }
+          timeMs += step.intervalMs;
+          for (uint8_t action : step.in) {
+            if (action != NO_ACTION) {
+              visit(timeMs, action);
+            }
+          }
+          timeMs += step.intervalMs;
+        }
+        break;
+      case STEP_REPEAT:
+        if (step.runtimeMs > 0 && depth < DSL_MAX_REPEAT_DEPTH) {
+          loopStart[depth] = i;
+          loopsLeft[depth] = step.runtimeMs;
+          depth++;
+        } else {
+          // Skip to the matching end
+          for (int nested = 1; nested > 0 && i + 1 < N; ) {
+            i++;
+            nested += steps[i].type == STEP_REPEAT ? 1 : steps[i].type == STEP_END ? -1 : 0;
+          }
+        }
+        break;
+      case STEP_END:
+        if (depth > 0 && --loopsLeft[depth - 1] > 0) {
+          i = loopStart[depth - 1];
+        } else if (depth > 0) {
+          depth--;
+        }
+        break;
+    }
+  }
+  return timeMs;
+}
+
+// Every repeat has a matching end, and they aren't nested too deeply
+template <size_t N>
+constexpr bool checkRepeats(const Step (&steps)[N]) {
+  int depth = 0;
+  for (const Step &step : steps) {
+    depth += step.type == STEP_REPEAT ? 1 : step.type == STEP_END ? -1 : 0;
+    if (depth < 0 || depth > DSL_MAX_REPEAT_DEPTH) {
+      return false;
+    }
+  }
+  return depth == 0;
+}
+
+// Every flap's runtime is a whole number of flaps
+template <size_t N>
+constexpr bool checkFlaps(const Step (&steps)[N]) {
+  for (const Step &step : steps) {
+    if (step.type == STEP_FLAP && (step.intervalMs == 0 || step.runtimeMs % (step.intervalMs * 2) != 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Which motor an action moves: 0 for the head and tail, 1 for the mouth
+constexpr int actuator(uint8_t action) {
+  return (action & 0xF0) == CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY ? 1 : action >> 4;
+}
+
+// No motor is moved two different ways at the same moment. Songs run forwards in time, so only
+// each motor's last move has to be remembered.
+template <size_t N>
+constexpr bool checkOverlaps(const Step (&steps)[N]) {
+  bool ok = true;
+  uint32_t lastTimeMs[2] = { UINT32_MAX, UINT32_MAX };
+  uint8_t stateBefore[2] = { CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST };
+  uint8_t state[2] = { CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST };
+  expand(steps, [&](uint32_t timeMs, uint8_t action) {
+    int motor = actuator(action);
+    if (lastTimeMs[motor] != timeMs) {
+      lastTimeMs[motor] = timeMs;
+      stateBefore[motor] = state[motor];
+    } else if (action != state[motor] && action != stateBefore[motor]) {
+      ok = false; // A second move at the same moment can only put the motor back as it was
+    }
+    state[motor] = action;
+  });
+  return ok;
+}
+
+template <size_t N>
+constexpr uint32_t durationMs(const Step (&steps)[N]) {
+  return expand(steps, [](uint32_t, uint8_t) {});
+}
+
+// Bytes taken by a varint, see choreography.h
+constexpr size_t varintSize(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+// Size of the encoded song, with its end event at the end of the track
+template <size_t N>
+constexpr size_t encodedSize(const Step (&steps)[N], uint32_t lengthMs) {
+  size_t size = CHOREOGRAPHY_HEADER_SIZE;
+  uint32_t lastMs = 0;
+  expand(steps, [&](uint32_t timeMs, uint8_t) {
+    size += varintSize(timeMs - lastMs) + 1;
+    lastMs = timeMs;
+  });
+  return size + varintSize(lengthMs - lastMs) + 1;
+}
+
+// Encode a song in the choreography file format, with its end event at the end of the track
+template <size_t Size, size_t N>
+constexpr std::array<uint8_t, Size> encode(const Step (&steps)[N], uint32_t lengthMs) {
+  std::array<uint8_t, Size> data = {};
+  for (int i = 0; i < 4; i++) {
+    data[i] = CHOREOGRAPHY_MAGIC[i];
+  }
+  data[4] = CHOREOGRAPHY_VERSION;
+  for (int i = 0; i < 4; i++) {
+    data[8 + i] = (lengthMs >> (8 * i)) & 0xFF;
+  }
+
+  size_t position = CHOREOGRAPHY_HEADER_SIZE;
+  uint32_t lastMs = 0;
+  auto event = [&](uint32_t timeMs, uint8_t action) {
+    uint32_t delta = timeMs - lastMs;
+    lastMs = timeMs;
+    while (delta >= 0x80) {
+      data[position++] = (delta & 0x7F) | 0x80;
+      delta >>= 7;
+    }
+    data[position++] = delta;
+    data[position++] = action;
+  };
+  expand(steps, event);
+  event(lengthMs, CHOREOGRAPHY_ACTION_END);
+  return data;
+}
+
+} // namespace dsl
@@ -0,0 +1,165 @@
+// Big Mouth Phatt Bass configuration
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+// Debug mode - for lip sync testing - reduces volume to avoid annoying the family and autoplays chosen track
+#define DEBUG false
+#define DEBUG_VOLUME 10
+#define DEBUG_AUTOPLAY_TRACK 1
+#define SERIAL_BAUD_RATE 115200 // USB serial, used for reporting timing stats and console commands
+#define CONSOLE_LINE_LENGTH 64 // Longest console command over USB serial
+#define CONSOLE_UART_WAKE_EDGES 3 // Edges on the USB serial line that wake the fish from idle light sleep, 3 at least
+#define BOOT_TIMELINE_STAGES 8 // Stages of booting timed and reported over USB serial
+#define STATE_NVS_NAMESPACE "state" // Where the selected track and mode are kept, see state.h
+
+// Button and sensor pins
+#define BUTTON_PIN 4
+#define LDR_PIN 33
+#define LDR_ADC_CHANNEL ADC1_CHANNEL_5 // ADC channel of LDR_PIN, which the ULP coprocessor reads directly
+#define LONG_PRESS_DURATION_MILLIS 500 // How long do you hold the button down to count as a long press?
+#define BUTTON_HELD_DURATION_MILLIS 3000 // How long do you hold the button down to count as holding it?
+#define BUTTON_DEBOUNCE_MILLIS 20 // How long to ignore bounces for after the button changes state
+#define BUTTON_EVENT_QUEUE_SIZE 8
+#define BUTTON_EVENT_WAIT_MILLIS 1000 // How long the input task waits for a button event before checking whether it can sleep
+#define NORMAL_MODE_DEEP_SLEEP true // Deep sleep when idle in normal mode, woken by the button. False light sleeps instead.
+#define NORMAL_MODE_DEEP_SLEEP_AFTER_MILLIS 120000 // How long to stay idle in light sleep first, where a press plays at once
+
+// Light sensor settings
+#define LDR_FULL_SCALE 2500 // Raw ADC reading that counts as complete darkness
+#define SENSOR_TRIGGER_THRESHOLD 0.04 // Change in normalised light level (0-1) from the baseline that triggers a performance
+#define SENSOR_RELEASE_THRESHOLD 0.02 // Change that the light level has to come back within before it can trigger again
+#define SENSOR_SAMPLE_RATE 20000 // LDR samples per second while reading it
+#define SENSOR_WINDOW_MILLIS 20 // Samples are averaged over this long to cancel light flicker. 20 is a whole mains cycle at 50 Hz; use 50 to suit 60 Hz too.
+#define SENSOR_FILTER_SHIFT 1 // Filter takes 1/2^n of each new reading
+#define SENSOR_BASELINE_SHIFT 2 // Baseline moves 1/2^n of the way to the filtered level on each reading
+#define SENSOR_MODE_DEEP_SLEEP true // Deep sleep between performances in sensor mode, with the ULP watching the LDR. False polls it instead.
+#define SENSOR_POLL_MILLIS 200 // How often to check the LDR in sensor mode, if not deep sleeping
+#define SENSOR_ULP_SAMPLE_PERIOD_MILLIS 20 // How often the ULP checks the LDR while we deep sleep
+
+// ADC sampling settings, shared by the light sensor and live lipsync
+#define ADC_I2S_PORT I2S_NUM_0 // Only I2S0 can read the built-in ADC
+#define ADC_DMA_BUFFER_COUNT 4
+#define ADC_DMA_BUFFER_SAMPLES 64 // Per DMA buffer. Sets the delay before the CPU sees new samples.
+
+// Live lipsync settings, for tracks without a choreography file
+#define LIVE_LIPSYNC_ALWAYS false // Use live lipsync even for tracks that have a choreography file
+#define AUDIO_PIN 34 // MP3 player's DAC output, AC coupled and biased to mid-rail
+#define AUDIO_ADC_CHANNEL ADC1_CHANNEL_6 // ADC channel of AUDIO_PIN
+#define AUDIO_SAMPLE_RATE 8000
+#define AUDIO_BLOCK_SAMPLES 64 // Samples per RMS block, up to 256. Sets the audio to mouth latency along with ADC_DMA_BUFFER_SAMPLES.
+#define AUDIO_DC_SHIFT 10 // DC bias estimate takes 1/2^n of each sample
+#define AUDIO_ATTACK_SHIFT 1 // Envelope rises 1/2^n of the way to a louder block
+#define AUDIO_RELEASE_SHIFT 3 // Envelope falls 1/2^n of the way to a quieter block
+#define AUDIO_PEAK_DECAY_SHIFT 8 // Peak envelope falls by 1/2^n each block
+#define AUDIO_OPEN_PERCENT 50 // Mouth opens when the envelope rises above this percentage of the peak
+#define AUDIO_CLOSE_PERCENT 30 // Mouth closes when the envelope falls below this percentage of the peak
+#define AUDIO_NOISE_FLOOR 20 // RMS in raw ADC counts that counts as silence, however quiet the track
+#define AUDIO_MIN_MOUTH_MILLIS 80 // Shortest time between mouth movements, which the motor needs to follow
+#define AUDIO_SILENCE_END_MILLIS 3000 // Silence that ends the performance, if the MP3 player doesn't report the track ending
+
+// Motor control pins
+#define HEADTAIL_MOTOR_PIN_1 12
+#define HEADTAIL_MOTOR_PIN_2 14
+#define HEADTAIL_MOTOR_PWM_PIN 13
+#define MOUTH_MOTOR_PIN_1 27
+#define MOUTH_MOTOR_PIN_2 26
+#define MOUTH_MOTOR_PWM_PIN 25
+
+// Motor PWM settings
+#define PWM_FREQUENCY 1000
+#define PWM_RESOLUTION 8
+#define HEADTAIL_MOTOR_PWM_CHANNEL 0
+#define MOUTH_MOTOR_PWM_CHANNEL 1
+#define HEADTAIL_MOTOR_PWM_DUTY_CYCLE 255 // Proxy for motor speed, up to 2^resolution
+#define MOUTH_MOTOR_PWM_DUTY_CYCLE 255    // Proxy for motor speed, up to 2^resolution
+
+// Motor drive profiles, see motors.cpp
+#define MOTOR_PROFILES_ENABLED true // False drives the motors flat out for every movement
+#define MOTOR_KICK_PERCENT 50 // Duty each movement starts at, as a percentage of the duty cycles above
+#define MOTOR_RAMP_MILLIS 20 // Time to fade up to full duty. Keep it short, a new movement on the same motor waits for it.
+#define MOTOR_BRAKE_KICK_PERCENT 30 // Duty each rest starts braking at, ramping up to full like a movement
+#define MOTOR_HOLD_PERCENT 60 // Duty once the movement has reached its end stop
+#define MOTOR_HOLD_AFTER_MILLIS 150 // Time from the start of a movement to fading down to the holding duty
+#define MOTOR_HOLD_FADE_MILLIS 20 // Time to fade down to the holding duty. Keep it short, like the ramp.
+#define MOTOR_TEST_CYCLES 10 // Back and forth movements in each half of the motor test
+#define MOTOR_TEST_PERIOD_MILLIS 400 // Time for each back and forth movement in the motor test
+
+// Music player settings
+#define TRACK_NUMBER_FOR_SENSOR_MODE 1 // In sensor mode you don't get to select track, use this one
+#define MUSIC_VOLUME 20 // Up to 30, for the built-in tracks
+#define ANNOUNCER_VOLUME 10 // Up to 30
+#define MUSIC_FOLDER 1 // Corresponds to folder "01" on SD card, for the built-in tracks
+#define ANNOUNCER_FOLDER 2 // Corresponds to folder "02" on SD card
+#define SENSOR_MODE_ANNOUNCER_TRACK_NUMBER 99 // Corresponds to file "02/099.mp3" on SD card
+#define MP3_PLAYER_BAUD_RATE 9600
+#define MP3_COMMAND_QUEUE_SIZE 16 // Commands that can be waiting to be sent to the MP3 player
+#define MP3_COMMAND_SPACING_MILLIS 50 // Minimum time between commands, which the MP3 player needs to process each one
+#define MP3_PLAY_LATENCY_MILLIS 50 // Time from sending a play command to starting the choreography, as the songs were timed with
+#define MP3_ACK_TO_PLAY_MILLIS 25 // Time from the MP3 player acknowledging a play command to starting the choreography
+#define MP3_FEEDBACK_TIMEOUT_MILLIS 500 // How long to wait for the MP3 player to acknowledge a play command
+#define MP3_TRACK_END_TIMEOUT_MILLIS 5000 // How long past the end of the choreography to wait for the track to finish
+
+// Task settings. Motion gets a core to itself; comms and input share the other.
+#define MOTION_TASK_CORE 1
+#define MOTION_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define MOTION_TASK_STACK_SIZE 4096
+#define COMMS_TASK_CORE 0
+#define COMMS_TASK_PRIORITY 5
+#define COMMS_TASK_STACK_SIZE 3072
+#define COMMS_TASK_POLL_MILLIS 1 // How often the comms task checks for feedback from the MP3 player
+#define INPUT_TASK_CORE 0
+#define INPUT_TASK_PRIORITY 3
+#define INPUT_TASK_STACK_SIZE 4096
+#define TASK_WAIT_SLOTS 4 // Tasks whose waiting is timed for their CPU share, see startTaskWait()
+
+// Waiting, see waitUntil() in timing.cpp. Light sleep is only used for waits long enough that its
+// entry and exit, measured at boot, are a small part of them; shorter ones are a task delay
+// followed by spinning on the CPU cycle counter.
+#define TIMING_CALIBRATION_SLEEPS 4 // Light sleeps timed at boot, taking the worst
+#define TIMING_CALIBRATION_SLEEP_US 1000 // Length of each one
+#define TIMING_LIGHT_SLEEP_MIN_OVERHEADS 4 // Shortest wait to light sleep for, in multiples of the overhead
+#define TIMING_SPIN_MARGIN_US 100 // Left for spinning after a task delay, to cover the scheduler waking us late
+
+// Energy accounting, see energy.h. Estimated currents from the battery in each state, to be
+// replaced with measurements of your own fish. Motors are at their *_PWM_DUTY_CYCLE, on top of the CPU.
+#define ENERGY_AWAKE_MA 40.0
+#define ENERGY_LIGHT_SLEEP_MA 0.8
+#define ENERGY_DEEP_SLEEP_MA 0.15 // Including the ULP watching the LDR in sensor mode
+#define ENERGY_HEAD_OUT_MA 400.0
+#define ENERGY_TAIL_OUT_MA 400.0
+#define ENERGY_MOUTH_OPEN_MA 300.0
+#define ENERGY_MOUTH_CLOSE_MA 300.0
+#define ENERGY_UART_TX_MA 1.0 // Sending to the MP3 player
+#define ENERGY_NVS_NAMESPACE "energy"
+
+// Event trace settings, see trace.h
+#define TRACE_ENABLED true // Record motor, MP3 and sleep events. False compiles the recording out.
+#define TRACE_BUFFER_EVENTS 2048 // Events kept, a power of two. 8 bytes each; a busy song needs about 1500.
+
+// Motor lead times, see leadtime.h. The hand-timed scripts already allow for the motors' lag, so
+// these are zero unless calibrated. Calibrated values are stored in NVS and override these.
+#define LEAD_TIME_HEAD_OUT_MILLIS 0
+#define LEAD_TIME_TAIL_OUT_MILLIS 0
+#define LEAD_TIME_HEADTAIL_REST_MILLIS 0
+#define LEAD_TIME_MOUTH_OPEN_MILLIS 0
+#define LEAD_TIME_MOUTH_CLOSE_MILLIS 0
+#define LEAD_TIME_MOUTH_REST_MILLIS 0
+#define LEAD_TIME_MAX_MILLIS 250 // Longest lead time allowed
+#define LEAD_TIME_NVS_NAMESPACE "leadtimes"
+#define LEAD_CALIBRATION_CYCLES 16 // Movements made while calibrating
+#define LEAD_CALIBRATION_SKIP_CYCLES 4 // Movements ignored at the start, while the user finds the beat
+#define LEAD_CALIBRATION_PERIOD_MILLIS 1000 // Time between movements while calibrating
+
+// Track registry settings, see tracks.h
+#define TRACK_REGISTRY_PATH "/tracks.csv" // Track list on the LittleFS partition, replacing the built-in one
+#define TRACK_REGISTRY_MAX_TRACKS 512 // Tracks the file can list. 10 bytes of RAM each, only taken if there is a file.
+#define TRACK_REGISTRY_LINE_LENGTH 80 // Longest line in the file
+
+// Choreography settings
+#define CHOREOGRAPHY_PATH_FORMAT "/songs/%03d.chr" // Choreography file for each track on the LittleFS partition
+#define CHOREOGRAPHY_READ_BUFFER_SIZE 32 // Bytes read from flash at a time, so RAM use doesn't depend on song length
+#define CHOREOGRAPHY_LOOKAHEAD_EVENTS 8 // Events read ahead, so ones with longer lead times can be fired before earlier ones
+#define UPLOAD_SLOTS 2 // Choreographies that can be uploaded into RAM over USB serial at once, see upload.h
+#define UPLOAD_SLOT_BYTES 4096 // Largest choreography that can be uploaded. Each slot has two buffers this size.
+#define UPLOAD_TIMEOUT_MILLIS 2000 // Gap in an upload's data that abandons it
@@ -0,0 +1,128 @@
+// Big Mouth Phatt Bass serial console
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include "config.h"
+#include "console.h"
+#include "energy.h"
+#include "leadtime.h"
+#include "motors.h"
+#include "tasks.h"
+#include "timing.h"
+#include "trace.h"
+#include "tracks.h"
+#include "upload.h"
+
+char consoleLine[CONSOLE_LINE_LENGTH];
+int consoleLineLength = 0;
+
+// Read whatever has arrived over USB serial, and run each complete line, unless it's part of an
+// upload. Called regularly by the comms task.
+void pollConsole() {
+  if (pollUpload()) {
+    return;
+  }
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (consoleLineLength > 0) {
+        consoleLine[consoleLineLength] = '\0';
+        consoleLineLength = 0;
+        runConsoleCommand(consoleLine);
+      }
+    } else if (consoleLineLength < CONSOLE_LINE_LENGTH - 1) {
+      consoleLine[consoleLineLength++] = c;
+    }
+  }
+}
+
+// Run a console command
+void runConsoleCommand(char *line) {
+  char *command = strtok(line, " ");
+  char *arg1 = strtok(nullptr, " ");
+  char *arg2 = strtok(nullptr, " ");
+  char *arg3 = strtok(nullptr, " ");
+  if (command == nullptr) {
+    return;
+  }
+
+  if (strcmp(command, "T") == 0 || strcmp(command, "trace") == 0) {
+    dumpTrace();
+
+  } else if (strcmp(command, "energy") == 0) {
+    if (arg1 != nullptr && strcmp(arg1, "reset") == 0) {
+      resetEnergyTotals();
+    }
+    reportEnergy();
+
+  } else if (strcmp(command, "sleep") == 0) {
+    if (arg1 != nullptr && strcmp(arg1, "reset") == 0) {
+      resetSleepStats();
+    }
+    reportSleepStats();
+
+  } else if (strcmp(command, "upload") == 0 && arg3 != nullptr) {
+    startUpload(atoi(arg1), strtoul(arg2, nullptr, 10), strtoul(arg3, nullptr, 16));
+
+  } else if (strcmp(command, "slots") == 0) {
+    reportUploadSlots();
+
+  } else if (strcmp(command, "slot") == 0 && arg2 != nullptr) {
+    if (strcmp(arg1, "play") == 0) {
+      playUploadedChoreography(atoi(arg2));
+    } else if (strcmp(arg1, "commit") == 0) {
+      commitUploadedChoreography(atoi(arg2));
+    } else if (strcmp(arg1, "clear") == 0) {
+      clearUploadedChoreography(atoi(arg2));
+    } else {
+      Serial.printf("No such slot command %s\n", arg1);
+    }
+
+  } else if (strcmp(command, "tracks") == 0) {
+    reportTracks();
+
+  } else if (strcmp(command, "lead") == 0 && arg1 == nullptr) {
+    reportLeadTimes();
+
+  } else if (strcmp(command, "lead") == 0 && arg2 != nullptr) {
+    if (setLeadTimeMs(arg1, atoi(arg2))) {
+      Serial.printf("Lead time %s: %d ms, saved\n", arg1, atoi(arg2));
+    } else {
+      Serial.printf("Can't set lead time %s to %s ms, up to %d ms\n", arg1, arg2, LEAD_TIME_MAX_MILLIS);
+    }
+
+  } else if (strcmp(command, "calibrate") == 0 && arg1 != nullptr) {
+    int action = leadTimeAction(arg1);
+    if (action < 0) {
+      Serial.printf("No such action %s\n", arg1);
+    } else if (!requestCalibration(action)) {
+      Serial.println("Can't calibrate during a performance");
+    }
+
+  } else if (strcmp(command, "profiles") == 0) {
+    if (arg1 != nullptr && (strcmp(arg1, "on") == 0 || strcmp(arg1, "off") == 0)) {
+      setMotorProfilesEnabled(strcmp(arg1, "on") == 0);
+    }
+    Serial.printf("Motor drive profiles %s\n", areMotorProfilesEnabled() ? "on" : "off");
+
+  } else if (strcmp(command, "motortest") == 0) {
+    if (!requestMotorTest()) {
+      Serial.println("Can't test the motors during a performance");
+    }
+
+  } else {
+    Serial.println("Commands:");
+    Serial.println("  T | trace                 Dump the event trace, see tools/trace2chrome.py");
+    Serial.println("  tracks                    List the tracks, see tracks.h");
+    Serial.println("  upload <n> <bytes> <crc>  Upload choreography n into RAM, see upload.h and tools/choreo.py upload");
+    Serial.println("  slots                     List the uploaded choreographies");
+    Serial.println("  slot play|commit|clear <n>  Perform, save to LittleFS or drop uploaded choreography n");
+    Serial.println("  energy [reset]            Show the estimated battery use, or reset the running totals");
+    Serial.println("  sleep [reset]             Show how waits were split between light sleep, task delay and spinning");
+    Serial.println("  lead                      Show the motor lead times");
+    Serial.println("  lead <action> <ms>        Set an action's lead time, e.g. lead mouthOpen 40");
+    Serial.println("  calibrate <action>        Tap the button in time with the action to measure its lead time");
+    Serial.println("  profiles [on|off]         Show or set whether the motors use their soft start drive profiles");
+    Serial.println("  motortest                 Reverse both motors flat out, then with profiles, to compare peak current");
+  }
+}
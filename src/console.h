@@ -0,0 +1,14 @@
+// Big Mouth Phatt Bass serial console
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Commands typed over USB serial, one per line, handled by the comms task. The chip can't receive
+// while in light sleep. When idle in normal mode, serial activity wakes it, but loses the first few
+// characters, so press Enter first. Otherwise use them during or just after a performance, or after
+// pressing the button. Type "help" for the list.
+
+#pragma once
+
+#include <Arduino.h>
+
+void pollConsole();
+void runConsoleCommand(char *line);
@@ -0,0 +1,219 @@
+// Big Mouth Phatt Bass energy accounting
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <sys/time.h>
+#include "config.h"
+#include "choreography.h"
+#include "energy.h"
+#include "timing.h"
+
+void updateEnergyStats(int64_t nowUs);
+EnergyStats energyStatsBetween(const EnergyStats &from, const EnergyStats &to);
+int64_t energyWallUs(const EnergyStats &stats);
+void saveEnergyTotals();
+int64_t timeOfDayUs();
+
+const char *const energyStateNames[ENERGY_STATES] = {
+  "awake", "light sleep", "deep sleep", "head out", "tail out", "mouth open", "mouth close", "UART TX"
+};
+const float energyCurrentsMa[ENERGY_STATES] = {
+  ENERGY_AWAKE_MA, ENERGY_LIGHT_SLEEP_MA, ENERGY_DEEP_SLEEP_MA, ENERGY_HEAD_OUT_MA, ENERGY_TAIL_OUT_MA,
+  ENERGY_MOUTH_OPEN_MA, ENERGY_MOUTH_CLOSE_MA, ENERGY_UART_TX_MA
+};
+
+// What each motor is doing, so its time can be counted when it next changes
+struct MotorEnergy {
+  int state;            // EnergyState, or -1 if not driven
+  uint32_t dutyPercent; // Of its full duty cycle
+  int64_t sinceUs;
+};
+
+// Counters, and the counters when the totals were last saved. Kept through deep sleep.
+RTC_DATA_ATTR EnergyStats energyStats;
+RTC_DATA_ATTR EnergyStats energySavedStats;
+RTC_DATA_ATTR bool energyStatsValid = false;
+RTC_DATA_ATTR int64_t deepSleepStartedUs = 0; // Time of day, or 0 if we didn't deep sleep
+
+MotorEnergy motorEnergy[2] = { { -1, 0, 0 }, { -1, 0, 0 } };
+int64_t energyUpdatedUs = 0; // When the awake time was last brought up to date
+EnergyTotals energyTotals;
+portMUX_TYPE energyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Set up the counters, carrying on from before a deep sleep if that's what woke us, and load the
+// totals from NVS
+void setupEnergy() {
+  if (!energyStatsValid) {
+    energyStats = EnergyStats();
+    energySavedStats = EnergyStats();
+    energyStatsValid = true;
+  }
+  if (deepSleepStartedUs != 0) {
+    energyStats.us[ENERGY_DEEP_SLEEP] += max(timeOfDayUs() - deepSleepStartedUs, (int64_t) 0);
+    deepSleepStartedUs = 0;
+  }
+
+  energyTotals = EnergyTotals();
+  Preferences preferences;
+  if (preferences.begin(ENERGY_NVS_NAMESPACE, true)) {
+    // Totals saved by a build with a different layout are dropped
+    if (preferences.getBytesLength("totals") == sizeof(energyTotals)) {
+      preferences.getBytes("totals", &energyTotals, sizeof(energyTotals));
+    }
+    preferences.end();
+  }
+}
+
+// Count time spent in a state that's recorded after the fact, like a light sleep or a UART frame.
+// Sleeps are moved over from the awake time.
+void addEnergyTime(EnergyState state, int64_t us) {
+  portENTER_CRITICAL_SAFE(&energyMux);
+  energyStats.us[state] += us;
+  if (state == ENERGY_LIGHT_SLEEP) {
+    energyStats.us[ENERGY_AWAKE] -= us;
+  }
+  portEXIT_CRITICAL_SAFE(&energyMux);
+}
+
+// A motor (0 for head/tail, 1 for mouth) has started a movement, a choreography action, or
+// changed its duty. Rests aren't driven.
+void setMotorEnergyState(int motor, uint8_t action, uint32_t dutyPercent) {
+  int state = -1;
+  switch (action) {
+    case CHOREOGRAPHY_ACTION_HEAD_OUT:
+      state = ENERGY_HEAD_OUT;
+      break;
+    case CHOREOGRAPHY_ACTION_TAIL_OUT:
+      state = ENERGY_TAIL_OUT;
+      break;
+    case CHOREOGRAPHY_ACTION_MOUTH_OPEN:
+      state = ENERGY_MOUTH_OPEN;
+      break;
+    case CHOREOGRAPHY_ACTION_MOUTH_CLOSE:
+      state = ENERGY_MOUTH_CLOSE;
+      break;
+  }
+  int64_t nowUs = timeNowUs();
+  portENTER_CRITICAL_SAFE(&energyMux);
+  MotorEnergy &m = motorEnergy[motor];
+  if (m.state >= 0) {
+    energyStats.us[m.state] += (nowUs - m.sinceUs) * m.dutyPercent / 100;
+  }
+  m = { state, dutyPercent, nowUs };
+  portEXIT_CRITICAL_SAFE(&energyMux);
+}
+
+// The counters up to now
+EnergyStats getEnergyStats() {
+  int64_t nowUs = timeNowUs();
+  portENTER_CRITICAL(&energyMux);
+  updateEnergyStats(nowUs);
+  EnergyStats stats = energyStats;
+  portEXIT_CRITICAL(&energyMux);
+  return stats;
+}
+
+// Bring the awake time and running motors up to date. Call with energyMux held.
+void updateEnergyStats(int64_t nowUs) {
+  energyStats.us[ENERGY_AWAKE] += nowUs - energyUpdatedUs;
+  energyUpdatedUs = nowUs;
+  for (MotorEnergy &m : motorEnergy) {
+    if (m.state >= 0) {
+      energyStats.us[m.state] += (nowUs - m.sinceUs) * m.dutyPercent / 100;
+      m.sinceUs = nowUs;
+    }
+  }
+}
+
+// Estimated charge drawn, in mAh
+float energyMah(const EnergyStats &stats) {
+  float mah = 0;
+  for (int i = 0; i < ENERGY_STATES; i++) {
+    mah += stats.us[i] * energyCurrentsMa[i] / 3.6e9f;
+  }
+  return mah;
+}
+
+// The counters for the time from one snapshot to another
+EnergyStats energyStatsBetween(const EnergyStats &from, const EnergyStats &to) {
+  EnergyStats stats;
+  for (int i = 0; i < ENERGY_STATES; i++) {
+    stats.us[i] = to.us[i] - from.us[i];
+  }
+  return stats;
+}
+
+// Real time covered by some counters: the CPU is always either awake or asleep
+int64_t energyWallUs(const EnergyStats &stats) {
+  return stats.us[ENERGY_AWAKE] + stats.us[ENERGY_LIGHT_SLEEP] + stats.us[ENERGY_DEEP_SLEEP];
+}
+
+// Report a performance's energy, given the counters at its start, and add it and the idle time
+// before it to the totals
+void recordPerformanceEnergy(int tracknum, const EnergyStats &start) {
+  EnergyStats end = getEnergyStats();
+  EnergyStats performance = energyStatsBetween(start, end);
+  EnergyStats idle = energyStatsBetween(energySavedStats, start);
+  float mah = energyMah(performance);
+  Serial.printf("Track %d: %.3f mAh in %.1f s, motors %.1f s at full duty\n", tracknum, mah,
+      energyWallUs(performance) / 1e6,
+      (performance.us[ENERGY_HEAD_OUT] + performance.us[ENERGY_TAIL_OUT] + performance.us[ENERGY_MOUTH_OPEN]
+          + performance.us[ENERGY_MOUTH_CLOSE]) / 1e6);
+
+  energyTotals.performances++;
+  energyTotals.performanceUs += energyWallUs(performance);
+  energyTotals.performanceMah += mah;
+  energyTotals.idleUs += energyWallUs(idle);
+  energyTotals.idleMah += energyMah(idle);
+  energySavedStats = end;
+  saveEnergyTotals();
+}
+
+// Add the idle time so far to the totals, and note when we went to sleep so the time asleep can be
+// counted when we wake up. Call just before deep sleeping.
+void prepareEnergyForDeepSleep() {
+  EnergyStats now = getEnergyStats();
+  EnergyStats idle = energyStatsBetween(energySavedStats, now);
+  energyTotals.idleUs += energyWallUs(idle);
+  energyTotals.idleMah += energyMah(idle);
+  energySavedStats = now;
+  saveEnergyTotals();
+  deepSleepStartedUs = timeOfDayUs();
+}
+
+// Print the counters since startup and the running totals over USB serial
+void reportEnergy() {
+  EnergyStats stats = getEnergyStats();
+  Serial.printf("Since power on, %.3f mAh:\n", energyMah(stats));
+  for (int i = 0; i < ENERGY_STATES; i++) {
+    Serial.printf("  %-12s %10.1f s at %6.2f mA\n", energyStateNames[i], stats.us[i] / 1e6, energyCurrentsMa[i]);
+  }
+  EnergyTotals &totals = energyTotals;
+  Serial.printf("Totals: %u performances, %.3f mAh each on average; %.1f h idle, %.3f mAh per idle hour\n",
+      (unsigned) totals.performances, totals.performances > 0 ? totals.performanceMah / totals.performances : 0,
+      totals.idleUs / 3.6e9, totals.idleUs > 0 ? totals.idleMah / (totals.idleUs / 3.6e9) : 0);
+}
+
+// Clear the running totals, e.g. after changing the firmware or the batteries
+void resetEnergyTotals() {
+  energyTotals = EnergyTotals();
+  energySavedStats = getEnergyStats();
+  saveEnergyTotals();
+}
+
+// Write the running totals to NVS
+void saveEnergyTotals() {
+  Preferences preferences;
+  if (preferences.begin(ENERGY_NVS_NAMESPACE, false)) {
+    preferences.putBytes("totals", &energyTotals, sizeof(energyTotals));
+    preferences.end();
+  }
+}
+
+// Time of day in micros. Unlike timeNowUs(), this keeps counting through deep sleep.
+int64_t timeOfDayUs() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return now.tv_sec * 1000000LL + now.tv_usec;
+}
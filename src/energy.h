@@ -0,0 +1,52 @@
+// Big Mouth Phatt Bass energy accounting
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Counts the time spent in each power state, and multiplies it by a table of currents in config.h
+// to estimate the charge drawn from the battery. The CPU is counted as awake unless a light or deep
+// sleep is recorded. Each motor direction is counted on top, as full duty equivalent time: a motor
+// held at 60% of its *_PWM_DUTY_CYCLE for a second counts 0.6 s. Sending to the MP3 player counts
+// as UART TX, also on top. The currents are estimates until measured for a particular build.
+//
+// Each performance is reported over serial, and running totals of performances and of the idle
+// time between them are kept in NVS, so battery life can be worked out and builds compared. The
+// counters live in RTC memory, so they carry on through deep sleep.
+
+#pragma once
+
+#include <Arduino.h>
+
+enum EnergyState : uint8_t {
+  ENERGY_AWAKE,       // CPU running
+  ENERGY_LIGHT_SLEEP,
+  ENERGY_DEEP_SLEEP,
+  ENERGY_HEAD_OUT,    // Motors, on top of the CPU
+  ENERGY_TAIL_OUT,
+  ENERGY_MOUTH_OPEN,
+  ENERGY_MOUTH_CLOSE,
+  ENERGY_UART_TX,     // Sending to the MP3 player, on top of the CPU
+  ENERGY_STATES
+};
+
+// Time spent in each state, in micros
+struct EnergyStats {
+  int64_t us[ENERGY_STATES];
+};
+
+// Running totals, kept in NVS
+struct EnergyTotals {
+  uint32_t performances;
+  int64_t performanceUs;
+  float performanceMah;
+  int64_t idleUs;
+  float idleMah;
+};
+
+void setupEnergy();
+void addEnergyTime(EnergyState state, int64_t us);
+void setMotorEnergyState(int motor, uint8_t action, uint32_t dutyPercent);
+EnergyStats getEnergyStats();
+float energyMah(const EnergyStats &stats);
+void recordPerformanceEnergy(int tracknum, const EnergyStats &start);
+void prepareEnergyForDeepSleep();
+void reportEnergy();
+void resetEnergyTotals();
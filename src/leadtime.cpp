@@ -0,0 +1,199 @@
+// Big Mouth Phatt Bass motor lead times
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+#include "choreography.h"
+#include "leadtime.h"
+#include "motors.h"
+#include "timing.h"
+
+// A movement that has a lead time. "undo" is the movement that puts the motor back, so calibration
+// can repeat it.
+struct LeadTimeSetting {
+  uint8_t action;
+  const char *name;
+  uint8_t undo;
+  uint16_t defaultMs;
+};
+
+const LeadTimeSetting leadTimeSettings[] = {
+  { CHOREOGRAPHY_ACTION_HEAD_OUT, "headOut", CHOREOGRAPHY_ACTION_HEADTAIL_REST, LEAD_TIME_HEAD_OUT_MILLIS },
+  { CHOREOGRAPHY_ACTION_TAIL_OUT, "tailOut", CHOREOGRAPHY_ACTION_HEADTAIL_REST, LEAD_TIME_TAIL_OUT_MILLIS },
+  { CHOREOGRAPHY_ACTION_HEADTAIL_REST, "headTailRest", CHOREOGRAPHY_ACTION_HEAD_OUT, LEAD_TIME_HEADTAIL_REST_MILLIS },
+  { CHOREOGRAPHY_ACTION_MOUTH_OPEN, "mouthOpen", CHOREOGRAPHY_ACTION_MOUTH_CLOSE, LEAD_TIME_MOUTH_OPEN_MILLIS },
+  { CHOREOGRAPHY_ACTION_MOUTH_CLOSE, "mouthClose", CHOREOGRAPHY_ACTION_MOUTH_OPEN, LEAD_TIME_MOUTH_CLOSE_MILLIS },
+  { CHOREOGRAPHY_ACTION_MOUTH_REST, "mouthRest", CHOREOGRAPHY_ACTION_MOUTH_OPEN, LEAD_TIME_MOUTH_REST_MILLIS },
+};
+#define LEAD_TIME_SETTINGS (sizeof(leadTimeSettings) / sizeof(leadTimeSettings[0]))
+
+int findLeadTimeSetting(uint8_t action);
+void saveLeadTime(int setting);
+
+uint32_t leadTimesUs[LEAD_TIME_SETTINGS];
+uint32_t maxLeadTimeUs = 0;
+
+// Calibration taps, recorded by the input task while the motion task runs the calibration
+volatile bool calibrating = false;
+int64_t calibrationTapsUs[LEAD_CALIBRATION_CYCLES * 2]; // Room for some stray taps
+volatile int calibrationTapCount = 0;
+portMUX_TYPE calibrationMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Load the lead times for this fish from NVS, falling back to the defaults in config.h
+void setupLeadTimes() {
+  Preferences preferences;
+  bool opened = preferences.begin(LEAD_TIME_NVS_NAMESPACE, true);
+  maxLeadTimeUs = 0;
+  for (int i = 0; i < (int) LEAD_TIME_SETTINGS; i++) {
+    uint16_t leadMs = leadTimeSettings[i].defaultMs;
+    if (opened) {
+      leadMs = preferences.getUShort(leadTimeSettings[i].name, leadMs);
+    }
+    leadTimesUs[i] = min(leadMs, (uint16_t) LEAD_TIME_MAX_MILLIS) * 1000;
+    maxLeadTimeUs = max(maxLeadTimeUs, leadTimesUs[i]);
+  }
+  if (opened) {
+    preferences.end();
+  }
+}
+
+// How early to switch a motor on for an action to land on time. Partial mouth openings use mouthOpen's.
+uint32_t getLeadTimeUs(uint8_t action) {
+  if ((action & 0xF0) == CHOREOGRAPHY_ACTION_MOUTH_OPEN_PARTLY) {
+    action = CHOREOGRAPHY_ACTION_MOUTH_OPEN;
+  }
+  int setting = findLeadTimeSetting(action);
+  return setting >= 0 ? leadTimesUs[setting] : 0;
+}
+
+// The longest lead time of any action, which is how far ahead the choreography has to look
+uint32_t getMaxLeadTimeUs() {
+  return maxLeadTimeUs;
+}
+
+// Set an action's lead time by name, e.g. "mouthOpen", and save it to NVS. Returns false if there
+// is no such action or the lead time is more than LEAD_TIME_MAX_MILLIS.
+bool setLeadTimeMs(const char *actionName, uint16_t leadMs) {
+  int action = leadTimeAction(actionName);
+  if (action < 0 || leadMs > LEAD_TIME_MAX_MILLIS) {
+    return false;
+  }
+  int setting = findLeadTimeSetting(action);
+  leadTimesUs[setting] = leadMs * 1000;
+  saveLeadTime(setting);
+  return true;
+}
+
+// The action with a given name, as used in choreography scripts, or -1 if there isn't one
+int leadTimeAction(const char *actionName) {
+  for (int i = 0; i < (int) LEAD_TIME_SETTINGS; i++) {
+    if (strcmp(leadTimeSettings[i].name, actionName) == 0) {
+      return leadTimeSettings[i].action;
+    }
+  }
+  return -1;
+}
+
+// Report the lead time of each action over serial
+void reportLeadTimes() {
+  for (int i = 0; i < (int) LEAD_TIME_SETTINGS; i++) {
+    Serial.printf("Lead time %s: %u ms\n", leadTimeSettings[i].name, (unsigned) (leadTimesUs[i] / 1000));
+  }
+}
+
+// Work out an action's lead time by getting the user to tap the button in time with the movement,
+// then save it. Runs in the motion task, see requestCalibration().
+void calibrateLeadTime(uint8_t action) {
+  int setting = findLeadTimeSetting(action);
+  if (setting < 0) {
+    return;
+  }
+  const LeadTimeSetting &calibrated = leadTimeSettings[setting];
+  Serial.printf("Calibrating %s: tap the button each time the movement finishes, %d times\n", calibrated.name,
+      LEAD_CALIBRATION_CYCLES);
+
+  portENTER_CRITICAL(&calibrationMux);
+  calibrationTapCount = 0;
+  calibrating = true;
+  portEXIT_CRITICAL(&calibrationMux);
+
+  // Movements are scheduled against a fixed epoch, as in a performance, so they keep a steady beat
+  int64_t commandsUs[LEAD_CALIBRATION_CYCLES];
+  int64_t epochUs = timeNowUs() + LEAD_CALIBRATION_PERIOD_MILLIS * 1000LL;
+  for (int i = 0; i < LEAD_CALIBRATION_CYCLES; i++) {
+    commandsUs[i] = epochUs + i * LEAD_CALIBRATION_PERIOD_MILLIS * 1000LL;
+    sleepUntil(commandsUs[i]);
+    performChoreographyAction(calibrated.action);
+    sleepUntil(commandsUs[i] + LEAD_CALIBRATION_PERIOD_MILLIS * 500LL);
+    performChoreographyAction(calibrated.undo);
+  }
+  lightSleep(LEAD_CALIBRATION_PERIOD_MILLIS / 2); // For any late taps
+  headTailRest();
+  mouthRest();
+
+  portENTER_CRITICAL(&calibrationMux);
+  calibrating = false;
+  int taps = calibrationTapCount;
+  portEXIT_CRITICAL(&calibrationMux);
+
+  // Match each tap to the movement it was nearest, skipping the first few while the user finds
+  // the beat. Taps can be a little early, as people anticipate a steady beat.
+  int32_t delaysUs[sizeof(calibrationTapsUs) / sizeof(calibrationTapsUs[0])];
+  int count = 0;
+  for (int i = 0; i < taps; i++) {
+    int64_t sinceEpochUs = calibrationTapsUs[i] - epochUs + LEAD_CALIBRATION_PERIOD_MILLIS * 500LL;
+    int cycle = sinceEpochUs / (LEAD_CALIBRATION_PERIOD_MILLIS * 1000LL);
+    if (sinceEpochUs < 0 || cycle < LEAD_CALIBRATION_SKIP_CYCLES || cycle >= LEAD_CALIBRATION_CYCLES) {
+      continue;
+    }
+    delaysUs[count++] = calibrationTapsUs[i] - commandsUs[cycle];
+  }
+  if (count < (LEAD_CALIBRATION_CYCLES - LEAD_CALIBRATION_SKIP_CYCLES) / 2) {
+    Serial.printf("Calibrating %s: only %d taps in time, lead time not changed\n", calibrated.name, count);
+    return;
+  }
+  std::sort(delaysUs, delaysUs + count);
+  uint32_t leadMs = constrain(delaysUs[count / 2] / 1000, 0, LEAD_TIME_MAX_MILLIS);
+  leadTimesUs[setting] = leadMs * 1000;
+  saveLeadTime(setting);
+  Serial.printf("Calibrating %s: lead time %u ms from %d taps (spread %d-%d ms)\n", calibrated.name,
+      (unsigned) leadMs, count, (int) (delaysUs[0] / 1000), (int) (delaysUs[count - 1] / 1000));
+}
+
+// True while a calibration is collecting taps, so button presses should go to it
+bool isCalibrating() {
+  return calibrating;
+}
+
+// A button press during calibration, with the time it went down
+void recordCalibrationTap(int64_t pressedUs) {
+  portENTER_CRITICAL(&calibrationMux);
+  if (calibrating && calibrationTapCount < (int) (sizeof(calibrationTapsUs) / sizeof(calibrationTapsUs[0]))) {
+    calibrationTapsUs[calibrationTapCount++] = pressedUs;
+  }
+  portEXIT_CRITICAL(&calibrationMux);
+}
+
+// Index of an action's lead time setting, or -1 if it doesn't have one
+int findLeadTimeSetting(uint8_t action) {
+  for (int i = 0; i < (int) LEAD_TIME_SETTINGS; i++) {
+    if (leadTimeSettings[i].action == action) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Save a lead time to NVS and update the longest one
+void saveLeadTime(int setting) {
+  Preferences preferences;
+  if (preferences.begin(LEAD_TIME_NVS_NAMESPACE, false)) {
+    preferences.putUShort(leadTimeSettings[setting].name, leadTimesUs[setting] / 1000);
+    preferences.end();
+  }
+  maxLeadTimeUs = 0;
+  for (int i = 0; i < (int) LEAD_TIME_SETTINGS; i++) {
+    maxLeadTimeUs = max(maxLeadTimeUs, leadTimesUs[i]);
+  }
+}
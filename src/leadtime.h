@@ -0,0 +1,26 @@
+// Big Mouth Phatt Bass motor lead times
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// The motors take tens of millis to physically move after they are switched on, so a mouth told
+// to open exactly on a word visibly opens after it. Each movement (a choreography action, see
+// choreography.h) has a lead time, and playChoreography() switches the motor on that much early so
+// the movement lands on time. Defaults come from config.h; calibrated values for a particular fish
+// are kept in NVS, so they survive reflashing.
+//
+// Calibration runs in the motion task: the fish repeats one movement once a second, and you tap
+// the button in time with it finishing. The median delay from switching the motor on to the taps
+// is the lead time.
+
+#pragma once
+
+#include <Arduino.h>
+
+void setupLeadTimes();
+uint32_t getLeadTimeUs(uint8_t action);
+uint32_t getMaxLeadTimeUs();
+bool setLeadTimeMs(const char *actionName, uint16_t leadMs);
+int leadTimeAction(const char *actionName);
+void reportLeadTimes();
+void calibrateLeadTime(uint8_t action);
+bool isCalibrating();
+void recordCalibrationTap(int64_t pressedUs);
@@ -0,0 +1,133 @@
+// Big Mouth Phatt Bass live lipsync
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include "config.h"
+#include "adcsampler.h"
+#include "lipsync.h"
+#include "motors.h"
+#include "mp3player.h"
+#include "timing.h"
+
+uint32_t integerSqrt(uint32_t value);
+
+// The envelope has extra fraction bits so the slow release doesn't stall on small differences
+#define AUDIO_ENVELOPE_FRACTION_BITS 8
+#define AUDIO_BLOCK_MICROS (AUDIO_BLOCK_SAMPLES * 1000000LL / AUDIO_SAMPLE_RATE)
+
+static_assert(AUDIO_BLOCK_SAMPLES <= 256, "Sum of squares of a block must fit in 32 bits");
+
+LipsyncStats lipsyncStats;
+
+// Drive the mouth live from the music, which started playing at epochUs, until the MP3 player
+// reports the track has finished or the performance is cancelled. If the player doesn't give
+// feedback, we stop after AUDIO_SILENCE_END_MILLIS of silence instead. Returns false if the audio
+// couldn't be sampled, or the sampler stopped delivering for MP3_TRACK_END_TIMEOUT_MILLIS.
+bool playLiveLipsync(int64_t epochUs) {
+  lipsyncStats = LipsyncStats();
+  // The light sensor may be part way through a reading, so give it time to finish
+  if (!startAdcSampling(AUDIO_ADC_CHANNEL, AUDIO_SAMPLE_RATE, SENSOR_WINDOW_MILLIS * 3)) {
+    return false;
+  }
+  bool trackEndReported = getMP3PlayerStatus().acks > 0;
+
+  int32_t dcQ8 = 2048 << 8; // DAC output is biased to mid-rail, so start the DC estimate there
+  int32_t envelope = 0;     // Envelope and peak of the block RMS, with AUDIO_ENVELOPE_FRACTION_BITS extra bits
+  int32_t peak = 0;
+  bool mouthIsOpen = false;
+  int64_t lastMouthMoveUs = 0;
+  int64_t lastSoundUs = timeNowUs();
+  int64_t lastBlockUs = lastSoundUs;
+  uint16_t block[AUDIO_BLOCK_SAMPLES];
+  bool sampled = true;
+
+  while (!isCancelRequested() && !hasMP3TrackFinishedSince(epochUs)) {
+    int64_t requestedUs = timeNowUs();
+    size_t count = readAdcSamples(block, AUDIO_BLOCK_SAMPLES, AUDIO_BLOCK_MICROS / 1000 * 4);
+    int64_t receivedUs = timeNowUs();
+    if (count == 0) {
+      if (receivedUs - lastBlockUs > MP3_TRACK_END_TIMEOUT_MILLIS * 1000LL) {
+        sampled = false;
+        break;
+      }
+      continue;
+    }
+    lastBlockUs = receivedUs;
+    if (receivedUs - requestedUs < AUDIO_BLOCK_MICROS / 4) {
+      lipsyncStats.lateBlocks++;
+    }
+
+    // RMS of the block, after removing the DC bias with a slow high pass filter
+    uint32_t sumOfSquares = 0;
+    for (size_t i = 0; i < count; i++) {
+      dcQ8 += ((block[i] << 8) - dcQ8) >> AUDIO_DC_SHIFT;
+      int32_t ac = block[i] - (dcQ8 >> 8);
+      sumOfSquares += ac * ac;
+    }
+    int32_t rms = integerSqrt(sumOfSquares / count) << AUDIO_ENVELOPE_FRACTION_BITS;
+
+    // Envelope follower with a fast attack and slow release, and a slowly decaying peak to set the
+    // mouth thresholds against, so it works for quiet and loud tracks alike
+    if (rms > envelope) {
+      envelope += (rms - envelope) >> AUDIO_ATTACK_SHIFT;
+    } else {
+      envelope -= (envelope - rms) >> AUDIO_RELEASE_SHIFT;
+    }
+    peak = max(envelope, peak - (peak >> AUDIO_PEAK_DECAY_SHIFT));
+    int32_t openLevel = max(peak / 100 * AUDIO_OPEN_PERCENT, (int32_t) AUDIO_NOISE_FLOOR << AUDIO_ENVELOPE_FRACTION_BITS);
+    int32_t closeLevel = peak / 100 * AUDIO_CLOSE_PERCENT;
+    if (envelope >= openLevel) {
+      lastSoundUs = receivedUs;
+    }
+
+    // Move the mouth, but no faster than the motor can follow
+    if (receivedUs - lastMouthMoveUs >= AUDIO_MIN_MOUTH_MILLIS * 1000LL) {
+      if (!mouthIsOpen && envelope >= openLevel) {
+        mouthOpen();
+        mouthIsOpen = true;
+        lastMouthMoveUs = receivedUs;
+        lipsyncStats.mouthMoves++;
+      } else if (mouthIsOpen && envelope < closeLevel) {
+        mouthClose();
+        mouthIsOpen = false;
+        lastMouthMoveUs = receivedUs;
+        lipsyncStats.mouthMoves++;
+      }
+    }
+
+    int32_t processUs = timeNowUs() - receivedUs;
+    lipsyncStats.blocks++;
+    lipsyncStats.totalProcessUs += processUs;
+    lipsyncStats.maxProcessUs = max(lipsyncStats.maxProcessUs, processUs);
+
+    if (!trackEndReported && receivedUs - lastSoundUs > AUDIO_SILENCE_END_MILLIS * 1000LL) {
+      break;
+    }
+  }
+  stopAdcSampling();
+  return sampled;
+}
+
+// Get the live lipsync stats for the last performance
+LipsyncStats getLipsyncStats() {
+  return lipsyncStats;
+}
+
+// Integer square root, by the bit-by-bit method, so we don't need floating point for the RMS
+uint32_t integerSqrt(uint32_t value) {
+  uint32_t result = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result;
+}
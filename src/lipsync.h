@@ -0,0 +1,23 @@
+// Big Mouth Phatt Bass live lipsync
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// For tracks without a choreography file, the mouth is driven live from the music. The MP3
+// player's DAC output is sampled in blocks, and the RMS of each block feeds an envelope follower.
+// The mouth opens when the envelope rises above a fraction of the recent peak, and closes when it
+// falls below a lower fraction, so it doesn't chatter around a single threshold.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Statistics on the live lipsync during a performance
+struct LipsyncStats {
+  uint32_t blocks;        // Blocks of audio processed
+  uint32_t lateBlocks;    // Blocks that were already waiting when we asked, i.e. we were falling behind
+  uint32_t mouthMoves;    // Times the mouth opened or closed
+  int64_t totalProcessUs; // Time spent processing blocks, for the CPU load
+  int32_t maxProcessUs;   // Longest time spent processing a block
+};
+
+bool playLiveLipsync(int64_t epochUs);
+LipsyncStats getLipsyncStats();
@@ -1,197 +1,252 @@
 // Big Mouth Phatt Bass control code
 // by Ian Renton, 2024. CC Zero / Public Domain
 
-// Debug mode - for lip sync testing - reduces volume to avoid annoying the family and autoplays chosen track
-#define DEBUG false
-#define DEBUG_VOLUME 10
-#define DEBUG_AUTOPLAY_TRACK 1
-
-// Button and sensor pins
-#define BUTTON_PIN 4
-#define LDR_PIN 33
-#define LONG_PRESS_DURATION_MILLIS 500 // How long do you hold the button down to count as a long press?
-
-// Motor control pins
-#define HEADTAIL_MOTOR_PIN_1 12
-#define HEADTAIL_MOTOR_PIN_2 14
-#define HEADTAIL_MOTOR_PWM_PIN 13
-#define MOUTH_MOTOR_PIN_1 27
-#define MOUTH_MOTOR_PIN_2 26
-#define MOUTH_MOTOR_PWM_PIN 25
-
-// Motor PWM settings
-#define PWM_FREQUENCY 1000
-#define PWM_RESOLUTION 8
-#define HEADTAIL_MOTOR_PWM_CHANNEL 0
-#define MOUTH_MOTOR_PWM_CHANNEL 1
-#define HEADTAIL_MOTOR_PWM_DUTY_CYCLE 255 // Proxy for motor speed, up to 2^resolution
-#define MOUTH_MOTOR_PWM_DUTY_CYCLE 255    // Proxy for motor speed, up to 2^resolution
-
-// Music player settings
-#define TRACK_NUMBER_FOR_SENSOR_MODE 1 // In sensor mode you don't get to select track, use this one
-#define MAX_TRACK_NUMBER 10
-#define MUSIC_VOLUME 20 // Up to 30
-#define ANNOUNCER_VOLUME 10 // Up to 30
-#define MUSIC_FOLDER 1 // Corresponds to folder "01" on SD card
-#define ANNOUNCER_FOLDER 2 // Corresponds to folder "02" on SD card
-#define SENSOR_MODE_ANNOUNCER_TRACK_NUMBER 99 // Corresponds to file "02/099.mp3" on SD card
-#define MP3_PLAYER_BAUD_RATE 9600
-
-
 // Includes
 #include <Arduino.h>
+#include <esp_system.h>
+#include "config.h"
+#include "adcsampler.h"
+#include "button.h"
+#include "choreography.h"
+#include "energy.h"
+#include "leadtime.h"
+#include "lipsync.h"
+#include "motors.h"
+#include "mp3player.h"
+#include "sensor.h"
+#include "state.h"
+#include "tasks.h"
+#include "timing.h"
+#include "trace.h"
+#include "tracks.h"
 
 // Function defs
+void markBoot(const char *stage);
+void reportBootTimeline();
 void indicateReady();
-boolean isButtonPushed();
-double getLightLevel();
 void announceTrackName(int trackNumber);
 void announceSensorMode();
+void reportLightChangeWake();
+void reportButtonWake();
+void reportLightSensorStats();
+void checkInputs();
+void handleButtonEvent(const ButtonEvent &event);
+int nextTrackNumber(int tracknum);
 void trigger(int trackNumber);
-void lipsyncPhattBass();
-void lipsyncAllAboutThatBass();
-void lipsyncMrScruffFish();
-void lipsyncChopSuey();
-void lipsyncSmellsLikeTeenSpirit();
-void lipsyncKillingInTheName();
-void lipsyncEnterSandman();
-void lipsyncCloser();
-void lipsyncIAmJustAFish();
-void lipsyncBasketCase();
-void playTrack(int foldernum, int tracknum);
-void flapHeadFor(int runtime, int interval);
-void flapTailFor(int runtime, int interval);
-void flapHead(int interval);
-void flapTail(int interval);
-void headOut();
-void tailOut();
-void headTailRest();
-void flapMouthFor(int runtime, int interval);
-void flapMouthAndTailTogetherFor(int runtime, int interval);
-void mouthOpenFor(int runtime);
-void mouthOpen();
-void mouthClose();
-void mouthRest();
 void stop();
-void changeVolume(int thevolume);
-void sendCommandToMP3Player(byte command, int dataBytes);
-void lightSleep(int timeMs);
+void reportWakeStats(int tracknum);
+void reportCancelResponse(int tracknum);
+void reportLipsyncStats(int tracknum);
 
 
 // Variable defs
 int trackNumber = 1;
 bool sensorMode = false;
-double lastSensorLightLevel = 0;
+int64_t lastActivityUs = 0; // Last button press or performance, for deep sleeping when idle in normal mode
+
+// Boot timeline, see markBoot()
+struct BootStage {
+  const char *name;
+  int64_t atUs;
+};
+BootStage bootStages[BOOT_TIMELINE_STAGES];
+int bootStageCount = 0;
 
 
 // Setup and run the program
 void setup() {
-  // Set up button and LDR pins
+  // Set up USB serial for reporting
+  Serial.begin(SERIAL_BAUD_RATE);
+  setupTiming();
+  setupEnergy();
+  markBoot("serial");
+  if (esp_reset_reason() == ESP_RST_BROWNOUT) {
+    Serial.println("Reset by brownout, the supply dipped. Check the motor drive profiles with the motortest command.");
+  }
+
+  // Set up button and LDR pins, and the ADC sampling for the LDR and live lipsync
   pinMode(BUTTON_PIN, INPUT_PULLUP);
   pinMode(LDR_PIN, INPUT_PULLUP);
+  setupAdcSampler();
+  markBoot("inputs");
+
+  // Set up motor control pins and PWM, and load this fish's motor lead times
+  setupMotors();
+  setupLeadTimes();
+  markBoot("motors");
+
+  // Mount the flash partition containing the choreography files, and load the track list from it
+  setupChoreography();
+  setupTracks();
+  markBoot("filesystem");
+
+  // Carry on with the track and mode we had before
+  FishState state = loadFishState();
+  sensorMode = state.sensorMode;
+  trackNumber = getTrack(state.trackNumber) != nullptr ? state.trackNumber : 1;
+  markBoot("state");
+
+  // Start the comms task, which sets up serial comms to the MP3 player
+  startCommsTask();
+  markBoot("mp3");
+
+  // If the ULP woke us from deep sleep, we were already in sensor mode and the light level has
+  // changed, so get straight on with the performance
+  if (wasWokenByLightChange()) {
+    sensorMode = true;
+    trackNumber = TRACK_NUMBER_FOR_SENSOR_MODE;
+    reportLightChangeWake();
+    startMotionAndInputTasks(trackNumber);
+    markBoot("armed");
+    reportBootTimeline();
+    return;
+  }
 
-  // Set up motor control pins
-  pinMode(HEADTAIL_MOTOR_PIN_1, OUTPUT);
-  pinMode(HEADTAIL_MOTOR_PIN_2, OUTPUT);
-  pinMode(HEADTAIL_MOTOR_PWM_PIN, OUTPUT);
-  pinMode(MOUTH_MOTOR_PIN_1, OUTPUT);
-  pinMode(MOUTH_MOTOR_PIN_2, OUTPUT);
-  pinMode(MOUTH_MOTOR_PWM_PIN, OUTPUT);
-
-  // Set up PWM
-  ledcSetup(HEADTAIL_MOTOR_PWM_CHANNEL, PWM_FREQUENCY, PWM_RESOLUTION);
-  ledcSetup(MOUTH_MOTOR_PWM_CHANNEL, PWM_FREQUENCY, PWM_RESOLUTION);
-  ledcAttachPin(HEADTAIL_MOTOR_PWM_PIN, HEADTAIL_MOTOR_PWM_CHANNEL);
-  ledcAttachPin(MOUTH_MOTOR_PWM_PIN, MOUTH_MOTOR_PWM_CHANNEL);
-  ledcWrite(HEADTAIL_MOTOR_PWM_CHANNEL, HEADTAIL_MOTOR_PWM_DUTY_CYCLE);
-  ledcWrite(MOUTH_MOTOR_PWM_CHANNEL, MOUTH_MOTOR_PWM_DUTY_CYCLE);
-
-  // Set up serial comms to MP3 player
-  Serial2.begin(MP3_PLAYER_BAUD_RATE);
-  while (!Serial2);
-
-  // Reset anything going on on the motor & MP3 boards
+  // If the button woke us from deep sleep in normal mode, the press is already under way and the
+  // button handling carries on with it, so get straight to being ready for it
+  if (wasWokenByButton()) {
+    reportButtonWake();
+    startMotionAndInputTasks();
+    markBoot("armed");
+    reportBootTimeline();
+    return;
+  }
+
+  // Reset anything going on on the motor & MP3 boards. The MP3 commands are sent in the
+  // background, like the announcements below, so none of this holds up being ready.
   stop();
 
   // If we are in debug mode to speed up lip-sync testing, autoplay the chosen track.
   if (DEBUG) {
-    trigger(DEBUG_AUTOPLAY_TRACK);
+    startMotionAndInputTasks(DEBUG_AUTOPLAY_TRACK);
     return;
   }
 
-  // Check startup mode. If the button is held down at startup time, we go into
-  // "sensor mode" to use the LDR to trigger the fish, otherwise we go into
-  // normal mode where a button press triggers it.
+  // Check startup mode. Holding the button down at startup switches between "sensor mode", where
+  // the LDR triggers the fish, and normal mode, where a button press triggers it. Otherwise we
+  // stay in the mode we were in.
   if (isButtonPushed()) {
-    // Button held in on startup, so going into sensor mode.
-    // Wait for button to be unpushed, then the mode/track announce sequence will give time for the user to move away
-    sensorMode = true;
-    trackNumber = TRACK_NUMBER_FOR_SENSOR_MODE;
+    sensorMode = !sensorMode;
+    saveFishState({ trackNumber, sensorMode });
+    if (sensorMode) {
+      announceSensorMode();
+    }
 
-    announceSensorMode();
+    // Wait for button to be unpushed, then in sensor mode give the user time to move away
     while (isButtonPushed()) {
       lightSleep(10);
     }
-    lightSleep(2000);
-
+    if (sensorMode) {
+      lightSleep(2000);
+    }
+  }
+  if (sensorMode) {
     // Record the current light level, so we don't trigger immediately
-    lastSensorLightLevel = getLightLevel();
-
-  } else {
-    // Normal mode, nothing else to do here
+    trackNumber = TRACK_NUMBER_FOR_SENSOR_MODE;
+    resetLightSensorBaseline();
   }
 
+  // Ready to go. From here on the motion and input tasks run the fish, while the announcement plays.
   announceTrackName(trackNumber);
-  lightSleep(1000);
+  startMotionAndInputTasks();
+  markBoot("armed");
+  reportBootTimeline();
 }
 
-// Main program loop
+// Arduino's loop task isn't needed, everything happens in our own tasks
 void loop() {
-  // Wait for a trigger condition, either a change in light level or
-  // a button push depending on our mode.
+  vTaskDelete(NULL);
+}
+
+// Input handling, called repeatedly by the input task. Wait for a trigger condition, either a
+// change in light level or a button push depending on our mode. Triggers are ignored while a
+// performance is already running, but the button can stop it in either mode.
+void checkInputs() {
+  ButtonEvent event;
   if (sensorMode) {
-    double lightLevel = getLightLevel();
-    if (lightLevel < lastSensorLightLevel - 0.04 || lightLevel > lastSensorLightLevel + 0.04) {
-      trigger(trackNumber);
+    // Once there's nothing going on, hand over to the ULP to watch the light level, and deep sleep
+    if (SENSOR_MODE_DEEP_SLEEP && !isPerforming() && !isButtonBusy() && !isLightSleepInhibited()) {
+      deepSleepUntilLightChanges();
     }
-    lastSensorLightLevel = lightLevel;
-    lightSleep(200);
-
-  } else if (isButtonPushed()) {
-    // Not in sensor mode, and the button was pushed. If it was pushed for less than half a second,
-    // this is the sign to trigger and play the music. If it was pushed for more than half a second,
-    // this is the sign to switch tracks.
-    lightSleep(LONG_PRESS_DURATION_MILLIS);
-    if (!isButtonPushed()) {
-      trigger(trackNumber);
-    } else {
-      while (isButtonPushed());
-      trackNumber++;
-      if (trackNumber > MAX_TRACK_NUMBER) {
-        trackNumber = 1;
-      }
-      // Announce the name of the new track that will play
-      announceTrackName(trackNumber);
+    // Polling the LDR, either while performing, or instead of deep sleeping
+    if (updateLightSensor()) {
+      reportLightSensorStats();
+      requestPerformance(trackNumber);
+    }
+    if (waitForButtonEvent(event, isPerforming() ? SENSOR_POLL_MILLIS : 0)) {
+      handleButtonEvent(event);
+    } else if (!isPerforming()) {
+      lightSleep(SENSOR_POLL_MILLIS);
+    }
+
+  } else {
+    // Not in sensor mode, so wait for a button press. When there's nothing going on, light sleep
+    // until the button is pushed, or deep sleep once nothing has happened for a while.
+    if (isPerforming() || isButtonBusy()) {
+      lastActivityUs = timeNowUs();
+    }
+    int64_t deepSleepAtUs = lastActivityUs + NORMAL_MODE_DEEP_SLEEP_AFTER_MILLIS * 1000LL;
+    if (NORMAL_MODE_DEEP_SLEEP && timeNowUs() >= deepSleepAtUs && !isLightSleepInhibited()) {
+      deepSleepUntilButtonPushed();
+    }
+    lightSleepUntilButtonPushed(NORMAL_MODE_DEEP_SLEEP ? deepSleepAtUs : -1);
+    if (waitForButtonEvent(event, BUTTON_EVENT_WAIT_MILLIS)) {
+      lastActivityUs = timeNowUs();
+      handleButtonEvent(event);
     }
   }
-  lightSleep(50);
 }
 
-// Return true if button is pushed
-boolean isButtonPushed() {
-  return digitalRead(BUTTON_PIN) == 0;
+// Act on a button press. A short press is the sign to trigger and play the music, or to stop it if
+// it is already playing. A long press is the sign to switch tracks, skipping straight to the next
+// one if music is already playing. Sensor mode only uses the button to stop the music.
+void handleButtonEvent(const ButtonEvent &event) {
+  Serial.printf("Button %s, %lld us after classification\n", buttonEventName(event.type),
+      (long long) (timeNowUs() - event.atUs));
+  // While calibrating lead times, presses are taps in time with the motor instead
+  if (isCalibrating()) {
+    if (event.type != BUTTON_HELD) {
+      recordCalibrationTap(event.pressedUs);
+    }
+    return;
+  }
+  if (isPerforming()) {
+    if (event.type == BUTTON_SHORT_PRESS || (sensorMode && event.type == BUTTON_LONG_PRESS)) {
+      cancelPerformance(event.atUs);
+    } else if (event.type == BUTTON_LONG_PRESS) {
+      trackNumber = nextTrackNumber(trackNumber);
+      saveFishState({ trackNumber, sensorMode });
+      skipToPerformance(trackNumber, event.atUs);
+    }
+  } else if (!sensorMode) {
+    if (event.type == BUTTON_SHORT_PRESS) {
+      requestPerformance(trackNumber);
+    } else if (event.type == BUTTON_LONG_PRESS) {
+      trackNumber = nextTrackNumber(trackNumber);
+      saveFishState({ trackNumber, sensorMode });
+      // Announce the name of the new track that will play
+      announceTrackName(trackNumber);
+    }
+  }
 }
 
-// Return a normalised light level 0-1
-double getLightLevel() {
-  int measuredLevel = analogRead(LDR_PIN);
-  return constrain(1 - measuredLevel / 2500.0, 0.0, 1.0);
+// The track after the given one, wrapping round at the end
+int nextTrackNumber(int tracknum) {
+  tracknum++;
+  if (tracknum > getTrackCount()) {
+    tracknum = 1;
+  }
+  return tracknum;
 }
 
-// Play an "announcer" MP3 to say which song is playing
+// Play an "announcer" MP3 to say which song is playing, if it has one
 void announceTrackName(int tracknum) {
+  const Track *track = getTrack(tracknum);
+  if (track == nullptr || track->announcerFile == 0) {
+    return;
+  }
   changeVolume(DEBUG ? DEBUG_VOLUME : ANNOUNCER_VOLUME);
-  playTrack(ANNOUNCER_FOLDER, tracknum);
+  playTrack(track->announcerFolder, track->announcerFile);
 }
 
 // Play an "announcer" MP3 to say we are in sensor mode
@@ -200,738 +255,142 @@ void announceSensorMode() {
   playTrack(ANNOUNCER_FOLDER, SENSOR_MODE_ANNOUNCER_TRACK_NUMBER);
 }
 
-// Trigger a music playing & lip syncing action
+// Trigger a music playing & lip syncing action. Runs in the motion task, see requestPerformance().
 void trigger(int trackNumber) {
-  // Set volume. A lower volume is set in debug mode.
-  changeVolume(DEBUG ? DEBUG_VOLUME : MUSIC_VOLUME);
-
-  // Start playing MP3
-  playTrack(MUSIC_FOLDER, trackNumber);
-
-  // Lip-sync!
-  switch(trackNumber) {
-    case 1:
-      lipsyncPhattBass();
-      break;
-    case 2:
-      lipsyncAllAboutThatBass();
-      break;
-    case 3:
-      lipsyncMrScruffFish();
-      break;
-    case 4:
-      lipsyncChopSuey();
-      break;
-    case 5:
-      lipsyncSmellsLikeTeenSpirit();
-      break;
-    case 6:
-      lipsyncKillingInTheName();
-      break;
-    case 7:
-      lipsyncEnterSandman();
-      break;
-    case 8:
-      lipsyncCloser();
-      break;
-    case 9:
-      lipsyncIAmJustAFish();
-      break;
-    case 10:
-      lipsyncBasketCase();
-      break;
-  }
-
-  // Stop once complete
-  stop();
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Warp Brothers - Phatt Bass (track number 1)
-void lipsyncPhattBass() {
-  lightSleep(3000); // *sirens*
-  headOut();
-  lightSleep(1000);
-  mouthOpenFor(1000); // Listen
-  lightSleep(1000);
-  mouthOpenFor(500); // to the
-  lightSleep(300);
-  mouthOpenFor(300); // phatt
-  lightSleep(200);
-  flapMouthFor(3500, 250); // bass... bass... bass... bass...
-  tailOut();
-  mouthOpenFor(300); // bass...
-  headTailRest();
-  mouthOpenFor(300); // bass...
-  tailOut();
-  mouthOpenFor(300); // bass...
-  headTailRest();
-  lightSleep(300);
-  flapTailFor(10800, 200); // *early 2000s techno noises*
-  headOut();
-  lightSleep(200);
-  mouthOpenFor(600); // phatt
-  lightSleep(600);
-  mouthOpenFor(600); // bass
-  for (int i = 0; i < 10; i++) { // rest of music
-    flapTailFor(800, 200);
-    flapHeadFor(800, 200);
-  }
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Meghan Trainor - All About that Bass (track number 2)
-void lipsyncAllAboutThatBass() {
-  lightSleep(300);
-  headOut();
-  lightSleep(1000);
-  flapMouthFor(4500, 250); // Because you know I'm all about that bass, 'bout that bass, no treble
-  headTailRest();
-  flapMouthFor(3500, 250); // I'm all about that bass, 'bout that bass, no treble
-  headOut();
-  flapMouthFor(3500, 250); // I'm all about that bass, 'bout that bass, no treble
-  headTailRest();
-  flapMouthFor(2500, 250); // I'm all about that bass, 'bout that
-  flapMouthFor(1000, 125); // bass bass bass bass
-  lightSleep(500);
-  for (int i = 0; i < 12; i++) { // Yeah, it's pretty clear, I ain't no size two, but I can shake it, shake it, like I'm supposed to do
-    tailOut();
-    mouthOpen();
-    lightSleep(150);
-    mouthClose();
-    lightSleep(150);
-    headTailRest();
-    mouthOpen();
-    lightSleep(150);
-    mouthClose();
-    lightSleep(150);
-  }
-  for (int i = 0; i < 10; i++) { // 'Cause I got that boom boom that all the boys chase, and all the right junk in all the right
-    headOut();
-    mouthOpen();
-    lightSleep(150);
-    mouthClose();
-    lightSleep(150);
-    headTailRest();
-    mouthOpen();
-    lightSleep(150);
-    mouthClose();
-    lightSleep(150);
-  }
-  for (int i = 0; i < 2; i++) { // basses
-    tailOut();
-    mouthOpen();
-    lightSleep(150);
-    mouthClose();
-    lightSleep(150);
-    headTailRest();
-  }
-  lightSleep(500);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Mr Scruff - Fish (track number 3)
-void lipsyncMrScruffFish() {
-  lightSleep(300);
-  headOut();
-  mouthOpenFor(2400); // Now listen to me young fellow
-  lightSleep(300);
-  mouthOpenFor(2400); // What need is there for fish to sing
-  lightSleep(300);
-  mouthOpenFor(3000); // When I can roar and bellow?
-  headTailRest();
-  lightSleep(1000);
-  for (int i = 0; i < 4; i++) { // Fish x8
-    tailOut();
-    mouthOpenFor(340);
-    lightSleep(100);
-    headTailRest();
-    mouthOpenFor(340);
-    lightSleep(100);
-  }
-  mouthOpenFor(340); // Fish
-  lightSleep(100);
-  headOut();
-  lightSleep(100);
-  mouthOpenFor(1300); // Eating fish
-  headTailRest();
-  lightSleep(400);
-  for (int i = 0; i < 2; i++) { // *ununtelligible noises*
-    mouthOpenFor(700);
-    lightSleep(300);
-  }
-  lightSleep(1400);
-  for (int i = 0; i < 4; i++) { // Fish x8
-    tailOut();
-    mouthOpenFor(340);
-    lightSleep(100);
-    headTailRest();
-    mouthOpenFor(340);
-    lightSleep(100);
-  }
-  mouthOpenFor(340); // Fish
-  lightSleep(100);
-  headOut();
-  lightSleep(100);
-  mouthOpenFor(1300); // Eating fish
-  headTailRest();
-  lightSleep(3800);
-  mouthOpenFor(2600); // Fish are really (something??)
-  lightSleep(1800);
-  mouthOpenFor(2600); // Fish are really (something??)
-  lightSleep(2000);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// System of a Down - Chop Suey (track number 4)
-void lipsyncChopSuey() {
-  headOut();
-  mouthOpenFor(300); // Wake up
-  headTailRest();
-  lightSleep(100);
-  mouthOpenFor(300); // *whisper* Wake up
-  lightSleep(100);
-  headOut();
-  mouthOpenFor(1500); // Grab a brush and put a little make-up
-  headTailRest();
-  lightSleep(600);
-  headOut();
-  mouthOpenFor(1320); // Hide the scars to fade away the shake-up
-  headTailRest();
-  lightSleep(50);
-  mouthOpenFor(500); // *whisper* Hide the scars to fade away the
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(1320); // Why'd you leave the keys upon the table?
-  headTailRest();
-  lightSleep(550);
-  headOut();
-  mouthOpenFor(1320); // Here you go create another fable
-  headTailRest();
-  lightSleep(50);
-  mouthOpenFor(500); // You wanted to
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(1250); // Grab a brush and put a little make-up
-  headTailRest();
-  lightSleep(50);
-  mouthOpenFor(500); // You wanted to
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(1320); // Hide the scars to fade away the shake-up
-  headTailRest();
-  lightSleep(50);
-  mouthOpenFor(500); // You wanted to
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(1320); // Why'd you leave the keys upon the table?
-  headTailRest();
-  lightSleep(50);
-  mouthOpenFor(500); // You wanted to
-  lightSleep(50);
-  mouthOpenFor(1500); // I don't think you trust
-  lightSleep(1500);
-  mouthOpenFor(700); // in
-  lightSleep(1200);
-  mouthOpenFor(800); // my
-  lightSleep(1100);
-  mouthOpenFor(2800); // Self-righteous suicide
-  lightSleep(1000);
-  mouthOpenFor(700); // I
-  lightSleep(1200);
-  mouthOpenFor(900); // cry
-  lightSleep(850);
-  mouthOpenFor(1900); // when angels deserve to
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(3200); // DDDDIIIIIIEEEEE
-  headTailRest();
-  lightSleep(50);
-  flapTailFor(4200, 125);
-  lightSleep(50);
-  headOut();
-  mouthOpenFor(1800); // *roar*
-  headTailRest();
-  lightSleep(500);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Nirvana - Smells Like Teen Spirit (track number 5)
-void lipsyncSmellsLikeTeenSpirit() {
-  mouthOpenFor(500); // Hello
-  lightSleep(500);
-  mouthOpenFor(500); // Hello
-  headOut();
-  lightSleep(400);
-  flapMouthFor(1400, 175); // With the lights out
-  lightSleep(300);
-  flapMouthFor(1400, 175); // It's less dangerous
-  lightSleep(400);
-  headTailRest();
-  lightSleep(400);
-  flapMouthAndTailTogetherFor(1400, 175); // Here we are now
-  lightSleep(400);
-  flapMouthAndTailTogetherFor(1400, 175); // Entertain us
-  lightSleep(300);
-  headOut();
-  lightSleep(600);
-  flapMouthFor(1400, 175); // I feel stupid
-  lightSleep(600);
-  flapMouthFor(1400, 175); // and contagious
-  lightSleep(200);
-  headTailRest();
-  lightSleep(500);
-  flapMouthAndTailTogetherFor(1400, 175); // Here we are now
-  lightSleep(500);
-  flapMouthAndTailTogetherFor(1400, 175); // Entertain us
-  lightSleep(700);
-  flapMouthAndTailTogetherFor(1400, 175); // A mulatto
-  headOut();
-  lightSleep(700);
-  flapMouthFor(1400, 175); // An albino
-  headTailRest();
-  lightSleep(700);
-  flapMouthAndTailTogetherFor(1400, 175); // A mosquito
-  headOut();
-  lightSleep(700);
-  flapMouthFor(1400, 175); // My libido
-  headTailRest();
-  lightSleep(800);
-  mouthOpenFor(800); // Yeah
-  lightSleep(500);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Rage Against the Machine - Killing in the Name (track number 6)
-void lipsyncKillingInTheName() {
-  headOut();
-  lightSleep(250);
-  for (int i = 0; i < 8; i++) {
-    flapMouthFor(2250, 125); // Fuck you I won't do what you tell me
-    lightSleep(400);
+  // Any cancel request was for the previous performance
+  clearCancel();
+  TRACE(TRACE_PERFORMANCE_START, 0, trackNumber);
+  EnergyStats startEnergy = getEnergyStats();
+  const Track *track = getTrack(trackNumber);
+  if (track == nullptr) {
+    Serial.printf("Track %d: no such track, there are %d\n", trackNumber, getTrackCount());
+    TRACE(TRACE_PERFORMANCE_END, 0, trackNumber);
+    return;
   }
-  flapMouthFor(2250, 125); // Fuck you I won't do what you tell me
-  headTailRest();
-  lightSleep(2000);
-  headOut();
-  lightSleep(250);
-  mouthOpenFor(300); // Mother
-  lightSleep(200);
-  mouthOpenFor(1000); // Fuckeeerrrrr
-  headTailRest();
-  lightSleep(1200);
-  mouthOpenFor(300); // Ugh
-  flapTailFor(5500, 250);
-  flapTailFor(3000, 125);
-  flapTailFor(500, 250);
-  flapHeadFor(500, 250);
-  flapTailFor(500, 250);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// Metallica - Enter Sandman (track number 7)
-void lipsyncEnterSandman() {
-  lightSleep(400);
-  flapMouthFor(3000, 300); // Hush little baby, don't say a word
-  lightSleep(900);
-  flapMouthFor(3000, 300); // And never mind that noise you heard
-  lightSleep(1100);
-  flapMouthAndTailTogetherFor(3000, 300); // It's just the beast under your bed
-  lightSleep(900);
-  flapMouthAndTailTogetherFor(3000, 300); // In your closet, in your head
-  headOut();
-  lightSleep(1000);
-  flapMouthFor(1200, 300); // Exit
-  mouthOpenFor(1000); // light
-  lightSleep(1700);
-  flapMouthFor(1200, 300); // Enter
-  mouthOpenFor(1000); // night
-  lightSleep(1100);
-  mouthOpenFor(1000); // Grain
-  lightSleep(200);
-  mouthOpenFor(200); // of
-  lightSleep(200);
-  mouthOpenFor(2000); // sand
-  lightSleep(500);
-  flapMouthFor(1200, 300); // Exit
-  mouthOpenFor(1000); // light
-  lightSleep(1600);
-  flapMouthFor(1200, 300); // Enter
-  mouthOpenFor(1000); // night
-  lightSleep(1500);
-  mouthOpenFor(1000); // Take
-  lightSleep(200);
-  mouthOpenFor(200); // my
-  lightSleep(200);
-  mouthOpenFor(2000); // hand
-  headTailRest();
-  lightSleep(200);
-  flapMouthFor(1600, 200); // We're off to never never
-  mouthOpenFor(1500); // laaaaand
-  lightSleep(1000);
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// NIN - Closer (track number 8)
-void lipsyncCloser() {
-  headOut();
-  lightSleep(200);
-  flapMouthFor(3000, 165); // I wanna fuck you like an animal
-  headTailRest();
-  lightSleep(200);
-  flapTailFor(1600, 200); // (instrumental)
-  headOut();
-  lightSleep(200);
-  flapMouthFor(2700, 165); // I wanna feel you from the
-  mouthOpenFor(500); // in
-  lightSleep(100);
-  mouthOpenFor(800); // side
-  headTailRest();
-  lightSleep(200);
-  flapTailFor(1200, 200); // (instrumental)
-  headOut();
-  lightSleep(200);
-  flapMouthFor(3000, 165); // I wanna fuck you like an animal
-  headTailRest();
-  lightSleep(200);
-  flapTailFor(1600, 200); // (instrumental)
-  lightSleep(400);
-  headOut();
-  lightSleep(200);
-  flapMouthFor(1800, 150); // My whole existence is
-  mouthOpenFor(800); // flawed
-  headTailRest();
-  lightSleep(200);
-  flapTailFor(2000, 200); // (instrumental)
-  lightSleep(400);
-  headOut();
-  lightSleep(200);
-  flapMouthFor(1800, 150); // You get me closer to
-  mouthOpenFor(1000); // God
-  headTailRest();
-  lightSleep(200);
-  flapTailFor(6300, 350); // (instrumental)
-}
 
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// "I am Just a Fish" (track number 9)
-void lipsyncIAmJustAFish() {
-  headOut();
-  lightSleep(200);
-  mouthOpenFor(700); // Don't
-  lightSleep(500);
-  mouthOpenFor(700); // Cry
-  lightSleep(700);
-  flapMouthFor(1200, 150); // I am just a
-  mouthOpenFor(500); // Fish
-  headTailRest();
-  lightSleep(200);
-  for (int i = 0; i < 2; i++) { // (instrumental)
-    tailOut();
-    lightSleep(500);
-    headTailRest();
-    lightSleep(700);
-  }
-  tailOut();
-  lightSleep(500);
-  headTailRest();
-  lightSleep(100);
-  for (int i = 0; i < 3; i++) {
-    headOut();
-    lightSleep(400);
-    flapMouthFor(1200, 150); // I am just a
-    mouthOpenFor(500); // Fish
-    headTailRest();
-    lightSleep(200);
-    for (int i = 0; i < 2; i++) { // (instrumental)
-      tailOut();
-      lightSleep(500);
-      headTailRest();
-      lightSleep(700);
+  // Set volume. A lower volume is set in debug mode.
+  changeVolume(DEBUG ? DEBUG_VOLUME : track->volume);
+
+  // Start playing MP3. The commands are sent in the background, so wait for the MP3 player to
+  // confirm the music has started. All choreography timings are measured from this point. We stay
+  // out of light sleep until the end of the performance, so we can receive feedback from the player.
+  inhibitLightSleep();
+  int64_t playSentUs = playTrack(track->folder, track->file);
+  int64_t epochUs = waitForMP3PlaybackStart(playSentUs);
+
+  // Lip-sync! Tracks without a choreography file are lip-synced live from the music.
+  if (epochUs >= 0) {
+    resetWakeStats();
+    if (!LIVE_LIPSYNC_ALWAYS && track->choreography != 0 && playChoreography(track->choreography, epochUs)) {
+      reportWakeStats(trackNumber);
+    } else if (playLiveLipsync(epochUs)) {
+      reportLipsyncStats(trackNumber);
+    } else {
+      Serial.printf("Track %d: no choreography, and could not sample the audio\n", trackNumber);
     }
-    tailOut();
-    lightSleep(500);
-    headTailRest();
-    lightSleep(100);
-  }
-  // Outro
-  flapHeadFor(2400, 600);
-  for (int i = 0; i < 5; i++) {
-    tailOut();
-    lightSleep(500);
-    headTailRest();
-    lightSleep(700);
+  } else if (!isCancelRequested()) {
+    Serial.printf("Track %d: MP3 player error %d\n", trackNumber, getMP3PlayerStatus().lastError);
   }
-}
-
-// Lip-sync function, operating the motors in time to music. The music is already playing at
-// this point so we just have to move motors accordingly. This version of the function is for:
-// "Basket Case" (track number 10)
-void lipsyncBasketCase() {
-  headOut();
-  lightSleep(400);
-  mouthOpenFor(300); // Do
-  lightSleep(100);
-  flapMouthFor(900, 150); // you have the
-  mouthOpenFor(400); // time
-  flapTailFor(600, 100);
-  headOut();
-  lightSleep(400);
-  mouthOpenFor(300); // To
-  lightSleep(200);
-  flapMouthFor(900, 150); // listen to me
-  mouthOpenFor(400); // whine
-  flapTailFor(600, 100);
-
-  headOut();
-  lightSleep(400);
-  flapMouthFor(2560, 160); // About nothing and everything
-  mouthOpenFor(600); // all at
-  lightSleep(200);
-  mouthOpenFor(200); // once
-
-  flapTailFor(1800, 100);
-
-  headOut();
-  lightSleep(400);
-  mouthOpenFor(300); // I
-  lightSleep(100);
-  flapMouthFor(900, 150); // am one of those
-  mouthOpenFor(400); // those
-  flapTailFor(600, 100);
-  headOut();
-  lightSleep(400);
-  mouthOpenFor(300); // Me-
-  lightSleep(200);
-  flapMouthFor(900, 150); // lodromatic
-  mouthOpenFor(400); // fools
-  flapTailFor(600, 100);
-  
-  headOut();
-  lightSleep(400);
-  flapMouthFor(2560, 160); // Neurotic to the bone, no
-  mouthOpenFor(600); // doubt about
-  lightSleep(100);
-  mouthOpenFor(100); // it
-
-  flapTailFor(3000, 100);
-
-  headOut();
-  lightSleep(400);
-  flapMouthFor(1500, 120); // Sometimes I give myself
-  mouthOpenFor(600); // the
-  lightSleep(200);
-  mouthOpenFor(500); // creeps
-
-  flapTailFor(2500, 100);
-
-  headOut();
-  lightSleep(400);
-  flapMouthFor(1740, 120); // Sometimes my mind plays tricks
-  mouthOpenFor(600); // on
-  lightSleep(200);
-  mouthOpenFor(500); // me
-
-  flapTailFor(1600, 100);
-
-  headOut();
-  lightSleep(400);
-  flapMouthFor(1800, 150); // At all keeps adding up
-
-  flapTailFor(600, 100);
-
-  headOut();
-  lightSleep(300);
-  flapMouthFor(1500, 150); // I think I'm cracking
-  mouthOpenFor(800); // up
-  lightSleep(500);
-  mouthOpenFor(200); // Am
-  lightSleep(200);
-  flapMouthFor(1500, 150); // I just paranoid
-  flapMouthFor(600, 100); // Or am I just
-  mouthOpenFor(800); // stoned
-  headTailRest();
-  lightSleep(300);
+  releaseLightSleep();
 
-  for (int i = 0; i < 3; i++) {
-    tailOut();
-    lightSleep(800);
-    headTailRest();
-    lightSleep(800);
+  // How long the first performance after the button woke us from deep sleep took to get going
+  static bool firstPerformance = true;
+  if (firstPerformance && wasWokenByButton() && epochUs >= 0) {
+    Serial.printf("Track %d: music started %lld ms after the button woke us, plus the bootloader\n",
+        trackNumber, (long long) (epochUs / 1000));
   }
-}
+  firstPerformance = false;
 
-// Play a specific track number from a specific folder.
-void playTrack(int foldernum, int tracknum) {
-  // Disable repeat
-  sendCommandToMP3Player(0x11, 0);
-  // Play track
-  int foldertrack = (foldernum << 8) | tracknum;
-  sendCommandToMP3Player(0x0f, foldertrack);
-}
-
-// Flap the head in and out for a defined time (in millis), moving it at the defined interval (in millis).
-// runtime should be a multiple of interval * 2, otherwise the number of mouth movements will be rounded down.
-// Used to bop to music
-void flapHeadFor(int runtime, int interval) {
-  int runs = runtime / interval / 2.0;
-  for (int i = 0; i < runs; i++) {
-    headOut();
-    lightSleep(interval);
-    headTailRest();
-    lightSleep(interval);
+  // Stop once complete, or cancelled
+  stop();
+  TRACE(TRACE_PERFORMANCE_END, 0, trackNumber);
+  if (isCancelRequested()) {
+    reportCancelResponse(trackNumber);
   }
+  recordPerformanceEnergy(trackNumber, startEnergy);
 }
 
-// Flap the tail in and out for a defined time (in millis), moving it at the defined interval (in millis).
-// runtime should be a multiple of interval * 2, otherwise the number of mouth movements will be rounded down.
-// Used to bop to music
-void flapTailFor(int runtime, int interval) {
-  int runs = runtime / interval / 2.0;
-  for (int i = 0; i < runs; i++) {
-    tailOut();
-    lightSleep(interval);
-    headTailRest();
-    lightSleep(interval);
+// Record how long after reset we reached a stage of booting, for reportBootTimeline(). Times are
+// from when the timer started, which doesn't include the bootloader.
+void markBoot(const char *stage) {
+  if (bootStageCount < BOOT_TIMELINE_STAGES) {
+    bootStages[bootStageCount++] = { stage, timeNowUs() };
   }
 }
 
-// Flap the head out for a defined time (in millis), then back in for the same time. Used to bop to music.
-void flapHead(int interval) {
-  headOut();
-  lightSleep(interval);
-  headTailRest();
-  lightSleep(interval);
-}
-
-// Flap the tail out for a defined time (in millis), then back in for the same time. Used to bop to music.
-void flapTail(int interval) {
-  tailOut();
-  lightSleep(interval);
-  headTailRest();
-  lightSleep(interval);
+// Report the boot timeline, ending when we were ready to be triggered
+void reportBootTimeline() {
+  Serial.print("Boot:");
+  for (int i = 0; i < bootStageCount; i++) {
+    Serial.printf(" %s %lld.%01lld ms%s", bootStages[i].name, (long long) (bootStages[i].atUs / 1000),
+        (long long) (bootStages[i].atUs / 100 % 10), i < bootStageCount - 1 ? "," : "\n");
+  }
 }
 
-// Bring the fish's head out
-void headOut() {
-  digitalWrite(HEADTAIL_MOTOR_PIN_1, LOW);
-  digitalWrite(HEADTAIL_MOTOR_PIN_2, HIGH);
+// Report what woke us from deep sleep in sensor mode. The trigger latency is up to one ULP sample
+// period, plus the bootloader, plus the time since the program started (reported here), plus
+// starting the music.
+void reportLightChangeWake() {
+  LightChangeWake wake = getLightChangeWake();
+  Serial.printf("Light level changed from %u to %u after %u samples (%lu ms asleep), program started %lu ms ago\n",
+      wake.baseline, wake.sample, wake.sampleCount,
+      (unsigned long) wake.sampleCount * SENSOR_ULP_SAMPLE_PERIOD_MILLIS, (unsigned long) millis());
 }
 
-// Bring the fish's tail out
-void tailOut() {
-  digitalWrite(HEADTAIL_MOTOR_PIN_1, HIGH);
-  digitalWrite(HEADTAIL_MOTOR_PIN_2, LOW);
+// Report that the button woke us from deep sleep, and how long ago the program started
+void reportButtonWake() {
+  Serial.printf("Woken by the button, program started %lu ms ago\n", (unsigned long) millis());
 }
 
-// Put the fish head and tail back to the neutral position
-void headTailRest() {
-  digitalWrite(HEADTAIL_MOTOR_PIN_1, LOW);
-  digitalWrite(HEADTAIL_MOTOR_PIN_2, LOW);
+// Report the light sensor's counters when it triggers, including how many readings it rejected as
+// noise, and the ADC throughput
+void reportLightSensorStats() {
+  LightSensorStats stats = getLightSensorStats();
+  Serial.printf("Light level %u, baseline %u: %u triggers, %u rejected, %u samples in %u windows at %lld samples/s\n",
+      getLightLevel(), getLightLevelBaseline(), (unsigned) stats.triggers, (unsigned) stats.rejected,
+      (unsigned) stats.samples, (unsigned) stats.windows,
+      (long long) (stats.busyUs > 0 ? stats.samples * 1000000LL / stats.busyUs : 0));
 }
 
-// Flap the fish's mouth for a defined time (in millis), opening and closing it at the defined interval (in millis).
-// runtime should be a multiple of interval * 2, otherwise the number of mouth movements will be rounded down.
-// Used to simulate singing or rapid speech.
-void flapMouthFor(int runtime, int interval) {
-  int runs = runtime / interval / 2.0;
-  for (int i = 0; i < runs; i++) {
-    mouthOpen();
-    lightSleep(interval);
-    mouthClose();
-    lightSleep(interval);
+// Report how late the choreography's motor movements were compared to when they should have
+// happened. If "last" is no worse than "mean", the timing did not drift over the song.
+void reportWakeStats(int tracknum) {
+  WakeStats stats = getWakeStats();
+  if (stats.count > 0) {
+    Serial.printf("Track %d: %u events, lateness mean %lld us, max %d us, last %d us\n", tracknum,
+        (unsigned) stats.count, (long long) (stats.totalLateUs / stats.count), (int) stats.maxLateUs, (int) stats.lastLateUs);
   }
 }
 
-// Flap the fish's mouth and tail together for a defined time (in millis), opening and closing the mouth and bringing
-// the tail out/in at the defined interval (in millis).
-// runtime should be a multiple of interval * 2, otherwise the number of mouth movements will be rounded down.
-// Used to simulate singing or rapid speech.
-void flapMouthAndTailTogetherFor(int runtime, int interval) {
-  int runs = runtime / interval / 2.0;
-  for (int i = 0; i < runs; i++) {
-    mouthOpen();
-    tailOut();
-    lightSleep(interval);
-    mouthClose();
-    headTailRest();
-    lightSleep(interval);
+// Report how live lipsync performed. The audio to mouth latency isn't measured, as we have nothing to
+// time the audio against; the figure given is a bound worked out from a block of audio, plus the DMA
+// buffer it arrived in if we were falling behind, plus the longest processing time. CPU load is the
+// processing time as a share of the audio time.
+void reportLipsyncStats(int tracknum) {
+  LipsyncStats stats = getLipsyncStats();
+  if (stats.blocks > 0) {
+    int64_t blockUs = AUDIO_BLOCK_SAMPLES * 1000000LL / AUDIO_SAMPLE_RATE;
+    int64_t meanProcessUs = stats.totalProcessUs / stats.blocks;
+    Serial.printf("Track %d: live lipsync, %u blocks (%u late), %u mouth moves, processing mean %lld us, max %d us, CPU %lld.%02lld%%, latency up to %lld us (from block sizes, not measured)\n",
+        tracknum, (unsigned) stats.blocks, (unsigned) stats.lateBlocks, (unsigned) stats.mouthMoves,
+        (long long) meanProcessUs, (int) stats.maxProcessUs,
+        (long long) (meanProcessUs * 100 / blockUs), (long long) (meanProcessUs * 10000 / blockUs % 100),
+        (long long) (blockUs + (stats.lateBlocks > 0 ? ADC_DMA_BUFFER_SAMPLES * 1000000LL / AUDIO_SAMPLE_RATE : 0) + stats.maxProcessUs));
   }
 }
 
-// Open the fish's mouth for a defined time (in millis), then close it. Used to simulate speaking a word.
-void mouthOpenFor(int runtime) {
-  mouthOpen();
-  lightSleep(runtime);
-  mouthClose();
-}
-
-// Open the fish's mouth
-void mouthOpen() {
-  digitalWrite(MOUTH_MOTOR_PIN_1, LOW);
-  digitalWrite(MOUTH_MOTOR_PIN_2, HIGH);
-}
-
-// Close the fish's mouth
-void mouthClose() {
-  digitalWrite(MOUTH_MOTOR_PIN_1, HIGH);
-  digitalWrite(MOUTH_MOTOR_PIN_2, LOW);
-}
-
-// Rest the fish's mouth
-void mouthRest() {
-  digitalWrite(MOUTH_MOTOR_PIN_1, LOW);
-  digitalWrite(MOUTH_MOTOR_PIN_2, LOW);
+// Report how long it took to stop after a cancel request, and the worst case so far
+void reportCancelResponse(int tracknum) {
+  static int64_t maxResponseUs = 0;
+  int64_t responseUs = timeNowUs() - getCancelRequestedUs();
+  maxResponseUs = max(maxResponseUs, responseUs);
+  Serial.printf("Track %d: cancelled, stopped %lld us after request, worst case %lld us\n", tracknum,
+      (long long) responseUs, (long long) maxResponseUs);
 }
 
 // Stop the motors & music
 void stop() {
   headTailRest();
   mouthRest();
-  sendCommandToMP3Player(0x16, 0);
-}
-
-// Set volume to specific value
-void changeVolume(int thevolume) {
-  sendCommandToMP3Player(0x06, thevolume);
+  stopMusic();
 }
-
-// Send a command to the MP3-TF-16P. Some commands support one or two bytes of data
-// Based on docs here: https://picaxe.com/docs/spe033.pdf
-// Todo: replace with https://registry.platformio.org/libraries/makuna/DFPlayer%20Mini%20Mp3%20by%20Makuna/
-void sendCommandToMP3Player(byte command, int dataBytes) {
-  byte commandData[10];
-  byte q;
-  int checkSum;
-  commandData[0] = 0x7E; //Start of new command
-  commandData[1] = 0xFF; //Version information
-  commandData[2] = 0x06; //Data length (not including parity) or the start and version
-  commandData[3] = command; //The command
-  commandData[4] = 0x01; //1 = feedback
-  commandData[5] = highByte(dataBytes); //High byte of the data
-  commandData[6] = lowByte(dataBytes); //low byte of the data
-  checkSum = -(commandData[1] + commandData[2] + commandData[3] + commandData[4] + commandData[5] + commandData[6]);
-  commandData[7] = highByte(checkSum); //High byte of the checkSum
-  commandData[8] = lowByte(checkSum); //low byte of the checkSum
-  commandData[9] = 0xEF; //End bit
-  delay(50);
-  for (q = 0; q < 10; q++) {
-    Serial2.write(commandData[q]);
-  }
-  delay(50);
-}
-
-// Replacement for "delay" that uses the ESP32 "light sleep" mode to save power
-void lightSleep(int timeMs) {
-  esp_sleep_enable_timer_wakeup(timeMs * 1000);
-  esp_light_sleep_start();
-}
\ No newline at end of file
@@ -0,0 +1,288 @@
+// Big Mouth Phatt Bass motor control
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Each movement has a drive profile, run by the LEDC hardware fade engine so it costs no CPU time.
+// The motor is kicked at a reduced duty cycle and ramped up to its peak, rather than switched
+// straight on flat out, which limits the current spike when a motor starts or reverses, and so the
+// supply dips that can brown out the ESP32. Rests ramp their braking up the same way, so a motor
+// stopping from full speed isn't shorted all at once. Once the movement has reached its end stop,
+// the duty fades down to a holding level, as a stalled motor only needs enough to hold against the
+// spring.
+//
+// Both motors' direction pins are committed together as a frame (see commitActuatorFrame()), with
+// one write to the GPIO clear register and one to the set register, rather than a digitalWrite()
+// per pin. So the motors switch together, and an H-bridge never sees half of a change.
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <soc/gpio_struct.h>
+#include "config.h"
+#include "choreography.h"
+#include "energy.h"
+#include "motors.h"
+#include "timing.h"
+#include "trace.h"
+
+// Arduino puts LEDC channels 0-7 in the high speed group, which the fade engine is driven through here
+static_assert(HEADTAIL_MOTOR_PWM_CHANNEL < 8 && MOUTH_MOTOR_PWM_CHANNEL < 8, "Motor PWM channels must be 0-7");
+// The direction pins are written through the registers for GPIOs 0-31
+static_assert(HEADTAIL_MOTOR_PIN_1 < 32 && HEADTAIL_MOTOR_PIN_2 < 32 && MOUTH_MOTOR_PIN_1 < 32 && MOUTH_MOTOR_PIN_2 < 32,
+    "Motor direction pins must be GPIO 0-31");
+
+// Drive profile for a movement: the levels of the motor's two direction pins, then in percent of
+// its full duty cycle, kick at kickPercent, ramp to peakPercent over MOTOR_RAMP_MILLIS, and fade
+// to holdPercent after MOTOR_HOLD_AFTER_MILLIS. With profiles disabled, the duty is always full.
+struct MotorProfile {
+  uint8_t action;
+  uint8_t pin1Level;
+  uint8_t pin2Level;
+  uint8_t kickPercent;
+  uint8_t peakPercent;
+  uint8_t holdPercent;
+};
+
+// Rests brake the motor, with both pins low, and end up braking at full duty as they always have
+const MotorProfile motorProfiles[] = {
+  { CHOREOGRAPHY_ACTION_HEAD_OUT, LOW, HIGH, MOTOR_KICK_PERCENT, 100, MOTOR_HOLD_PERCENT },
+  { CHOREOGRAPHY_ACTION_TAIL_OUT, HIGH, LOW, MOTOR_KICK_PERCENT, 100, MOTOR_HOLD_PERCENT },
+  { CHOREOGRAPHY_ACTION_HEADTAIL_REST, LOW, LOW, MOTOR_BRAKE_KICK_PERCENT, 100, 100 },
+  { CHOREOGRAPHY_ACTION_MOUTH_OPEN, LOW, HIGH, MOTOR_KICK_PERCENT, 100, MOTOR_HOLD_PERCENT },
+  { CHOREOGRAPHY_ACTION_MOUTH_CLOSE, HIGH, LOW, MOTOR_KICK_PERCENT, 100, MOTOR_HOLD_PERCENT },
+  { CHOREOGRAPHY_ACTION_MOUTH_REST, LOW, LOW, MOTOR_BRAKE_KICK_PERCENT, 100, 100 },
+};
+
+// One of the motors, and the duties of its current movement
+struct Motor {
+  uint8_t pin1;
+  uint8_t pin2;
+  ledc_channel_t channel;
+  uint32_t fullDuty;
+  esp_timer_handle_t holdTimer;
+  uint32_t kickDuty;
+  uint32_t peakDuty;
+  volatile uint32_t holdDuty; // Read by the hold timer
+  uint8_t index;              // For energy accounting, see energy.h
+  volatile uint8_t action;    // The current movement, read by the hold timer
+};
+
+void startMovement(Motor &motor, uint8_t action, uint8_t amplitudePercent, uint32_t &pinLevels);
+void finishMovement(Motor &motor, uint8_t action, uint8_t amplitudePercent);
+const MotorProfile *findMotorProfile(uint8_t action);
+void holdMotor(void *arg);
+
+Motor headTailMotor = { HEADTAIL_MOTOR_PIN_1, HEADTAIL_MOTOR_PIN_2, (ledc_channel_t) HEADTAIL_MOTOR_PWM_CHANNEL,
+    HEADTAIL_MOTOR_PWM_DUTY_CYCLE, nullptr, 0, 0, 0, 0, CHOREOGRAPHY_ACTION_HEADTAIL_REST };
+Motor mouthMotor = { MOUTH_MOTOR_PIN_1, MOUTH_MOTOR_PIN_2, (ledc_channel_t) MOUTH_MOTOR_PWM_CHANNEL,
+    MOUTH_MOTOR_PWM_DUTY_CYCLE, nullptr, 0, 0, 0, 1, CHOREOGRAPHY_ACTION_MOUTH_REST };
+volatile bool motorProfilesEnabled = MOTOR_PROFILES_ENABLED;
+
+// The direction pins, as a GPIO register mask, and the levels they were last set to. Both motors
+// start at rest, with their pins low, as pinMode() leaves them.
+const uint32_t motorPinMask = (1UL << HEADTAIL_MOTOR_PIN_1) | (1UL << HEADTAIL_MOTOR_PIN_2)
+    | (1UL << MOUTH_MOTOR_PIN_1) | (1UL << MOUTH_MOTOR_PIN_2);
+uint32_t motorPinLevels = 0;
+ActuatorFrame currentFrame = { CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST, MOTOR_AMPLITUDE_FULL };
+
+// Set up motor control pins, PWM and the fade engine
+void setupMotors() {
+  pinMode(HEADTAIL_MOTOR_PIN_1, OUTPUT);
+  pinMode(HEADTAIL_MOTOR_PIN_2, OUTPUT);
+  pinMode(HEADTAIL_MOTOR_PWM_PIN, OUTPUT);
+  pinMode(MOUTH_MOTOR_PIN_1, OUTPUT);
+  pinMode(MOUTH_MOTOR_PIN_2, OUTPUT);
+  pinMode(MOUTH_MOTOR_PWM_PIN, OUTPUT);
+
+  ledcSetup(HEADTAIL_MOTOR_PWM_CHANNEL, PWM_FREQUENCY, PWM_RESOLUTION);
+  ledcSetup(MOUTH_MOTOR_PWM_CHANNEL, PWM_FREQUENCY, PWM_RESOLUTION);
+  ledcAttachPin(HEADTAIL_MOTOR_PWM_PIN, HEADTAIL_MOTOR_PWM_CHANNEL);
+  ledcAttachPin(MOUTH_MOTOR_PWM_PIN, MOUTH_MOTOR_PWM_CHANNEL);
+  ledcWrite(HEADTAIL_MOTOR_PWM_CHANNEL, HEADTAIL_MOTOR_PWM_DUTY_CYCLE);
+  ledcWrite(MOUTH_MOTOR_PWM_CHANNEL, MOUTH_MOTOR_PWM_DUTY_CYCLE);
+  ledc_fade_func_install(0);
+
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = holdMotor;
+  timerArgs.dispatch_method = ESP_TIMER_TASK;
+  timerArgs.arg = &headTailMotor;
+  timerArgs.name = "headtail hold";
+  esp_timer_create(&timerArgs, &headTailMotor.holdTimer);
+  timerArgs.arg = &mouthMotor;
+  timerArgs.name = "mouth hold";
+  esp_timer_create(&timerArgs, &mouthMotor.holdTimer);
+}
+
+// Bring the fish's head out
+void headOut() {
+  moveHeadTail(CHOREOGRAPHY_ACTION_HEAD_OUT);
+}
+
+// Bring the fish's tail out
+void tailOut() {
+  moveHeadTail(CHOREOGRAPHY_ACTION_TAIL_OUT);
+}
+
+// Put the fish head and tail back to the neutral position
+void headTailRest() {
+  moveHeadTail(CHOREOGRAPHY_ACTION_HEADTAIL_REST);
+}
+
+// Open the fish's mouth. A partial opening drives the motor more gently, so it gets part of the
+// way against the spring; how far depends on the fish.
+void mouthOpen(uint8_t amplitudePercent) {
+  moveMouth(CHOREOGRAPHY_ACTION_MOUTH_OPEN, amplitudePercent);
+}
+
+// Close the fish's mouth
+void mouthClose() {
+  moveMouth(CHOREOGRAPHY_ACTION_MOUTH_CLOSE, MOTOR_AMPLITUDE_FULL);
+}
+
+// Rest the fish's mouth
+void mouthRest() {
+  moveMouth(CHOREOGRAPHY_ACTION_MOUTH_REST, MOTOR_AMPLITUDE_FULL);
+}
+
+// Move the head and tail, leaving the mouth as it is
+void moveHeadTail(uint8_t action) {
+  ActuatorFrame frame = currentFrame;
+  frame.headTail = action;
+  commitActuatorFrame(frame);
+}
+
+// Move the mouth, leaving the head and tail as they are
+void moveMouth(uint8_t action, uint8_t amplitudePercent) {
+  ActuatorFrame frame = currentFrame;
+  frame.mouth = action;
+  frame.mouthAmplitude = amplitudePercent;
+  commitActuatorFrame(frame);
+}
+
+// What the motors were last told to do
+ActuatorFrame getActuatorFrame() {
+  return currentFrame;
+}
+
+// Move both motors to the states in a frame. Only motors whose state has changed are touched, and
+// the direction pins of both are switched together once each changed motor has its kick duty set.
+// Actions that aren't motor movements are ignored.
+void commitActuatorFrame(const ActuatorFrame &frame) {
+  bool headTailChanged = frame.headTail != currentFrame.headTail && findMotorProfile(frame.headTail) != nullptr;
+  bool mouthChanged = (frame.mouth != currentFrame.mouth || frame.mouthAmplitude != currentFrame.mouthAmplitude)
+      && findMotorProfile(frame.mouth) != nullptr;
+  uint32_t pinLevels = motorPinLevels;
+  if (headTailChanged) {
+    startMovement(headTailMotor, frame.headTail, MOTOR_AMPLITUDE_FULL, pinLevels);
+    currentFrame.headTail = frame.headTail;
+  }
+  if (mouthChanged) {
+    startMovement(mouthMotor, frame.mouth, frame.mouthAmplitude, pinLevels);
+    currentFrame.mouth = frame.mouth;
+    currentFrame.mouthAmplitude = frame.mouthAmplitude;
+  }
+  writeMotorPins(pinLevels & ~motorPinLevels, ~pinLevels & motorPinLevels);
+  motorPinLevels = pinLevels;
+  if (headTailChanged) {
+    finishMovement(headTailMotor, frame.headTail, MOTOR_AMPLITUDE_FULL);
+  }
+  if (mouthChanged) {
+    finishMovement(mouthMotor, frame.mouth, frame.mouthAmplitude);
+  }
+}
+
+// Write the direction pins that have changed, with one write to the clear register and one to the
+// set register. Clearing first means a reversing H-bridge passes through rest, both inputs low,
+// rather than both high. In IRAM, so a flash cache miss can't hold up the second write.
+void IRAM_ATTR writeMotorPins(uint32_t setMask, uint32_t clearMask) {
+  GPIO.out_w1tc = clearMask;
+  GPIO.out_w1ts = setMask;
+}
+
+// Start a movement: set the kick duty, before the direction pins change, so a reversing motor never
+// sees the full duty, and work out the new pin levels. Setting the duty waits for any fade still
+// running on this motor, so movements on the same motor less than MOTOR_RAMP_MILLIS apart, or
+// during the MOTOR_HOLD_FADE_MILLIS fade to the holding duty, are delayed by the rest of the fade.
+void startMovement(Motor &motor, uint8_t action, uint8_t amplitudePercent, uint32_t &pinLevels) {
+  const MotorProfile &profile = *findMotorProfile(action);
+  uint32_t fullDuty = motor.fullDuty * amplitudePercent / 100;
+  motor.kickDuty = motorProfilesEnabled ? fullDuty * profile.kickPercent / 100 : fullDuty;
+  motor.peakDuty = motorProfilesEnabled ? fullDuty * profile.peakPercent / 100 : fullDuty;
+  esp_timer_stop(motor.holdTimer);
+  motor.holdDuty = motorProfilesEnabled ? fullDuty * profile.holdPercent / 100 : fullDuty;
+  motor.action = action;
+  ledc_set_duty_and_update(LEDC_HIGH_SPEED_MODE, motor.channel, motor.kickDuty, 0);
+  setMotorEnergyState(motor.index, action, motor.peakDuty * 100 / motor.fullDuty);
+
+  pinLevels &= ~((1UL << motor.pin1) | (1UL << motor.pin2));
+  pinLevels |= (profile.pin1Level ? 1UL << motor.pin1 : 0) | (profile.pin2Level ? 1UL << motor.pin2 : 0);
+}
+
+// Once the direction pins have switched, fade up to the peak and set the timer to fade down to the
+// holding duty
+void finishMovement(Motor &motor, uint8_t action, uint8_t amplitudePercent) {
+  if (motor.peakDuty != motor.kickDuty) {
+    ledc_set_fade_with_time(LEDC_HIGH_SPEED_MODE, motor.channel, motor.peakDuty, MOTOR_RAMP_MILLIS);
+    ledc_fade_start(LEDC_HIGH_SPEED_MODE, motor.channel, LEDC_FADE_NO_WAIT);
+  }
+  if (motor.holdDuty != motor.peakDuty) {
+    esp_timer_start_once(motor.holdTimer, MOTOR_HOLD_AFTER_MILLIS * 1000ULL);
+  }
+  TRACE(TRACE_MOTOR, action, amplitudePercent);
+}
+
+// The drive profile for a movement, or nullptr if it isn't one
+const MotorProfile *findMotorProfile(uint8_t action) {
+  for (const MotorProfile &profile : motorProfiles) {
+    if (profile.action == action) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
+
+// Fade a motor down to its holding duty once its movement has finished. The fade engine can't wait
+// before starting a fade, so the timer does that. Runs in the esp_timer task.
+void holdMotor(void *arg) {
+  Motor *motor = (Motor *) arg;
+  ledc_set_fade_with_time(LEDC_HIGH_SPEED_MODE, motor->channel, motor->holdDuty, MOTOR_HOLD_FADE_MILLIS);
+  ledc_fade_start(LEDC_HIGH_SPEED_MODE, motor->channel, LEDC_FADE_NO_WAIT);
+  setMotorEnergyState(motor->index, motor->action, motor->holdDuty * 100 / motor->fullDuty);
+}
+
+// Turn the drive profiles on or off, e.g. to compare time-to-position with calibrateLeadTime().
+// Off drives the motors flat out for every movement.
+void setMotorProfilesEnabled(bool enabled) {
+  motorProfilesEnabled = enabled;
+}
+
+// True if movements use their drive profiles
+bool areMotorProfilesEnabled() {
+  return motorProfilesEnabled;
+}
+
+// Reverse both motors together, the worst case for current draw, first flat out and then with the
+// drive profiles, so the peak supply current can be compared on a meter with peak hold or a scope.
+// Serial markers show which half is which. Runs in the motion task, and stops if cancelled.
+void runMotorTest() {
+  bool wasEnabled = motorProfilesEnabled;
+  for (int pass = 0; pass < 2 && !isCancelRequested(); pass++) {
+    motorProfilesEnabled = pass == 1;
+    const char *name = motorProfilesEnabled ? "profiles" : "flat out";
+    Serial.printf("MOTORTEST_BEGIN,%s\n", name);
+    int64_t epochUs = timeNowUs() + MOTOR_TEST_PERIOD_MILLIS * 1000LL;
+    for (int i = 0; i < MOTOR_TEST_CYCLES * 2 && !isCancelRequested(); i++) {
+      sleepUntil(epochUs + i * MOTOR_TEST_PERIOD_MILLIS * 500LL);
+      // Both motors in one frame, so they reverse at the same instant
+      if (i % 2 == 0) {
+        commitActuatorFrame({ CHOREOGRAPHY_ACTION_HEAD_OUT, CHOREOGRAPHY_ACTION_MOUTH_OPEN, MOTOR_AMPLITUDE_FULL });
+      } else {
+        commitActuatorFrame({ CHOREOGRAPHY_ACTION_TAIL_OUT, CHOREOGRAPHY_ACTION_MOUTH_CLOSE, MOTOR_AMPLITUDE_FULL });
+      }
+    }
+    waitUntilOrCancelled(timeNowUs() + MOTOR_TEST_PERIOD_MILLIS * 500LL);
+    commitActuatorFrame({ CHOREOGRAPHY_ACTION_HEADTAIL_REST, CHOREOGRAPHY_ACTION_MOUTH_REST, MOTOR_AMPLITUDE_FULL });
+    Serial.printf("MOTORTEST_END,%s\n", name);
+    waitUntilOrCancelled(timeNowUs() + MOTOR_TEST_PERIOD_MILLIS * 2000LL);
+  }
+  motorProfilesEnabled = wasEnabled;
+}
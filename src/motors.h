@@ -0,0 +1,32 @@
+// Big Mouth Phatt Bass motor control
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include <Arduino.h>
+
+#define MOTOR_AMPLITUDE_FULL 100 // Percent
+
+// What both motors are doing, as the choreography action (see choreography.h) that put each one in
+// its state. Changes to both motors are made together by committing a whole frame.
+struct ActuatorFrame {
+  uint8_t headTail;
+  uint8_t mouth;
+  uint8_t mouthAmplitude; // Percent, for CHOREOGRAPHY_ACTION_MOUTH_OPEN
+};
+
+void setupMotors();
+void headOut();
+void tailOut();
+void headTailRest();
+void mouthOpen(uint8_t amplitudePercent = MOTOR_AMPLITUDE_FULL);
+void mouthClose();
+void mouthRest();
+void moveHeadTail(uint8_t action);
+void moveMouth(uint8_t action, uint8_t amplitudePercent);
+ActuatorFrame getActuatorFrame();
+void commitActuatorFrame(const ActuatorFrame &frame);
+void writeMotorPins(uint32_t setMask, uint32_t clearMask);
+void setMotorProfilesEnabled(bool enabled);
+bool areMotorProfilesEnabled();
+void runMotorTest();
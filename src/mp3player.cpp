@@ -0,0 +1,276 @@
+// Big Mouth Phatt Bass MP3 player driver
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "energy.h"
+#include "mp3player.h"
+#include "timing.h"
+#include "trace.h"
+
+void writeMP3Frame(const MP3Command &cmd);
+void mp3TxTimerCallback(void *arg);
+void parseMP3Byte(byte b);
+bool isValidMP3Frame(const byte *frame);
+void handleMP3Frame(byte command, uint16_t data);
+
+// Queue of commands waiting to be sent. Guarded by mp3QueueMux, since commands are added from
+// the main code and removed by the timer callback.
+MP3Command mp3Queue[MP3_COMMAND_QUEUE_SIZE];
+int mp3QueueHead = 0;
+int mp3QueueCount = 0;
+portMUX_TYPE mp3QueueMux = portMUX_INITIALIZER_UNLOCKED;
+esp_timer_handle_t mp3TxTimer;
+bool mp3TxTimerArmed = false;
+int64_t mp3NextSlotUs = 0; // Earliest time the next queued command can be sent
+
+// Feedback frame being received from the MP3 player, and what we've learned from previous ones
+byte mp3RxFrame[10];
+int mp3RxLength = 0;
+MP3PlayerStatus mp3Status;
+portMUX_TYPE mp3StatusMux = portMUX_INITIALIZER_UNLOCKED; // Status is written by the comms task and read by others
+
+// Set up serial comms to MP3 player, and the timer that sends queued commands
+void setupMP3Player() {
+  Serial2.begin(MP3_PLAYER_BAUD_RATE);
+
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = mp3TxTimerCallback;
+  timerArgs.name = "mp3tx";
+  esp_timer_create(&timerArgs, &mp3TxTimer);
+}
+
+// Play a specific track number from a specific folder. Returns the time the play command will be
+// sent, in micros (see timeNowUs()).
+int64_t playTrack(int foldernum, int tracknum) {
+  // Disable repeat
+  sendCommandToMP3Player(0x11, 0);
+  // Play track
+  int foldertrack = (foldernum << 8) | tracknum;
+  return sendCommandToMP3Player(0x0f, foldertrack);
+}
+
+// Stop the music
+int64_t stopMusic() {
+  return sendCommandToMP3Player(0x16, 0);
+}
+
+// Set volume to specific value
+int64_t changeVolume(int thevolume) {
+  return sendCommandToMP3Player(0x06, thevolume);
+}
+
+// Queue a command to the MP3-TF-16P. Some commands support one or two bytes of data.
+// Returns the time the command will be sent, in micros (see timeNowUs()). Only blocks if the
+// queue is full.
+int64_t sendCommandToMP3Player(byte command, int dataBytes) {
+  while (true) {
+    bool armTimer = false;
+    int64_t sendAtUs = 0;
+    int64_t nowUs = timeNowUs();
+
+    portENTER_CRITICAL(&mp3QueueMux);
+    bool queued = mp3QueueCount < MP3_COMMAND_QUEUE_SIZE;
+    if (queued) {
+      sendAtUs = max(nowUs, mp3NextSlotUs);
+      mp3NextSlotUs = sendAtUs + MP3_COMMAND_SPACING_MILLIS * 1000LL;
+      MP3Command &cmd = mp3Queue[(mp3QueueHead + mp3QueueCount) % MP3_COMMAND_QUEUE_SIZE];
+      cmd.command = command;
+      cmd.data = dataBytes;
+      cmd.sendAtUs = sendAtUs;
+      mp3QueueCount++;
+      if (!mp3TxTimerArmed) {
+        mp3TxTimerArmed = true;
+        armTimer = true;
+      }
+    }
+    portEXIT_CRITICAL(&mp3QueueMux);
+
+    if (queued) {
+      TRACE(TRACE_MP3_QUEUED, command, dataBytes);
+      if (armTimer) {
+        // UART transmission needs the clocks running, so no light sleep until the queue drains
+        inhibitLightSleep();
+        esp_timer_start_once(mp3TxTimer, max(sendAtUs - nowUs, (int64_t) 0));
+      }
+      return sendAtUs;
+    }
+    delay(1);
+  }
+}
+
+// True if there are commands still waiting to be sent, or the last one is still being transmitted
+bool isMP3PlayerBusy() {
+  return mp3TxTimerArmed;
+}
+
+// Read and parse any feedback frames the MP3 player has sent. Called regularly by the comms task.
+// Light sleep needs to be inhibited while feedback is expected, as the UART can't receive in light sleep.
+void pollMP3Player() {
+  while (Serial2.available() > 0) {
+    parseMP3Byte(Serial2.read());
+  }
+}
+
+// Get the feedback received from the MP3 player so far
+MP3PlayerStatus getMP3PlayerStatus() {
+  portENTER_CRITICAL(&mp3StatusMux);
+  MP3PlayerStatus status = mp3Status;
+  portEXIT_CRITICAL(&mp3StatusMux);
+  return status;
+}
+
+// Wait for the MP3 player to confirm it has started a track that was sent a play command at
+// playSentUs (as returned by playTrack()). Returns the time the music started, to use as the
+// choreography epoch, or -1 if the player reported an error or the wait was cancelled. If the player
+// never acknowledges the command (e.g. a module without feedback), falls back to the expected time
+// based on playSentUs.
+int64_t waitForMP3PlaybackStart(int64_t playSentUs) {
+  int64_t timeoutUs = playSentUs + MP3_FEEDBACK_TIMEOUT_MILLIS * 1000LL;
+  while (timeNowUs() < timeoutUs) {
+    MP3PlayerStatus status = getMP3PlayerStatus();
+    if (status.lastErrorUs > playSentUs) {
+      return -1;
+    }
+    if (status.lastAckUs > playSentUs) {
+      return status.lastAckUs + MP3_ACK_TO_PLAY_MILLIS * 1000LL;
+    }
+    if (!waitUntilOrCancelled(timeNowUs() + 1000)) {
+      return -1;
+    }
+  }
+  return playSentUs + MP3_PLAY_LATENCY_MILLIS * 1000LL;
+}
+
+// True if the MP3 player has reported finishing a track since the given time
+bool hasMP3TrackFinishedSince(int64_t sinceUs) {
+  return getMP3PlayerStatus().lastTrackFinishedUs > sinceUs;
+}
+
+// Add a received byte to the feedback frame. Once a full frame has arrived it is checked and
+// handled. If it is invalid, we resync on the next start byte, so one corrupted or dropped byte
+// doesn't lose all the frames after it.
+void parseMP3Byte(byte b) {
+  if (mp3RxLength == 0 && b != 0x7E) {
+    return;
+  }
+  mp3RxFrame[mp3RxLength++] = b;
+  if (mp3RxLength < (int) sizeof(mp3RxFrame)) {
+    return;
+  }
+
+  if (isValidMP3Frame(mp3RxFrame)) {
+    handleMP3Frame(mp3RxFrame[3], (mp3RxFrame[5] << 8) | mp3RxFrame[6]);
+    mp3RxLength = 0;
+    return;
+  }
+
+  portENTER_CRITICAL(&mp3StatusMux);
+  mp3Status.badFrames++;
+  portEXIT_CRITICAL(&mp3StatusMux);
+  int start = 1;
+  while (start < mp3RxLength && mp3RxFrame[start] != 0x7E) {
+    start++;
+  }
+  mp3RxLength -= start;
+  memmove(mp3RxFrame, mp3RxFrame + start, mp3RxLength);
+}
+
+// Check the framing and checksum of a received frame
+bool isValidMP3Frame(const byte *frame) {
+  if (frame[0] != 0x7E || frame[1] != 0xFF || frame[2] != 0x06 || frame[9] != 0xEF) {
+    return false;
+  }
+  uint16_t checkSum = (frame[7] << 8) | frame[8];
+  uint16_t sum = frame[1] + frame[2] + frame[3] + frame[4] + frame[5] + frame[6];
+  return (uint16_t) (sum + checkSum) == 0;
+}
+
+// Record what a valid feedback frame told us
+void handleMP3Frame(byte command, uint16_t data) {
+  int64_t nowUs = timeNowUs();
+  TRACE(TRACE_MP3_RECEIVED, command, data);
+  portENTER_CRITICAL(&mp3StatusMux);
+  switch (command) {
+    case 0x41: // ACK
+      mp3Status.acks++;
+      mp3Status.lastAckUs = nowUs;
+      break;
+    case 0x40: // Error
+      mp3Status.errors++;
+      mp3Status.lastError = data;
+      mp3Status.lastErrorUs = nowUs;
+      break;
+    case 0x3D: // Track finished (TF card)
+      mp3Status.tracksFinished++;
+      mp3Status.lastTrackFinished = data;
+      mp3Status.lastTrackFinishedUs = nowUs;
+      break;
+    default:
+      if (command >= 0x3F && command <= 0x4F) { // Replies to query commands, e.g. status
+        mp3Status.lastReply = command;
+        mp3Status.lastReplyData = data;
+        mp3Status.lastReplyUs = nowUs;
+      }
+      break;
+  }
+  portEXIT_CRITICAL(&mp3StatusMux);
+}
+
+// Timer callback that sends the command at the front of the queue once its time comes, then
+// re-arms itself for the next one. Once the queue is empty it waits one more spacing period, to let
+// the last frame finish transmitting, before allowing light sleep again.
+void mp3TxTimerCallback(void *arg) {
+  MP3Command cmd;
+  bool haveCommand = false;
+  bool finished = false;
+  int64_t nowUs = timeNowUs();
+  int64_t nextAtUs = 0;
+
+  portENTER_CRITICAL(&mp3QueueMux);
+  if (mp3QueueCount == 0) {
+    mp3TxTimerArmed = false;
+    finished = true;
+  } else if (mp3Queue[mp3QueueHead].sendAtUs > nowUs) {
+    nextAtUs = mp3Queue[mp3QueueHead].sendAtUs;
+  } else {
+    cmd = mp3Queue[mp3QueueHead];
+    mp3QueueHead = (mp3QueueHead + 1) % MP3_COMMAND_QUEUE_SIZE;
+    mp3QueueCount--;
+    haveCommand = true;
+    nextAtUs = mp3QueueCount > 0 ? mp3Queue[mp3QueueHead].sendAtUs : cmd.sendAtUs + MP3_COMMAND_SPACING_MILLIS * 1000LL;
+  }
+  portEXIT_CRITICAL(&mp3QueueMux);
+
+  if (finished) {
+    releaseLightSleep();
+    return;
+  }
+  if (haveCommand) {
+    writeMP3Frame(cmd);
+  }
+  esp_timer_start_once(mp3TxTimer, max(nextAtUs - timeNowUs(), (int64_t) 0));
+}
+
+// Send a command frame to the MP3-TF-16P
+// Based on docs here: https://picaxe.com/docs/spe033.pdf
+// Todo: replace with https://registry.platformio.org/libraries/makuna/DFPlayer%20Mini%20Mp3%20by%20Makuna/
+void writeMP3Frame(const MP3Command &cmd) {
+  byte commandData[10];
+  int checkSum;
+  commandData[0] = 0x7E; //Start of new command
+  commandData[1] = 0xFF; //Version information
+  commandData[2] = 0x06; //Data length (not including parity) or the start and version
+  commandData[3] = cmd.command; //The command
+  commandData[4] = 0x01; //1 = feedback
+  commandData[5] = highByte(cmd.data); //High byte of the data
+  commandData[6] = lowByte(cmd.data); //low byte of the data
+  checkSum = -(commandData[1] + commandData[2] + commandData[3] + commandData[4] + commandData[5] + commandData[6]);
+  commandData[7] = highByte(checkSum); //High byte of the checkSum
+  commandData[8] = lowByte(checkSum); //low byte of the checkSum
+  commandData[9] = 0xEF; //End bit
+  Serial2.write(commandData, sizeof(commandData));
+  addEnergyTime(ENERGY_UART_TX, sizeof(commandData) * 10 * 1000000LL / MP3_PLAYER_BAUD_RATE); // 8N1
+  TRACE(TRACE_MP3_SENT, cmd.command, cmd.data);
+}
@@ -0,0 +1,44 @@
+// Big Mouth Phatt Bass MP3 player driver
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Commands to the MP3-TF-16P are queued and sent in the background by an esp_timer callback,
+// keeping the minimum spacing between frames that the module needs. Callers return immediately.
+// Feedback frames sent back by the module are parsed by pollMP3Player().
+
+#pragma once
+
+#include <Arduino.h>
+
+// A command waiting to be sent to the MP3 player, with the time it is scheduled to be sent
+struct MP3Command {
+  byte command;
+  uint16_t data;
+  int64_t sendAtUs;
+};
+
+// Feedback received from the MP3 player. Times are in micros (see timeNowUs()), or 0 if never seen.
+struct MP3PlayerStatus {
+  uint32_t acks;              // Commands acknowledged (0x41)
+  int64_t lastAckUs;
+  uint32_t errors;            // Errors reported (0x40), e.g. file not found
+  int64_t lastErrorUs;
+  uint16_t lastError;
+  uint32_t tracksFinished;    // Tracks finished playing (0x3D)
+  int64_t lastTrackFinishedUs;
+  uint16_t lastTrackFinished;
+  byte lastReply;             // Last reply to a query command (0x3F-0x4F), e.g. status (0x42)
+  uint16_t lastReplyData;
+  int64_t lastReplyUs;
+  uint32_t badFrames;         // Frames discarded due to bad framing or checksum
+};
+
+void setupMP3Player();
+int64_t playTrack(int foldernum, int tracknum);
+int64_t stopMusic();
+int64_t changeVolume(int thevolume);
+int64_t sendCommandToMP3Player(byte command, int dataBytes);
+bool isMP3PlayerBusy();
+void pollMP3Player();
+MP3PlayerStatus getMP3PlayerStatus();
+int64_t waitForMP3PlaybackStart(int64_t playSentUs);
+bool hasMP3TrackFinishedSince(int64_t sinceUs);
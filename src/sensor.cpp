@@ -0,0 +1,240 @@
+// Big Mouth Phatt Bass light sensor handling
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp32/ulp.h>
+#include <driver/adc.h>
+#include "config.h"
+#include "adcsampler.h"
+#include "energy.h"
+#include "sensor.h"
+#include "timing.h"
+
+bool readLightSensorWindow();
+light_level_t lightLevelDeviation();
+
+// Where the ULP program keeps its variables, in words from the start of RTC slow memory. This has
+// to be inside the space reserved for the ULP (CONFIG_ESP32_ULP_COPROC_RESERVE_MEM) and clear of
+// the program itself, which is loaded at the start.
+#define ULP_DATA_OFFSET 112
+#define ULP_BASELINE 0
+#define ULP_SAMPLE 1
+#define ULP_SAMPLE_COUNT 2
+
+// Branch labels in the ULP program
+#define ULP_LABEL_BELOW_BASELINE 1
+#define ULP_LABEL_UPDATE_BASELINE 2
+#define ULP_LABEL_WAKE 3
+
+// Change in raw ADC reading that counts as a change in light level
+#define ULP_TRIGGER_THRESHOLD ((int) (SENSOR_TRIGGER_THRESHOLD * LDR_FULL_SCALE))
+
+// Light sensor filter settings. The filter state has extra fraction bits so small steps aren't lost.
+#define SENSOR_FILTER_FRACTION_BITS 8
+#define SENSOR_WINDOW_SAMPLES (SENSOR_SAMPLE_RATE * SENSOR_WINDOW_MILLIS / 1000)
+#define SENSOR_TRIGGER_LEVEL ((light_level_t) (SENSOR_TRIGGER_THRESHOLD * LIGHT_LEVEL_MAX))
+#define SENSOR_RELEASE_LEVEL ((light_level_t) (SENSOR_RELEASE_THRESHOLD * LIGHT_LEVEL_MAX))
+
+// Light sensor state, only used from the input task
+bool sensorInitialised = false;
+bool sensorTriggered = false;
+int32_t sensorFiltered = 0;  // Filtered light level, with SENSOR_FILTER_FRACTION_BITS extra bits
+int32_t sensorBaseline = 0;  // Slowly adapting baseline, likewise
+uint16_t sensorRaw = 0;      // Last averaged raw ADC reading
+LightSensorStats sensorStats;
+
+// Run by the ULP every SENSOR_ULP_SAMPLE_PERIOD_MILLIS while we deep sleep. Averages a few ADC
+// readings, wakes the main cores if the result is more than the threshold either side of the
+// baseline, otherwise moves the baseline 1/8 of the way towards it. The ULP has no signed maths,
+// so "below the baseline" is detected from the overflow flag of the subtraction.
+const ulp_insn_t ldrWatcherProgram[] = {
+  I_MOVI(R3, ULP_DATA_OFFSET),
+  I_MOVI(R1, 0),
+  I_ADC(R0, 0, LDR_ADC_CHANNEL),
+  I_ADDR(R1, R1, R0),
+  I_ADC(R0, 0, LDR_ADC_CHANNEL),
+  I_ADDR(R1, R1, R0),
+  I_ADC(R0, 0, LDR_ADC_CHANNEL),
+  I_ADDR(R1, R1, R0),
+  I_ADC(R0, 0, LDR_ADC_CHANNEL),
+  I_ADDR(R1, R1, R0),
+  I_RSHI(R1, R1, 2),
+  I_ST(R1, R3, ULP_SAMPLE),
+  I_LD(R0, R3, ULP_SAMPLE_COUNT),
+  I_ADDI(R0, R0, 1),
+  I_ST(R0, R3, ULP_SAMPLE_COUNT),
+  I_LD(R2, R3, ULP_BASELINE),
+  I_SUBR(R0, R1, R2),
+  M_BXF(ULP_LABEL_BELOW_BASELINE),
+  M_BGE(ULP_LABEL_WAKE, ULP_TRIGGER_THRESHOLD),
+  M_BX(ULP_LABEL_UPDATE_BASELINE),
+  M_LABEL(ULP_LABEL_BELOW_BASELINE),
+  I_SUBR(R0, R2, R1),
+  M_BGE(ULP_LABEL_WAKE, ULP_TRIGGER_THRESHOLD),
+  M_LABEL(ULP_LABEL_UPDATE_BASELINE),
+  I_RSHI(R0, R2, 3),
+  I_SUBR(R2, R2, R0),
+  I_RSHI(R0, R1, 3),
+  I_ADDR(R2, R2, R0),
+  I_ST(R2, R3, ULP_BASELINE),
+  I_HALT(),
+  M_LABEL(ULP_LABEL_WAKE),
+  I_WAKE(),
+  I_END(), // Stop the ULP timer, we only need waking once
+  I_HALT()
+};
+
+// Take an oversampled reading from the LDR and run it through the filter. Returns true when the
+// light level has moved away from the baseline by more than the trigger threshold, which is only
+// reported once until it has come back within the release threshold. A reading past the threshold
+// is confirmed with a second one straight away, so a single noisy reading can't trigger.
+bool updateLightSensor() {
+  if (!readLightSensorWindow()) {
+    return false;
+  }
+  bool triggered = false;
+  if (!sensorTriggered && lightLevelDeviation() > SENSOR_TRIGGER_LEVEL) {
+    if (readLightSensorWindow() && lightLevelDeviation() > SENSOR_TRIGGER_LEVEL) {
+      sensorTriggered = true;
+      triggered = true;
+      sensorStats.triggers++;
+    } else {
+      sensorStats.rejected++;
+    }
+  } else if (sensorTriggered && lightLevelDeviation() < SENSOR_RELEASE_LEVEL) {
+    sensorTriggered = false;
+  }
+
+  // The baseline follows the light level slowly, so gradual changes like daylight fading don't
+  // trigger, and a new level eventually becomes the normal one
+  sensorBaseline += (sensorFiltered - sensorBaseline) >> SENSOR_BASELINE_SHIFT;
+  return triggered;
+}
+
+// Start the baseline again from the current light level, so we don't trigger immediately
+void resetLightSensorBaseline() {
+  sensorInitialised = false;
+  sensorTriggered = false;
+  readLightSensorWindow();
+}
+
+// The current filtered light level, from 0 (dark) to LIGHT_LEVEL_MAX
+light_level_t getLightLevel() {
+  return sensorFiltered >> SENSOR_FILTER_FRACTION_BITS;
+}
+
+// The level the light sensor is comparing against to decide if the light level has changed
+light_level_t getLightLevelBaseline() {
+  return sensorBaseline >> SENSOR_FILTER_FRACTION_BITS;
+}
+
+// Get the light sensor counters since startup
+LightSensorStats getLightSensorStats() {
+  return sensorStats;
+}
+
+// Read one window of samples from the ADC and average them, then feed the result into the
+// filter. The window is a whole number of mains cycles, so light flicker averages out. Light sleep
+// is held off while the DMA runs. Returns false if the ADC couldn't be read.
+bool readLightSensorWindow() {
+  // If the sampler is busy listening to the music, we're performing anyway
+  if (!startAdcSampling(LDR_ADC_CHANNEL, SENSOR_SAMPLE_RATE, 0)) {
+    return false;
+  }
+  int64_t startUs = timeNowUs();
+  uint32_t total = 0;
+  uint32_t count = 0;
+  uint16_t buffer[ADC_DMA_BUFFER_SAMPLES];
+  while (count < SENSOR_WINDOW_SAMPLES) {
+    size_t read = readAdcSamples(buffer, min((size_t) (SENSOR_WINDOW_SAMPLES - count), (size_t) ADC_DMA_BUFFER_SAMPLES), SENSOR_WINDOW_MILLIS * 2);
+    if (read == 0) {
+      break;
+    }
+    for (size_t i = 0; i < read; i++) {
+      total += buffer[i];
+    }
+    count += read;
+  }
+  stopAdcSampling();
+  sensorStats.samples += count;
+  sensorStats.busyUs += timeNowUs() - startUs;
+  if (count == 0) {
+    return false;
+  }
+  sensorStats.windows++;
+
+  // Average in fixed point, with four extra bits from the oversampling, then normalise
+  uint32_t rawQ4 = min(total * 16 / count, (uint32_t) LDR_FULL_SCALE * 16);
+  sensorRaw = rawQ4 / 16;
+  int32_t level = ((uint32_t) LDR_FULL_SCALE * 16 - rawQ4) * LIGHT_LEVEL_MAX / (LDR_FULL_SCALE * 16);
+  level <<= SENSOR_FILTER_FRACTION_BITS;
+  if (!sensorInitialised) {
+    sensorFiltered = level;
+    sensorBaseline = level;
+    sensorInitialised = true;
+  } else {
+    sensorFiltered += (level - sensorFiltered) >> SENSOR_FILTER_SHIFT;
+  }
+  return true;
+}
+
+// How far the filtered light level is from the baseline, either way
+light_level_t lightLevelDeviation() {
+  return abs(sensorFiltered - sensorBaseline) >> SENSOR_FILTER_FRACTION_BITS;
+}
+
+// Deep sleep until the ULP sees the light level change. The current level is used as the
+// baseline, so we don't trigger immediately. This only returns if the ULP program can't be loaded,
+// in which case the caller has to poll the LDR instead, as waking up from deep sleep restarts the
+// program.
+void deepSleepUntilLightChanges() {
+  static bool ulpFailed = false;
+  if (ulpFailed) {
+    return;
+  }
+  readLightSensorWindow();
+  uint16_t baseline = sensorRaw;
+
+  // Hand ADC1 over from the I2S peripheral to the ULP
+  releaseAdcSampler();
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten(LDR_ADC_CHANNEL, ADC_ATTEN_DB_11);
+  adc1_ulp_enable();
+
+  size_t programSize = sizeof(ldrWatcherProgram) / sizeof(ulp_insn_t);
+  if (ulp_process_macros_and_load(0, ldrWatcherProgram, &programSize) != ESP_OK || programSize > ULP_DATA_OFFSET) {
+    Serial.println("Could not load ULP program, polling the LDR instead");
+    ulpFailed = true;
+    setupAdcSampler();
+    return;
+  }
+  RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_BASELINE] = baseline;
+  RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_SAMPLE] = baseline;
+  RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_SAMPLE_COUNT] = 0;
+
+  ulp_set_wakeup_period(0, SENSOR_ULP_SAMPLE_PERIOD_MILLIS * 1000);
+  ulp_run(0);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER); // Left enabled by light sleeps
+  esp_sleep_enable_ulp_wakeup();
+
+  prepareEnergyForDeepSleep();
+  Serial.printf("Deep sleeping until the light level changes from %d\n", baseline);
+  Serial.flush();
+  esp_deep_sleep_start();
+}
+
+// True if we have just been woken from deep sleep by the ULP seeing the light level change
+bool wasWokenByLightChange() {
+  return getBootWakeupCause() == ESP_SLEEP_WAKEUP_ULP;
+}
+
+// What the ULP saw when it woke us up. The ULP writes the program counter into the top half of
+// each word it stores, so only the bottom half is the value.
+LightChangeWake getLightChangeWake() {
+  LightChangeWake wake;
+  wake.baseline = RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_BASELINE] & 0xFFFF;
+  wake.sample = RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_SAMPLE] & 0xFFFF;
+  wake.sampleCount = RTC_SLOW_MEM[ULP_DATA_OFFSET + ULP_SAMPLE_COUNT] & 0xFFFF;
+  return wake;
+}
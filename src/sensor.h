@@ -0,0 +1,43 @@
+// Big Mouth Phatt Bass light sensor handling
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// In sensor mode the fish is triggered by a change in the light level on the LDR. While awake, the
+// LDR is oversampled by DMA (see adcsampler.h) and averaged over a whole number of mains cycles to remove flicker,
+// then filtered in fixed point and compared against a slowly adapting baseline, with hysteresis so
+// a level hovering around the threshold doesn't trigger repeatedly. Between
+// performances the main cores can deep sleep while the ULP coprocessor watches the LDR: it keeps a
+// slowly adapting baseline in RTC memory and wakes the chip when a sample strays from it by more
+// than SENSOR_TRIGGER_THRESHOLD. Waking from deep sleep restarts the program from setup().
+
+#pragma once
+
+#include <Arduino.h>
+
+// Normalised light level, from 0 (dark) to LIGHT_LEVEL_MAX (bright)
+typedef uint16_t light_level_t;
+#define LIGHT_LEVEL_MAX 65535
+
+// Light sensor counters since startup
+struct LightSensorStats {
+  uint32_t samples;  // ADC samples read
+  uint32_t windows;  // Averaged readings made from them
+  uint32_t triggers; // Changes in light level reported
+  uint32_t rejected; // Readings past the threshold that the next reading didn't confirm, i.e. would-be false triggers
+  int64_t busyUs;    // Time spent reading, so samples / busyUs is the throughput
+};
+
+// What the ULP saw when it last woke us up, for reporting trigger latency
+struct LightChangeWake {
+  uint16_t baseline;    // Raw ADC reading the ULP was comparing against
+  uint16_t sample;      // Raw ADC reading that crossed the threshold
+  uint16_t sampleCount; // Samples taken before the change, so time asleep is this * SENSOR_ULP_SAMPLE_PERIOD_MILLIS
+};
+
+bool updateLightSensor();
+void resetLightSensorBaseline();
+light_level_t getLightLevel();
+light_level_t getLightLevelBaseline();
+LightSensorStats getLightSensorStats();
+void deepSleepUntilLightChanges();
+bool wasWokenByLightChange();
+LightChangeWake getLightChangeWake();
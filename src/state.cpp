@@ -0,0 +1,44 @@
+// Big Mouth Phatt Bass persisted state
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+#include "state.h"
+
+// Copy of the state in RTC memory. Cleared by any reset other than waking from deep sleep.
+RTC_DATA_ATTR FishState rtcFishState;
+RTC_DATA_ATTR bool rtcFishStateValid = false;
+
+// Load the state, from RTC memory if it's there, otherwise from NVS, falling back to track 1 in
+// normal mode. The track number may no longer exist, if the track list has changed.
+FishState loadFishState() {
+  if (rtcFishStateValid) {
+    return rtcFishState;
+  }
+  FishState state = { 1, false };
+  Preferences preferences;
+  if (preferences.begin(STATE_NVS_NAMESPACE, true)) {
+    state.trackNumber = preferences.getUShort("track", state.trackNumber);
+    state.sensorMode = preferences.getUShort("sensorMode", state.sensorMode) != 0;
+    preferences.end();
+  }
+  rtcFishState = state;
+  rtcFishStateValid = true;
+  return state;
+}
+
+// Save the state, if it has changed
+void saveFishState(const FishState &state) {
+  FishState saved = loadFishState();
+  if (saved.trackNumber == state.trackNumber && saved.sensorMode == state.sensorMode) {
+    return;
+  }
+  Preferences preferences;
+  if (preferences.begin(STATE_NVS_NAMESPACE, false)) {
+    preferences.putUShort("track", state.trackNumber);
+    preferences.putUShort("sensorMode", state.sensorMode);
+    preferences.end();
+  }
+  rtcFishState = state;
+}
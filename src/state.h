@@ -0,0 +1,18 @@
+// Big Mouth Phatt Bass persisted state
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// The selected track and whether we're in sensor mode are kept in NVS, so the fish comes back the
+// way it was left after a power cycle. A copy is kept in RTC memory, which survives deep sleep, so
+// waking up doesn't have to read the flash. NVS is only written when something has changed.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct FishState {
+  int trackNumber;
+  bool sensorMode;
+};
+
+FishState loadFishState();
+void saveFishState(const FishState &state);
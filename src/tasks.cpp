@@ -0,0 +1,202 @@
+// Big Mouth Phatt Bass FreeRTOS tasks
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include "button.h"
+#include "config.h"
+#include "console.h"
+#include "leadtime.h"
+#include "motors.h"
+#include "mp3player.h"
+#include "tasks.h"
+#include "timing.h"
+
+void trigger(int trackNumber);
+void checkInputs();
+void motionTask(void *arg);
+void commsTask(void *arg);
+void inputTask(void *arg);
+bool queueMotionRequest(const MotionRequest &request);
+void finishPerformance();
+
+TaskHandle_t motionTaskHandle = nullptr;
+TaskHandle_t commsTaskHandle = nullptr;
+TaskHandle_t inputTaskHandle = nullptr;
+int64_t taskStatsFromUs[3];   // Start of the period each task's CPU use is reported over
+int64_t taskStatsWaitedUs[3]; // Its total waiting time at that point, see getTaskWaitedUs()
+QueueHandle_t performanceQueue;
+SemaphoreHandle_t commsReady;
+volatile int performancesPending = 0; // Requested and not yet finished, including calibrations
+portMUX_TYPE performancesPendingMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Start the comms task, which sets up serial comms to the MP3 player then handles its feedback.
+// Serial2 is set up from the comms task so that its interrupts are serviced on the comms core,
+// not the motion one. Returns once the MP3 player is ready for commands.
+void startCommsTask() {
+  commsReady = xSemaphoreCreateBinary();
+  taskStatsFromUs[1] = timeNowUs();
+  xTaskCreatePinnedToCore(commsTask, "comms", COMMS_TASK_STACK_SIZE, nullptr, COMMS_TASK_PRIORITY,
+      &commsTaskHandle, COMMS_TASK_CORE);
+  xSemaphoreTake(commsReady, portMAX_DELAY);
+}
+
+// Start the motion and input tasks, after which the fish is ready to perform. If a track number is
+// given, a performance of it is requested before the input task starts, so the input task never
+// sees the fish idle and decides to sleep.
+void startMotionAndInputTasks(int firstTracknum) {
+  performanceQueue = xQueueCreate(2, sizeof(MotionRequest));
+  if (firstTracknum > 0) {
+    requestPerformance(firstTracknum);
+  }
+  taskStatsFromUs[0] = taskStatsFromUs[2] = timeNowUs();
+  xTaskCreatePinnedToCore(motionTask, "motion", MOTION_TASK_STACK_SIZE, nullptr, MOTION_TASK_PRIORITY,
+      &motionTaskHandle, MOTION_TASK_CORE);
+  xTaskCreatePinnedToCore(inputTask, "input", INPUT_TASK_STACK_SIZE, nullptr, INPUT_TASK_PRIORITY,
+      &inputTaskHandle, INPUT_TASK_CORE);
+}
+
+// Ask the motion task to perform a track. Returns false if it is already performing. Light sleep
+// is inhibited from now until the performance is over, so the requesting task can't put the chip
+// to sleep before the motion task has started.
+bool requestPerformance(int tracknum) {
+  return requestMotion({ MOTION_PERFORM, tracknum });
+}
+
+// Ask the motion task to calibrate the lead time of a motor action (see leadtime.h), in place of a
+// performance. Returns false if it is already performing.
+bool requestCalibration(uint8_t action) {
+  return requestMotion({ MOTION_CALIBRATE, action });
+}
+
+// Ask the motion task to run the motor current test (see runMotorTest()), in place of a
+// performance. Returns false if it is already performing.
+bool requestMotorTest() {
+  return requestMotion({ MOTION_MOTOR_TEST, 0 });
+}
+
+// Ask the motion task to do something, if it is idle
+bool requestMotion(const MotionRequest &request) {
+  portENTER_CRITICAL(&performancesPendingMux);
+  bool idle = performancesPending == 0;
+  if (idle) {
+    performancesPending++;
+  }
+  portEXIT_CRITICAL(&performancesPendingMux);
+  if (!idle) {
+    return false;
+  }
+  return queueMotionRequest(request);
+}
+
+// Stop the current performance, if there is one. requestedAtUs is when the reason for stopping
+// happened, e.g. the button press, for measuring the response time.
+void cancelPerformance(int64_t requestedAtUs) {
+  if (isPerforming()) {
+    requestCancel(requestedAtUs);
+  }
+}
+
+// Stop the current performance and go straight on to perform another track
+void skipToPerformance(int tracknum, int64_t requestedAtUs) {
+  cancelPerformance(requestedAtUs);
+  portENTER_CRITICAL(&performancesPendingMux);
+  performancesPending++;
+  portEXIT_CRITICAL(&performancesPendingMux);
+  queueMotionRequest({ MOTION_PERFORM, tracknum });
+}
+
+// Send a request to the motion task, which has already been counted as pending
+bool queueMotionRequest(const MotionRequest &request) {
+  inhibitLightSleep();
+  if (xQueueSend(performanceQueue, &request, 0) != pdTRUE) {
+    finishPerformance();
+    return false;
+  }
+  return true;
+}
+
+// Count a pending performance as finished
+void finishPerformance() {
+  portENTER_CRITICAL(&performancesPendingMux);
+  performancesPending--;
+  portEXIT_CRITICAL(&performancesPendingMux);
+  releaseLightSleep();
+}
+
+// True if a performance has been requested and not yet finished
+bool isPerforming() {
+  return performancesPending > 0;
+}
+
+// Motion task. Waits for performance requests and runs them.
+void motionTask(void *arg) {
+  MotionRequest request;
+  while (true) {
+    startTaskWait();
+    BaseType_t received = xQueueReceive(performanceQueue, &request, portMAX_DELAY);
+    endTaskWait();
+    if (received == pdTRUE) {
+      switch (request.type) {
+        case MOTION_PERFORM:
+          trigger(request.arg);
+          reportTaskStats();
+          break;
+        case MOTION_CALIBRATE:
+          calibrateLeadTime(request.arg);
+          break;
+        case MOTION_MOTOR_TEST:
+          clearCancel();
+          runMotorTest();
+          break;
+      }
+      finishPerformance();
+    }
+  }
+}
+
+// Comms task. Sets up the MP3 player, then keeps up with feedback from it, and with commands
+// over USB serial.
+void commsTask(void *arg) {
+  setupMP3Player();
+  xSemaphoreGive(commsReady);
+  while (true) {
+    pollMP3Player();
+    pollConsole();
+    startTaskWait();
+    vTaskDelay(pdMS_TO_TICKS(COMMS_TASK_POLL_MILLIS));
+    endTaskWait();
+  }
+}
+
+// Input task. Watches the button or sensor for the signal to perform. The button interrupt is set
+// up from here so that it is serviced on this core.
+void inputTask(void *arg) {
+  setupButton();
+  while (true) {
+    checkInputs();
+  }
+}
+
+// Report stack and CPU use of each task over serial. Stack is the least free there has ever been.
+// CPU use is the share of one core since the last report, or since the task started, that the
+// task spent outside its waits (see startTaskWait()). Time it was ready to run but preempted by
+// another task counts as use, so on the shared core it's an upper bound.
+void reportTaskStats() {
+  TaskHandle_t handles[] = { motionTaskHandle, commsTaskHandle, inputTaskHandle };
+  int64_t nowUs = timeNowUs();
+  for (int i = 0; i < 3; i++) {
+    if (handles[i] == nullptr) {
+      continue;
+    }
+    Serial.printf("Task %s: priority %u, stack free %u bytes", pcTaskGetName(handles[i]),
+        (unsigned) uxTaskPriorityGet(handles[i]), (unsigned) uxTaskGetStackHighWaterMark(handles[i]));
+    int64_t waitedUs = getTaskWaitedUs(handles[i]);
+    int64_t elapsedUs = nowUs - taskStatsFromUs[i];
+    if (elapsedUs > 0) {
+      Serial.printf(", CPU %.1f%%", 100.0 * (elapsedUs - (waitedUs - taskStatsWaitedUs[i])) / elapsedUs);
+    }
+    taskStatsFromUs[i] = nowUs;
+    taskStatsWaitedUs[i] = waitedUs;
+    Serial.println();
+  }
+}
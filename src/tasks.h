@@ -0,0 +1,34 @@
+// Big Mouth Phatt Bass FreeRTOS tasks
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// The firmware runs as three tasks. Motion runs performances, pinned on its own core at high
+// priority so motor timing isn't disturbed by anything else. Comms handles feedback from the MP3
+// player, and Input watches the button and sensor; both share the other core. Input asks Motion
+// to start a performance through a queue, and can cancel the running one.
+
+#pragma once
+
+#include <Arduino.h>
+
+// What the motion task can be asked to do
+enum MotionRequestType : uint8_t {
+  MOTION_PERFORM,   // Perform track number arg
+  MOTION_CALIBRATE, // Calibrate the lead time of choreography action arg
+  MOTION_MOTOR_TEST // Run the motor current test
+};
+
+struct MotionRequest {
+  MotionRequestType type;
+  int arg;
+};
+
+void startCommsTask();
+void startMotionAndInputTasks(int firstTracknum = 0);
+bool requestPerformance(int tracknum);
+bool requestCalibration(uint8_t action);
+bool requestMotorTest();
+bool requestMotion(const MotionRequest &request);
+void cancelPerformance(int64_t requestedAtUs);
+void skipToPerformance(int tracknum, int64_t requestedAtUs);
+bool isPerforming();
+void reportTaskStats();
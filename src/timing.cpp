@@ -0,0 +1,309 @@
+// Big Mouth Phatt Bass timing functions
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "energy.h"
+#include "timing.h"
+#include "trace.h"
+
+void waitUntil(int64_t deadlineUs, bool cancellable);
+void waitAwake(int64_t deadlineUs, bool cancellable);
+void calibrateLightSleep();
+void recordWait(WaitMethod method, int64_t us);
+
+// Time a task has spent waiting, see startTaskWait()
+struct TaskWaitTime {
+  TaskHandle_t task;
+  int64_t waitedUs;
+  int64_t waitingSinceUs; // Start of the wait under way, or -1 if it isn't waiting
+};
+
+WakeStats wakeStats;
+SleepStats sleepStats;
+esp_sleep_wakeup_cause_t bootWakeupCause;
+int32_t lightSleepOverheadUs = 0;
+uint32_t cpuMhz;
+volatile int lightSleepInhibitCount = 0;
+portMUX_TYPE lightSleepInhibitMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool cancelRequested = false;
+volatile int64_t cancelRequestedUs = 0;
+SemaphoreHandle_t cancelSemaphore; // Given to wake a cancellable wait early
+TaskWaitTime taskWaitTimes[TASK_WAIT_SLOTS];
+portMUX_TYPE taskWaitTimesMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Set up the timing functions
+void setupTiming() {
+  cancelSemaphore = xSemaphoreCreateBinary();
+  bootWakeupCause = esp_sleep_get_wakeup_cause();
+  cpuMhz = getCpuFrequencyMhz();
+  calibrateLightSleep();
+}
+
+// Measure how much longer than asked a light sleep takes, entering it and waking up, including
+// refilling the flash cache. Takes the worst of a few short sleeps, so waits rarely overshoot.
+void calibrateLightSleep() {
+  int32_t worstUs = 0;
+  for (int i = 0; i < TIMING_CALIBRATION_SLEEPS; i++) {
+    esp_sleep_enable_timer_wakeup(TIMING_CALIBRATION_SLEEP_US);
+    int64_t startUs = timeNowUs();
+    esp_light_sleep_start();
+    worstUs = max(worstUs, (int32_t) (timeNowUs() - startUs - TIMING_CALIBRATION_SLEEP_US));
+  }
+  lightSleepOverheadUs = worstUs;
+  sleepStats.lightSleepOverheadUs = worstUs;
+}
+
+// Replacement for "delay" that uses the ESP32 "light sleep" mode to save power, when it's worth it
+void lightSleep(int timeMs) {
+  waitUntil(timeNowUs() + timeMs * 1000LL, false);
+}
+
+// What woke us from deep sleep, or ESP_SLEEP_WAKEUP_UNDEFINED after a reset. Unlike
+// esp_sleep_get_wakeup_cause(), which any light sleep changes, this stays as it was at boot.
+esp_sleep_wakeup_cause_t getBootWakeupCause() {
+  return bootWakeupCause;
+}
+
+// Microseconds since boot. Keeps counting through light sleep, so can be used for absolute deadlines.
+int64_t timeNowUs() {
+  return esp_timer_get_time();
+}
+
+// Light sleep until an absolute time (from timeNowUs()), rather than for a relative time. Chained
+// calls against a fixed epoch don't accumulate wake latency and code overhead the way chained
+// lightSleep() calls do, so the error stays bounded over a whole song. Returns how late we woke up
+// in micros, which is also recorded in the wake stats. Returns early if a cancel is requested.
+int32_t sleepUntil(int64_t deadlineUs) {
+  waitUntil(deadlineUs, true);
+  if (cancelRequested) {
+    return 0;
+  }
+
+  int32_t lateUs = timeNowUs() - deadlineUs;
+  TRACE(TRACE_LATE, 0, min(max(lateUs, (int32_t) 0), (int32_t) UINT16_MAX));
+  wakeStats.count++;
+  wakeStats.totalLateUs += lateUs;
+  wakeStats.lastLateUs = lateUs;
+  if (lateUs > wakeStats.maxLateUs) {
+    wakeStats.maxLateUs = lateUs;
+  }
+  return lateUs;
+}
+
+// Wait until an absolute time, like sleepUntil() but without recording wake stats. Returns false
+// if the wait was cut short by a cancel request.
+bool waitUntilOrCancelled(int64_t deadlineUs) {
+  waitUntil(deadlineUs, true);
+  return !cancelRequested;
+}
+
+// Wait until an absolute time, choosing how for the best timing and power. If nothing has inhibited
+// light sleep and the wait is long enough for its overhead to be a small part of it, we light sleep
+// until the overhead before the deadline, then wait out the rest awake. A light sleep woken by
+// anything other than its timer, like the button, ends the wait early. A cancellable wait returns as
+// soon as a cancel is requested. That only works while awake, but performances always inhibit light
+// sleep.
+void waitUntil(int64_t deadlineUs, bool cancellable) {
+  int64_t remainingUs = deadlineUs - timeNowUs();
+  if (remainingUs <= 0 || (cancellable && cancelRequested)) {
+    return;
+  }
+  if (lightSleepInhibitCount == 0) {
+    if (remainingUs >= max(lightSleepOverheadUs, (int32_t) 1) * TIMING_LIGHT_SLEEP_MIN_OVERHEADS) {
+      TRACE(TRACE_WAIT_START, TRACE_WAIT_LIGHT_SLEEP, min(remainingUs / 1000, (int64_t) UINT16_MAX));
+      esp_sleep_enable_timer_wakeup(remainingUs - lightSleepOverheadUs);
+      int64_t sleptAtUs = timeNowUs();
+      startTaskWait();
+      esp_light_sleep_start();
+      endTaskWait();
+      int64_t wokeAtUs = timeNowUs();
+      addEnergyTime(ENERGY_LIGHT_SLEEP, wokeAtUs - sleptAtUs);
+      recordWait(WAIT_LIGHT_SLEEP, wokeAtUs - sleptAtUs);
+      TRACE(TRACE_WAIT_END, TRACE_WAIT_LIGHT_SLEEP, 0);
+      if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+        return;
+      }
+      if (wokeAtUs > deadlineUs) {
+        sleepStats.lightSleepOvershoots++;
+      }
+    } else {
+      sleepStats.lightSleepsSkipped++;
+    }
+  }
+  waitAwake(deadlineUs, cancellable);
+}
+
+// Wait awake until an absolute time: a task delay for whole ticks, which leaves the CPU to other
+// tasks or idle, stopping TIMING_SPIN_MARGIN_US short in case the scheduler wakes us late, then
+// spinning on the CPU cycle counter for the rest. The cycle counter is much quicker to read than
+// the microsecond timer, so the spin ends closer to the deadline. It is per core, but our tasks are
+// pinned to theirs.
+void waitAwake(int64_t deadlineUs, bool cancellable) {
+  int64_t nowUs = timeNowUs();
+  TickType_t ticks = max(deadlineUs - nowUs - TIMING_SPIN_MARGIN_US, (int64_t) 0) / (portTICK_PERIOD_MS * 1000);
+  if (ticks > 0) {
+    TRACE(TRACE_WAIT_START, TRACE_WAIT_TASK_DELAY, min(ticks * portTICK_PERIOD_MS, (TickType_t) UINT16_MAX));
+    startTaskWait();
+    if (cancellable) {
+      xSemaphoreTake(cancelSemaphore, ticks);
+    } else {
+      vTaskDelay(ticks);
+    }
+    endTaskWait();
+    int64_t delayedFromUs = nowUs;
+    nowUs = timeNowUs();
+    recordWait(WAIT_TASK_DELAY, nowUs - delayedFromUs);
+    TRACE(TRACE_WAIT_END, TRACE_WAIT_TASK_DELAY, 0);
+  }
+
+  int64_t spinUs = deadlineUs - nowUs;
+  if (spinUs > 0 && !(cancellable && cancelRequested)) {
+    TRACE(TRACE_WAIT_START, TRACE_WAIT_SPIN, 0);
+    uint32_t startCycles = ESP.getCycleCount();
+    uint32_t cycles = spinUs * cpuMhz;
+    while (ESP.getCycleCount() - startCycles < cycles && !(cancellable && cancelRequested));
+    recordWait(WAIT_SPIN, spinUs);
+    TRACE(TRACE_WAIT_END, TRACE_WAIT_SPIN, 0);
+  }
+}
+
+// Add a wait to the sleep stats
+void recordWait(WaitMethod method, int64_t us) {
+  sleepStats.count[method]++;
+  sleepStats.totalUs[method] += us;
+}
+
+// Mark the start of a wait that leaves the CPU to other tasks, like a task delay, a blocking queue
+// receive or a light sleep, so the calling task's CPU share can be worked out from the time it
+// spends outside them. Spinning doesn't count, as it keeps the CPU busy. Call endTaskWait() after.
+// Only the first TASK_WAIT_SLOTS tasks to wait are timed, and waits outside a task are ignored.
+void startTaskWait() {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  if (task == nullptr) {
+    return;
+  }
+  int64_t nowUs = timeNowUs();
+  portENTER_CRITICAL(&taskWaitTimesMux);
+  for (TaskWaitTime &waitTime : taskWaitTimes) {
+    if (waitTime.task == nullptr) {
+      waitTime.task = task;
+    }
+    if (waitTime.task == task) {
+      waitTime.waitingSinceUs = nowUs;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&taskWaitTimesMux);
+}
+
+// Mark the end of a wait, see startTaskWait()
+void endTaskWait() {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  int64_t nowUs = timeNowUs();
+  portENTER_CRITICAL(&taskWaitTimesMux);
+  for (TaskWaitTime &waitTime : taskWaitTimes) {
+    if (waitTime.task == task && waitTime.waitingSinceUs >= 0) {
+      waitTime.waitedUs += nowUs - waitTime.waitingSinceUs;
+      waitTime.waitingSinceUs = -1;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&taskWaitTimesMux);
+}
+
+// Total time a task has spent waiting since boot, including any wait it is in now, see
+// startTaskWait(). Returns 0 if it has never waited.
+int64_t getTaskWaitedUs(TaskHandle_t task) {
+  int64_t nowUs = timeNowUs();
+  int64_t waitedUs = 0;
+  portENTER_CRITICAL(&taskWaitTimesMux);
+  for (const TaskWaitTime &waitTime : taskWaitTimes) {
+    if (waitTime.task == task) {
+      waitedUs = waitTime.waitedUs + (waitTime.waitingSinceUs >= 0 ? nowUs - waitTime.waitingSinceUs : 0);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&taskWaitTimesMux);
+  return waitedUs;
+}
+
+// Cancel any cancellable waits, now and until clearCancel() is called. Used to stop a performance.
+// requestedAtUs is when the reason for cancelling happened, e.g. the button press, so the response
+// time can be measured.
+void requestCancel(int64_t requestedAtUs) {
+  cancelRequestedUs = requestedAtUs;
+  cancelRequested = true;
+  xSemaphoreGive(cancelSemaphore);
+}
+
+// True if a cancel has been requested and not yet cleared
+bool isCancelRequested() {
+  return cancelRequested;
+}
+
+// When the current cancel request was made, see requestCancel()
+int64_t getCancelRequestedUs() {
+  return cancelRequestedUs;
+}
+
+// Clear a cancel request, e.g. at the start of a new performance
+void clearCancel() {
+  cancelRequested = false;
+  xSemaphoreTake(cancelSemaphore, 0);
+}
+
+// Prevent light sleep until a matching releaseLightSleep(), for things like UART transmissions
+// that need the clocks kept running. Calls can be nested.
+void inhibitLightSleep() {
+  portENTER_CRITICAL(&lightSleepInhibitMux);
+  lightSleepInhibitCount++;
+  portEXIT_CRITICAL(&lightSleepInhibitMux);
+}
+
+// Allow light sleep again after inhibitLightSleep()
+void releaseLightSleep() {
+  portENTER_CRITICAL(&lightSleepInhibitMux);
+  lightSleepInhibitCount--;
+  portEXIT_CRITICAL(&lightSleepInhibitMux);
+}
+
+// True if something has inhibited light sleep
+bool isLightSleepInhibited() {
+  return lightSleepInhibitCount > 0;
+}
+
+// Clear the wake stats, e.g. at the start of a performance
+void resetWakeStats() {
+  wakeStats = WakeStats();
+}
+
+// Get the wake stats since they were last reset
+WakeStats getWakeStats() {
+  return wakeStats;
+}
+
+// Clear the sleep stats, keeping the measured light sleep overhead
+void resetSleepStats() {
+  sleepStats = SleepStats();
+  sleepStats.lightSleepOverheadUs = lightSleepOverheadUs;
+}
+
+// Get the sleep stats since startup or since they were last reset
+SleepStats getSleepStats() {
+  return sleepStats;
+}
+
+// Print the sleep stats over USB serial
+void reportSleepStats() {
+  const char *const names[WAIT_METHODS] = { "light sleep", "task delay", "spin" };
+  Serial.printf("Light sleep overhead %d us, used for waits of %d us or more\n", (int) sleepStats.lightSleepOverheadUs,
+      (int) (max(sleepStats.lightSleepOverheadUs, (int32_t) 1) * TIMING_LIGHT_SLEEP_MIN_OVERHEADS));
+  for (int i = 0; i < WAIT_METHODS; i++) {
+    Serial.printf("  %-12s %8u waits, %10.3f s\n", names[i], (unsigned) sleepStats.count[i], sleepStats.totalUs[i] / 1e6);
+  }
+  Serial.printf("  %u too short to light sleep for, %u light sleeps woke after the deadline\n",
+      (unsigned) sleepStats.lightSleepsSkipped, (unsigned) sleepStats.lightSleepOvershoots);
+}
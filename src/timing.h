@@ -0,0 +1,54 @@
+// Big Mouth Phatt Bass timing functions
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+
+// Statistics on how late sleepUntil() woke up compared to the deadlines it was given
+struct WakeStats {
+  uint32_t count;
+  int64_t totalLateUs;
+  int32_t maxLateUs;
+  int32_t lastLateUs;
+};
+
+// How waits were split between the ways of waiting, see waitUntil()
+enum WaitMethod : uint8_t {
+  WAIT_LIGHT_SLEEP,
+  WAIT_TASK_DELAY,
+  WAIT_SPIN,
+  WAIT_METHODS
+};
+
+// Statistics on the ways waitUntil() chose to wait
+struct SleepStats {
+  int32_t lightSleepOverheadUs;   // Light sleep entry and exit, measured at boot
+  uint32_t count[WAIT_METHODS];   // Waits that used each method, some using several
+  int64_t totalUs[WAIT_METHODS];  // Time spent in each
+  uint32_t lightSleepsSkipped;    // Waits too short to be worth light sleeping for, although allowed
+  uint32_t lightSleepOvershoots;  // Light sleeps that woke after the deadline, despite the overhead
+};
+
+void setupTiming();
+esp_sleep_wakeup_cause_t getBootWakeupCause();
+void lightSleep(int timeMs);
+int64_t timeNowUs();
+int32_t sleepUntil(int64_t deadlineUs);
+bool waitUntilOrCancelled(int64_t deadlineUs);
+void requestCancel(int64_t requestedAtUs);
+bool isCancelRequested();
+int64_t getCancelRequestedUs();
+void clearCancel();
+void inhibitLightSleep();
+void releaseLightSleep();
+bool isLightSleepInhibited();
+void resetWakeStats();
+WakeStats getWakeStats();
+void resetSleepStats();
+SleepStats getSleepStats();
+void reportSleepStats();
+void startTaskWait();
+void endTaskWait();
+int64_t getTaskWaitedUs(TaskHandle_t task);
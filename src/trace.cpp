@@ -0,0 +1,37 @@
+// Big Mouth Phatt Bass event trace
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include "config.h"
+#include "trace.h"
+
+TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+std::atomic<uint32_t> traceCount(0); // Events ever recorded, so the next slot to write
+volatile bool tracePaused = false;
+
+// Print the trace over USB serial, oldest event first, as CSV lines:
+//   TRACE_BEGIN,<events>,<overwritten>
+//   TRACE,<time us>,<core>,<type>,<arg8>,<arg16>
+//   TRACE_END
+// Recording is paused while dumping, so the buffer isn't overwritten as it is printed.
+void dumpTrace() {
+  if (!TRACE_ENABLED) {
+    Serial.println("TRACE_BEGIN,0,0");
+    Serial.println("TRACE_END");
+    return;
+  }
+  tracePaused = true;
+  vTaskDelay(1); // Let any recording already under way on the other core finish
+
+  uint32_t count = traceCount.load();
+  uint32_t first = count > TRACE_BUFFER_EVENTS ? count - TRACE_BUFFER_EVENTS : 0;
+  Serial.printf("TRACE_BEGIN,%u,%u\n", (unsigned) (count - first), (unsigned) first);
+  for (uint32_t i = first; i != count; i++) {
+    const TraceEvent &event = traceBuffer[i & (TRACE_BUFFER_EVENTS - 1)];
+    Serial.printf("TRACE,%u,%u,%u,%u,%u\n", (unsigned) event.timeUs, event.type >> 7, event.type & 0x7F,
+        event.arg8, event.arg16);
+  }
+  Serial.println("TRACE_END");
+
+  tracePaused = false;
+}
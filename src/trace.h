@@ -0,0 +1,67 @@
+// Big Mouth Phatt Bass event trace
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// A fixed-size ring buffer of timestamped events from the timing-critical code: motor movements,
+// MP3 player frames, and waits and sleeps. Any task on either core can record an event without
+// taking a lock, just claiming the next slot with an atomic increment, so recording is cheap
+// enough to leave in a performance. When the buffer is full the oldest events are overwritten.
+// The "trace" console command (see console.h) prints the buffer, for tools/trace2chrome.py to turn
+// into a timeline. With TRACE_ENABLED false, TRACE() compiles to nothing.
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "config.h"
+
+enum TraceEventType : uint8_t {
+  TRACE_MOTOR,          // arg8: the movement, as a choreography action (see choreography.h)
+  TRACE_MP3_QUEUED,     // arg8: command, arg16: data
+  TRACE_MP3_SENT,       // arg8: command, arg16: data
+  TRACE_MP3_RECEIVED,   // arg8: command, arg16: data
+  TRACE_WAIT_START,     // arg8: TraceWaitKind, arg16: planned length in millis, up to 65535
+  TRACE_WAIT_END,       // arg8: TraceWaitKind
+  TRACE_LATE,           // arg16: how late sleepUntil() woke, in micros, up to 65535
+  TRACE_PERFORMANCE_START, // arg16: track number
+  TRACE_PERFORMANCE_END,   // arg16: track number
+};
+
+enum TraceWaitKind : uint8_t {
+  TRACE_WAIT_TASK_DELAY,  // Awake, leaving the CPU to other tasks
+  TRACE_WAIT_LIGHT_SLEEP, // Light sleep until a deadline
+  TRACE_WAIT_BUTTON,      // Light sleep until the button is pushed
+  TRACE_WAIT_SPIN,        // Spinning on the CPU cycle counter for the end of a wait
+};
+
+// One recorded event. Times are the low 32 bits of timeNowUs(), so wrap every 71 minutes.
+struct TraceEvent {
+  uint32_t timeUs;
+  uint8_t type;  // TraceEventType, with the recording core in the top bit
+  uint8_t arg8;
+  uint16_t arg16;
+};
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "TRACE_BUFFER_EVENTS must be a power of two");
+
+extern TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+extern std::atomic<uint32_t> traceCount;
+extern volatile bool tracePaused;
+
+// Record an event. Safe from any task on either core.
+inline void recordTraceEvent(TraceEventType type, uint8_t arg8, uint16_t arg16) {
+  if (tracePaused) {
+    return;
+  }
+  uint32_t timeUs = esp_timer_get_time();
+  uint32_t slot = traceCount.fetch_add(1, std::memory_order_relaxed) & (TRACE_BUFFER_EVENTS - 1);
+  traceBuffer[slot] = { timeUs, (uint8_t) (type | (xPortGetCoreID() << 7)), arg8, arg16 };
+}
+
+#if TRACE_ENABLED
+#define TRACE(type, arg8, arg16) recordTraceEvent((type), (arg8), (arg16))
+#else
+#define TRACE(type, arg8, arg16) ((void) 0)
+#endif
+
+void dumpTrace();
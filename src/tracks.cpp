@@ -0,0 +1,166 @@
+// Big Mouth Phatt Bass track registry
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <new>
+#include "config.h"
+#include "tracks.h"
+
+int readTracks(File &file, Track *into);
+bool parseTrack(char *line, Track &track);
+
+// The songs in this repo: music in folder "01", announcements of their names in "02", and the
+// tempos declared by their choreography scripts. Keep the tempos in step with BUILTIN_TEMPOS in
+// tools/choreo.py.
+const Track builtinTracks[] = {
+  { MUSIC_FOLDER, 1, ANNOUNCER_FOLDER, 1, 1, MUSIC_VOLUME, 150 },
+  { MUSIC_FOLDER, 2, ANNOUNCER_FOLDER, 2, 2, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 3, ANNOUNCER_FOLDER, 3, 3, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 4, ANNOUNCER_FOLDER, 4, 4, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 5, ANNOUNCER_FOLDER, 5, 5, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 6, ANNOUNCER_FOLDER, 6, 6, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 7, ANNOUNCER_FOLDER, 7, 7, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 8, ANNOUNCER_FOLDER, 8, 8, MUSIC_VOLUME, 86 },
+  { MUSIC_FOLDER, 9, ANNOUNCER_FOLDER, 9, 9, MUSIC_VOLUME, 0 },
+  { MUSIC_FOLDER, 10, ANNOUNCER_FOLDER, 10, 10, MUSIC_VOLUME, 0 },
+};
+
+const Track *tracks = builtinTracks;
+int trackCount = sizeof(builtinTracks) / sizeof(builtinTracks[0]);
+
+// Load the track registry from LittleFS if there is one, otherwise use the built-in table. A file
+// with a mistake in it is ignored as a whole, rather than leaving some tracks out. The file is read
+// twice, first to check it and count the tracks, then into a table of just the right size, so
+// there's no RAM set aside for it when there isn't one. Call after setupChoreography(), which
+// mounts LittleFS.
+void setupTracks() {
+  File file = LittleFS.open(TRACK_REGISTRY_PATH, "r");
+  if (!file) {
+    return;
+  }
+  Track *loadedTracks = nullptr;
+  int count = readTracks(file, nullptr);
+  if (count > 0) {
+    loadedTracks = new (std::nothrow) Track[count];
+    if (loadedTracks == nullptr) {
+      Serial.printf("%s: not enough RAM for %d tracks\n", TRACK_REGISTRY_PATH, count);
+    } else if (!file.seek(0) || readTracks(file, loadedTracks) != count) {
+      delete[] loadedTracks;
+      loadedTracks = nullptr;
+    }
+  }
+  file.close();
+
+  if (loadedTracks != nullptr) {
+    tracks = loadedTracks;
+    trackCount = count;
+  } else {
+    Serial.println("Using the built-in track list");
+  }
+}
+
+// Read the tracks from the registry file, into a table if one is given. Returns how many there
+// are, or -1 if there's a mistake in the file, which is reported over USB serial.
+int readTracks(File &file, Track *into) {
+  char line[TRACK_REGISTRY_LINE_LENGTH];
+  int lineLength = 0;
+  int lineNumber = 0;
+  int count = 0;
+  while (true) {
+    int c = file.read();
+    if (c >= 0 && c != '\n') {
+      if (lineLength == TRACK_REGISTRY_LINE_LENGTH - 1) {
+        Serial.printf("%s:%d: longer than %d characters\n", TRACK_REGISTRY_PATH, lineNumber + 1,
+            TRACK_REGISTRY_LINE_LENGTH - 1);
+        return -1;
+      }
+      line[lineLength++] = c;
+      continue;
+    }
+    line[lineLength] = '\0';
+    lineLength = 0;
+    lineNumber++;
+    char *comment = strchr(line, '#');
+    if (comment != nullptr) {
+      *comment = '\0';
+    }
+    if (strspn(line, " \t\r") < strlen(line)) {
+      if (count == TRACK_REGISTRY_MAX_TRACKS) {
+        Serial.printf("%s: more than %d tracks\n", TRACK_REGISTRY_PATH, TRACK_REGISTRY_MAX_TRACKS);
+        return -1;
+      }
+      Track track;
+      if (!parseTrack(line, track)) {
+        Serial.printf("%s:%d: expected folder, file, announcer folder, announcer file, choreography, volume, tempo\n",
+            TRACK_REGISTRY_PATH, lineNumber);
+        return -1;
+      }
+      if (into != nullptr) {
+        into[count] = track;
+      }
+      count++;
+    }
+    if (c < 0) {
+      return count;
+    }
+  }
+}
+
+// Parse one line of the registry file into a track. Returns false if it isn't valid.
+bool parseTrack(char *line, Track &track) {
+  long fields[7];
+  char *pos = line;
+  for (int i = 0; i < 7; i++) {
+    char *end;
+    fields[i] = strtol(pos, &end, 10);
+    if (end == pos) {
+      return false;
+    }
+    pos = end + strspn(end, " \t\r");
+    if (i < 6 && *pos++ != ',') {
+      return false;
+    }
+  }
+  if (*pos != '\0' || fields[0] < 1 || fields[0] > 99 || fields[1] < 1 || fields[1] > 255
+      || fields[2] < 0 || fields[2] > 99 || fields[3] < 0 || fields[3] > 255
+      || fields[4] < 0 || fields[4] > UINT16_MAX || fields[5] < 0 || fields[5] > 30
+      || fields[6] < 0 || fields[6] > UINT16_MAX) {
+    return false;
+  }
+  track = { (uint8_t) fields[0], (uint8_t) fields[1], (uint8_t) fields[2], (uint8_t) fields[3],
+      (uint16_t) fields[4], (uint8_t) fields[5], (uint16_t) fields[6] };
+  return true;
+}
+
+// Number of tracks, which are numbered from 1
+int getTrackCount() {
+  return trackCount;
+}
+
+// Look up a track by number. Returns nullptr if there is no such track.
+const Track *getTrack(int tracknum) {
+  if (tracknum < 1 || tracknum > trackCount) {
+    return nullptr;
+  }
+  return &tracks[tracknum - 1];
+}
+
+// The number of the track that plays a music file, or 0 if none does
+int findTrackByFile(int folder, int file) {
+  for (int i = 0; i < trackCount; i++) {
+    if (tracks[i].folder == folder && tracks[i].file == file) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Print the track list over USB serial
+void reportTracks() {
+  for (int i = 0; i < trackCount; i++) {
+    Serial.printf("Track %d: %02u/%03u.mp3, announcer %02u/%03u.mp3, choreography %u, volume %u, tempo %u bpm\n",
+        i + 1, tracks[i].folder, tracks[i].file, tracks[i].announcerFolder, tracks[i].announcerFile,
+        tracks[i].choreography, tracks[i].volume, tracks[i].tempoBpm);
+  }
+}
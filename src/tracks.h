@@ -0,0 +1,41 @@
+// Big Mouth Phatt Bass track registry
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Every track the fish can perform, numbered from 1 in the order the button cycles through them.
+// Each entry gives the MP3 file to play, using the full folder and file addressing of the MP3
+// player's play command (folders 1-99, files 1-255 in each), the announcer clip that names it,
+// its choreography, its volume and its tempo. Looking a track up is just indexing the table.
+//
+// The built-in table in tracks.cpp covers the songs in this repo. To serve a different set of
+// tracks without changing the code, put a TRACK_REGISTRY_PATH file on the LittleFS partition with
+// one line per track, which replaces the built-in table:
+//
+//   # folder, file, announcer folder, announcer file, choreography, volume, tempo
+//   1, 1, 2, 1, 1, 20, 150
+//   3, 17, 2, 11, 0, 25, 0
+//
+// An announcer file of 0 means the track isn't announced, and a choreography of 0 means it is
+// always lip-synced live. The tempo is in beats per minute, or 0 if unknown. The firmware only
+// reports it: tools/choreo.py reads the same file, and uses the tempo for beat-locked bops in a
+// choreography script that doesn't set its own, with the beat starting at the start of the track.
+// Lines can be up to TRACK_REGISTRY_LINE_LENGTH - 1 characters long.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct Track {
+  uint8_t folder;          // Music folder on the SD card, e.g. 1 for "01"
+  uint8_t file;            // Music file in the folder, e.g. 1 for "001.mp3"
+  uint8_t announcerFolder;
+  uint8_t announcerFile;   // 0 if not announced
+  uint16_t choreography;   // Choreography number, see CHOREOGRAPHY_PATH_FORMAT. 0 for live lipsync.
+  uint8_t volume;          // Up to 30
+  uint16_t tempoBpm;       // 0 if unknown
+};
+
+void setupTracks();
+int getTrackCount();
+const Track *getTrack(int tracknum);
+int findTrackByFile(int folder, int file);
+void reportTracks();
@@ -0,0 +1,295 @@
+// Big Mouth Phatt Bass choreography upload
+// by Ian Renton, 2024. CC Zero / Public Domain
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "choreography.h"
+#include "tasks.h"
+#include "timing.h"
+#include "tracks.h"
+#include "upload.h"
+
+// A choreography held in RAM, double buffered, see upload.h
+struct UploadSlot {
+  int number;   // Choreography number, or 0 if the slot is free
+  int active;   // Buffer that performances read, if the slot isn't free
+  bool committed;
+  uint8_t buffers[2][UPLOAD_SLOT_BYTES];
+  size_t sizes[2];
+  uint32_t crcs[2];
+  int readers[2]; // Performances reading each buffer
+};
+
+UploadSlot *findUploadSlot(int number);
+void finishUpload();
+void endUpload();
+bool isValidChoreography(const uint8_t *data, size_t size);
+uint32_t updateCrc32(uint32_t crc, uint8_t b);
+
+UploadSlot uploadSlots[UPLOAD_SLOTS];
+portMUX_TYPE uploadMux = portMUX_INITIALIZER_UNLOCKED;
+
+// The upload being received, if any
+UploadSlot *receivingSlot = nullptr;
+int receivingNumber;
+int receivingBuffer;
+size_t receivingSize;
+size_t receivedSize;
+uint32_t expectedCrc;
+uint32_t receivedCrc;
+int64_t lastReceivedUs;
+
+// Start receiving an upload of a choreography, which then arrives through pollUpload(). Replies
+// UPLOAD_READY, or UPLOAD_ERROR and returns false if it can't be taken.
+bool startUpload(int number, size_t size, uint32_t crc) {
+  if (receivingSlot != nullptr) {
+    Serial.println("UPLOAD_ERROR already uploading");
+    return false;
+  }
+  if (number < 1 || number > UINT16_MAX) {
+    Serial.printf("UPLOAD_ERROR no such choreography number %d\n", number);
+    return false;
+  }
+  if (size < CHOREOGRAPHY_HEADER_SIZE || size > UPLOAD_SLOT_BYTES) {
+    Serial.printf("UPLOAD_ERROR %u bytes, must be %d to %d\n", (unsigned) size, CHOREOGRAPHY_HEADER_SIZE, UPLOAD_SLOT_BYTES);
+    return false;
+  }
+  UploadSlot *slot = findUploadSlot(number);
+  if (slot == nullptr) {
+    Serial.printf("UPLOAD_ERROR all %d slots in use, free one with slot clear\n", UPLOAD_SLOTS);
+    return false;
+  }
+
+  // Receive into the buffer that performances aren't reading. A free slot may still have a
+  // performance reading what it held before it was cleared.
+  portENTER_CRITICAL(&uploadMux);
+  int buffer = slot->number == number ? 1 - slot->active : (slot->readers[0] == 0 ? 0 : 1);
+  bool busy = slot->readers[buffer] > 0;
+  portEXIT_CRITICAL(&uploadMux);
+  if (busy) {
+    Serial.println("UPLOAD_ERROR slot busy, try again after the performance");
+    return false;
+  }
+
+  receivingSlot = slot;
+  receivingNumber = number;
+  receivingBuffer = buffer;
+  receivingSize = size;
+  receivedSize = 0;
+  expectedCrc = crc;
+  receivedCrc = 0xFFFFFFFF;
+  lastReceivedUs = timeNowUs();
+  // The UART stops in light sleep, so stay awake until the upload is over
+  inhibitLightSleep();
+  Serial.println("UPLOAD_READY");
+  return true;
+}
+
+// Take whatever has arrived of an upload over USB serial. Returns true if an upload is being
+// received, so the console leaves the serial data alone. Called regularly by the comms task.
+bool pollUpload() {
+  if (receivingSlot == nullptr) {
+    return false;
+  }
+  int64_t nowUs = timeNowUs();
+  uint8_t *buffer = receivingSlot->buffers[receivingBuffer];
+  while (receivedSize < receivingSize && Serial.available() > 0) {
+    uint8_t b = Serial.read();
+    buffer[receivedSize++] = b;
+    receivedCrc = updateCrc32(receivedCrc, b);
+    lastReceivedUs = nowUs;
+  }
+  if (receivedSize == receivingSize) {
+    finishUpload();
+  } else if (nowUs - lastReceivedUs > UPLOAD_TIMEOUT_MILLIS * 1000LL) {
+    Serial.printf("UPLOAD_ERROR timed out after %u of %u bytes\n", (unsigned) receivedSize, (unsigned) receivingSize);
+    endUpload();
+  }
+  return true;
+}
+
+// Check a completely received upload, and if it's good, swap it in for performances to use
+void finishUpload() {
+  UploadSlot *slot = receivingSlot;
+  uint8_t *data = slot->buffers[receivingBuffer];
+  uint32_t crc = ~receivedCrc;
+  if (crc != expectedCrc) {
+    Serial.printf("UPLOAD_ERROR CRC %08x, expected %08x\n", (unsigned) crc, (unsigned) expectedCrc);
+  } else if (!isValidChoreography(data, receivingSize)) {
+    Serial.println("UPLOAD_ERROR not a choreography this firmware can play");
+  } else {
+    portENTER_CRITICAL(&uploadMux);
+    slot->sizes[receivingBuffer] = receivingSize;
+    slot->crcs[receivingBuffer] = crc;
+    slot->active = receivingBuffer;
+    slot->number = receivingNumber;
+    slot->committed = false;
+    portEXIT_CRITICAL(&uploadMux);
+    Serial.printf("UPLOAD_OK choreography %d, %u bytes, in slot %d\n", receivingNumber, (unsigned) receivingSize,
+        (int) (slot - uploadSlots) + 1);
+  }
+  endUpload();
+}
+
+// Go back to console commands after an upload, whether or not it worked
+void endUpload() {
+  receivingSlot = nullptr;
+  releaseLightSleep();
+}
+
+// The slot holding a choreography, or else a free slot, or nullptr if there are neither
+UploadSlot *findUploadSlot(int number) {
+  UploadSlot *free = nullptr;
+  for (UploadSlot &slot : uploadSlots) {
+    if (slot.number == number) {
+      return &slot;
+    }
+    if (slot.number == 0 && free == nullptr) {
+      free = &slot;
+    }
+  }
+  return free;
+}
+
+// True if data is a choreography we understand, which reads through to its end event
+bool isValidChoreography(const uint8_t *data, size_t size) {
+  ChoreographyReader reader;
+  if (!reader.begin(data, size)) {
+    return false;
+  }
+  ChoreographyEvent event;
+  while (reader.next(event)) {
+    if (event.action == CHOREOGRAPHY_ACTION_END) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Start reading the uploaded copy of a choreography. It stays in place until
+// releaseUploadedChoreography(), even if another upload replaces it meanwhile. Returns nullptr if
+// the choreography hasn't been uploaded.
+const uint8_t *acquireUploadedChoreography(int number, size_t &size) {
+  const uint8_t *data = nullptr;
+  portENTER_CRITICAL(&uploadMux);
+  for (UploadSlot &slot : uploadSlots) {
+    if (number != 0 && slot.number == number) {
+      slot.readers[slot.active]++;
+      data = slot.buffers[slot.active];
+      size = slot.sizes[slot.active];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&uploadMux);
+  return data;
+}
+
+// Finish reading an uploaded choreography, see acquireUploadedChoreography(). Anything else, like
+// a built-in choreography, is ignored.
+void releaseUploadedChoreography(const uint8_t *data) {
+  portENTER_CRITICAL(&uploadMux);
+  for (UploadSlot &slot : uploadSlots) {
+    for (int i = 0; i < 2; i++) {
+      if (data == slot.buffers[i] && slot.readers[i] > 0) {
+        slot.readers[i]--;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&uploadMux);
+}
+
+// Perform the first track that uses an uploaded choreography
+void playUploadedChoreography(int number) {
+  int tracknum = 0;
+  for (int i = 1; i <= getTrackCount() && tracknum == 0; i++) {
+    if (getTrack(i)->choreography == number) {
+      tracknum = i;
+    }
+  }
+  size_t size;
+  const uint8_t *data = acquireUploadedChoreography(number, size);
+  releaseUploadedChoreography(data);
+  if (data == nullptr) {
+    Serial.printf("UPLOAD_ERROR choreography %d isn't uploaded\n", number);
+  } else if (tracknum == 0) {
+    Serial.printf("UPLOAD_ERROR no track uses choreography %d\n", number);
+  } else if (!requestPerformance(tracknum)) {
+    Serial.println("UPLOAD_ERROR can't play during a performance");
+  } else {
+    Serial.printf("UPLOAD_OK playing track %d\n", tracknum);
+  }
+}
+
+// Write an uploaded choreography to its file on LittleFS, so it is kept through a reset. It is
+// written alongside first, then renamed over the old file, so a reset part way through can't leave
+// a broken file. Not done during a performance, as writing to flash stalls the other core.
+void commitUploadedChoreography(int number) {
+  if (isPerforming()) {
+    Serial.println("UPLOAD_ERROR can't commit during a performance");
+    return;
+  }
+  size_t size;
+  const uint8_t *data = acquireUploadedChoreography(number, size);
+  if (data == nullptr) {
+    Serial.printf("UPLOAD_ERROR choreography %d isn't uploaded\n", number);
+    return;
+  }
+  char path[32];
+  char newPath[36];
+  snprintf(path, sizeof(path), CHOREOGRAPHY_PATH_FORMAT, number);
+  snprintf(newPath, sizeof(newPath), "%s.new", path);
+  File file = LittleFS.open(newPath, "w", true);
+  bool written = file && file.write(data, size) == size;
+  if (file) {
+    file.close();
+  }
+  releaseUploadedChoreography(data);
+  if (!written || !LittleFS.rename(newPath, path)) {
+    LittleFS.remove(newPath);
+    Serial.printf("UPLOAD_ERROR couldn't write %s\n", path);
+    return;
+  }
+  UploadSlot *slot = findUploadSlot(number);
+  if (slot != nullptr && slot->number == number) {
+    slot->committed = true;
+  }
+  Serial.printf("UPLOAD_OK choreography %d committed to %s\n", number, path);
+}
+
+// Free the slot holding an uploaded choreography, going back to its file on LittleFS or its
+// built-in copy. A performance still reading it carries on.
+void clearUploadedChoreography(int number) {
+  UploadSlot *slot = findUploadSlot(number);
+  if (slot == nullptr || slot->number != number) {
+    Serial.printf("UPLOAD_ERROR choreography %d isn't uploaded\n", number);
+    return;
+  }
+  portENTER_CRITICAL(&uploadMux);
+  slot->number = 0;
+  portEXIT_CRITICAL(&uploadMux);
+  Serial.printf("UPLOAD_OK choreography %d cleared\n", number);
+}
+
+// Print what is in each slot over USB serial
+void reportUploadSlots() {
+  for (int i = 0; i < UPLOAD_SLOTS; i++) {
+    const UploadSlot &slot = uploadSlots[i];
+    if (slot.number == 0) {
+      Serial.printf("Slot %d: free\n", i + 1);
+    } else {
+      Serial.printf("Slot %d: choreography %d, %u bytes, CRC %08x, %s\n", i + 1, slot.number,
+          (unsigned) slot.sizes[slot.active], (unsigned) slot.crcs[slot.active],
+          slot.committed ? "committed to LittleFS" : "not committed");
+    }
+  }
+}
+
+// Add a byte to a CRC-32, the same one as zlib. Start with 0xFFFFFFFF and invert the result.
+uint32_t updateCrc32(uint32_t crc, uint8_t b) {
+  crc ^= b;
+  for (int i = 0; i < 8; i++) {
+    crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return crc;
+}
@@ -0,0 +1,34 @@
+// Big Mouth Phatt Bass choreography upload
+// by Ian Renton, 2024. CC Zero / Public Domain
+//
+// Loads a choreography into RAM over USB serial, so a routine can be tuned by editing its script
+// and performing it again within seconds, without rebuilding the filesystem or reflashing. While a
+// choreography is held in one of the UPLOAD_SLOTS slots, it is played in place of its file on
+// LittleFS and its built-in copy. Slots are lost on reset, unless committed to LittleFS.
+//
+// An upload is a console command followed by the raw contents of the .chr file:
+//
+//   upload <choreography> <bytes> <CRC-32 in hex>
+//
+// The fish replies UPLOAD_READY, then reads exactly that many bytes, and replies UPLOAD_OK or
+// UPLOAD_ERROR with the reason. The CRC is the usual one, as Python's zlib.crc32(). The data is
+// checked against it, and parsed through to its end event, before it is used. Each slot has two
+// buffers: the upload goes into the one not being performed, and only takes over once it has been
+// checked, so an upload can't corrupt a running performance, or leave half a choreography behind.
+//
+// Then "slot play <choreography>" performs the first track using it, "slot commit <choreography>"
+// writes it to LittleFS, and "slot clear <choreography>" frees the slot. These reply UPLOAD_OK or
+// UPLOAD_ERROR too. tools/choreo.py upload compiles a script and does all of this.
+
+#pragma once
+
+#include <Arduino.h>
+
+bool startUpload(int number, size_t size, uint32_t crc);
+bool pollUpload();
+const uint8_t *acquireUploadedChoreography(int number, size_t &size);
+void releaseUploadedChoreography(const uint8_t *data);
+void playUploadedChoreography(int number);
+void commitUploadedChoreography(int number);
+void clearUploadedChoreography(int number);
+void reportUploadSlots();
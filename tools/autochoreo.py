@@ -0,0 +1,274 @@
+#!/usr/bin/env python3
+# Big Mouth Phatt Bass choreography generator
+# by Ian Renton, 2024. CC Zero / Public Domain
+#
+# Generates choreography scripts for a folder of songs, so new tracks don't have to be timed by
+# hand. Each WAV file is analysed for its loudness envelope, the energy in the vocal band and the
+# onsets in the bass band. The mouth follows the vocal energy, the head turns out for each sung
+# phrase, and the tail bops on the bass beats in between. The output is an ordinary script for
+# tools/choreo.py, so it can be tweaked by hand afterwards.
+#
+# The SD card holds MP3s, so convert them first, e.g.:
+#   for f in 01/*.mp3; do ffmpeg -i "$f" -ac 1 "wav/$(basename "$f" .mp3).wav"; done
+#
+# WAV files are named after their track number, like the MP3s, e.g. "001.wav". Each gets a script
+# named "<track number>-<title>.txt", unless the track already has a script, which is left alone
+# unless --force is given, when it is overwritten under its existing name.
+#
+# Tracks are processed in parallel across all cores. Needs numpy.
+#
+# Usage:
+#   autochoreo.py [-j jobs] [--force] <wav folder> <script folder>
+
+import argparse
+import multiprocessing
+import os
+import sys
+import time
+import wave
+
+try:
+    import numpy as np
+except ImportError:
+    print("error: autochoreo.py needs numpy, try 'pip install numpy'", file=sys.stderr)
+    sys.exit(1)
+
+import choreo
+
+HOP_MS = 10                   # Analysis frame spacing
+CHUNK_FRAMES = 2048           # Frames analysed at once, to bound memory use on long tracks
+VOCAL_BAND_HZ = (300, 3000)
+BASS_BAND_HZ = (40, 150)
+MOUTH_OPEN_LEVEL = 0.5        # Fractions of the track's loud vocal level to open and close the mouth at
+MOUTH_CLOSE_LEVEL = 0.3
+MOUTH_MIN_MS = 80             # Shortest mouth movement the motor can follow
+VOCAL_RATIO = 0.35            # Share of the energy that must be in the vocal band to count as singing
+PHRASE_GAP_MS = 600           # Mouth movements closer than this are one phrase, with the head out
+HEAD_LEAD_MS = 100            # Head turns out this long before a phrase starts
+BOP_MIN_SPACING_MS = 250      # Closest two tail bops can be
+BOP_HOLD_MS = 150             # How long the tail stays out for each bop
+ONSET_WINDOW_MS = 500         # Onsets are picked against the average bass flux over this window
+ONSET_SENSITIVITY = 1.5       # and must stand out by this many standard deviations
+
+
+def read_wav(path):
+    """Read a PCM WAV file as mono float samples from -1 to 1, and its sample rate."""
+    with wave.open(path, "rb") as f:
+        channels = f.getnchannels()
+        width = f.getsampwidth()
+        rate = f.getframerate()
+        data = f.readframes(f.getnframes())
+    if width == 1:
+        samples = (np.frombuffer(data, dtype=np.uint8).astype(np.float32) - 128) / 128
+    elif width == 2:
+        samples = np.frombuffer(data, dtype="<i2").astype(np.float32) / 32768
+    elif width == 3:
+        raw = np.frombuffer(data, dtype=np.uint8).reshape(-1, 3)
+        ints = (raw[:, 0].astype(np.int32) | (raw[:, 1].astype(np.int32) << 8) | (raw[:, 2].astype(np.int32) << 16))
+        samples = ((ints ^ 0x800000) - 0x800000).astype(np.float32) / 8388608
+    elif width == 4:
+        samples = np.frombuffer(data, dtype="<i4").astype(np.float32) / 2147483648
+    else:
+        raise choreo.ChoreographyError("%s: unsupported sample width %d" % (path, width))
+    return samples.reshape(-1, channels).mean(axis=1), rate
+
+
+def analyse(samples, rate):
+    """Per-frame vocal band energy, total energy and bass band spectral flux."""
+    hop = rate * HOP_MS // 1000
+    size = 1 << int(np.ceil(np.log2(hop * 2)))
+    padded = np.concatenate([samples, np.zeros(size, dtype=np.float32)])
+    frames = np.lib.stride_tricks.sliding_window_view(padded, size)[::hop][:len(samples) // hop]
+    window = np.hanning(size).astype(np.float32)
+    freqs = np.fft.rfftfreq(size, 1.0 / rate)
+    vocal = (freqs >= VOCAL_BAND_HZ[0]) & (freqs < VOCAL_BAND_HZ[1])
+    bass = (freqs >= BASS_BAND_HZ[0]) & (freqs < BASS_BAND_HZ[1])
+
+    vocal_energy = np.empty(len(frames), dtype=np.float32)
+    total_energy = np.empty(len(frames), dtype=np.float32)
+    bass_magnitude = np.empty((len(frames), int(bass.sum())), dtype=np.float32)
+    for start in range(0, len(frames), CHUNK_FRAMES):
+        chunk = frames[start:start + CHUNK_FRAMES] * window
+        power = np.square(np.abs(np.fft.rfft(chunk, axis=1))).astype(np.float32)
+        vocal_energy[start:start + len(chunk)] = power[:, vocal].sum(axis=1)
+        total_energy[start:start + len(chunk)] = power.sum(axis=1)
+        bass_magnitude[start:start + len(chunk)] = np.sqrt(power[:, bass])
+
+    # Spectral flux: how much the bass spectrum grew since the previous frame
+    flux = np.zeros(len(frames), dtype=np.float32)
+    flux[1:] = np.maximum(np.diff(bass_magnitude, axis=0), 0).sum(axis=1)
+    return vocal_energy, total_energy, flux
+
+
+def mouth_periods(vocal_energy, total_energy):
+    """(start, end) frame ranges where the mouth should be open."""
+    singing = vocal_energy / np.maximum(total_energy, 1e-12) >= VOCAL_RATIO
+    loud = np.percentile(vocal_energy[singing], 95) if singing.any() else 0
+    if loud <= 0:
+        return []
+    envelope = np.sqrt(vocal_energy / loud)
+    min_frames = MOUTH_MIN_MS // HOP_MS
+
+    # Hysteresis is inherently sequential, but it's one comparison per frame
+    periods = []
+    start = None
+    last_change = -min_frames
+    for frame, value in enumerate(envelope):
+        if frame - last_change < min_frames:
+            continue
+        if start is None and value >= MOUTH_OPEN_LEVEL and singing[frame]:
+            start = last_change = frame
+        elif start is not None and value < MOUTH_CLOSE_LEVEL:
+            periods.append((start, frame))
+            start = None
+            last_change = frame
+    if start is not None:
+        periods.append((start, len(envelope)))
+    return periods
+
+
+def phrases(periods):
+    """Merge mouth periods with short gaps between them into sung phrases."""
+    merged = []
+    for start, end in periods:
+        if merged and start - merged[-1][1] < PHRASE_GAP_MS // HOP_MS:
+            merged[-1] = (merged[-1][0], end)
+        else:
+            merged.append((start, end))
+    return merged
+
+
+def onsets(flux):
+    """Frames where the bass flux stands out from its local average, i.e. the beats."""
+    width = max(ONSET_WINDOW_MS // HOP_MS, 1)
+    kernel = np.ones(width, dtype=np.float32) / width
+    mean = np.convolve(flux, kernel, mode="same")
+    deviation = np.sqrt(np.maximum(np.convolve(np.square(flux), kernel, mode="same") - np.square(mean), 0))
+    peak = np.zeros(len(flux), dtype=bool)
+    peak[1:-1] = (flux[1:-1] > flux[:-2]) & (flux[1:-1] >= flux[2:])
+    candidates = np.flatnonzero(peak & (flux > mean + ONSET_SENSITIVITY * deviation))
+    picked = []
+    for frame in candidates:
+        if not picked or frame - picked[-1] >= BOP_MIN_SPACING_MS // HOP_MS:
+            picked.append(frame)
+    return picked
+
+
+def choreograph(samples, rate):
+    """Work out the (time in ms, action name) events for a track, and its length in ms."""
+    vocal_energy, total_energy, flux = analyse(samples, rate)
+    periods = mouth_periods(vocal_energy, total_energy)
+    sung = phrases(periods)
+    events = []
+    for start, end in periods:
+        events.append((start * HOP_MS, "mouthOpen"))
+        events.append((end * HOP_MS, "mouthClose"))
+    for start, end in sung:
+        events.append((max(start * HOP_MS - HEAD_LEAD_MS, 0), "headOut"))
+        events.append((end * HOP_MS, "headTailRest"))
+
+    # Tail bops only in between phrases, not touching them, as head and tail share a motor
+    busy = [(max(start * HOP_MS - HEAD_LEAD_MS, 0), end * HOP_MS) for start, end in sung]
+    length = len(samples) * 1000 // rate
+    bops = 0
+    for frame in onsets(flux):
+        out = frame * HOP_MS
+        back = out + BOP_HOLD_MS
+        if back > length or any(out <= end and back >= start for start, end in busy):
+            continue
+        events.append((out, "tailOut"))
+        events.append((back, "headTailRest"))
+        bops += 1
+    events.sort(key=lambda event: event[0])
+    return events, length, len(periods), len(sung), bops
+
+
+def script_text(title, source, events, length):
+    lines = ["# %s" % title, "# Generated by tools/autochoreo.py from %s" % source, "", "length %d" % length, ""]
+    now = 0
+    for when, action in events:
+        if when > now:
+            lines.append("sleep %d" % (when - now))
+            now = when
+        lines.append(action)
+    lines.append("mouthRest")
+    return "\n".join(lines) + "\n"
+
+
+def process(job):
+    """Generate the script for one WAV file. Runs in a worker process."""
+    wav_path, script_path = job
+    started = time.perf_counter()
+    try:
+        samples, rate = read_wav(wav_path)
+        events, length, mouths, sung, bops = choreograph(samples, rate)
+        title = os.path.splitext(os.path.basename(wav_path))[0]
+        text = script_text(title, os.path.basename(wav_path), events, length)
+        # Make sure what we've written will compile before saving it
+        choreo.compile_script(text, script_path)
+        with open(script_path, "w") as f:
+            f.write(text)
+    except (choreo.ChoreographyError, wave.Error, EOFError) as e:
+        return wav_path, None, str(e), time.perf_counter() - started
+    summary = "%6.1f s audio, %4d mouth openings, %3d phrases, %3d bops" % (length / 1000, mouths, sung, bops)
+    return wav_path, summary, None, time.perf_counter() - started
+
+
+def script_name_for(wav_name, track):
+    """Name a new script as the hand-written ones are, "<track number>-<title>.txt", taking the title
+    from the rest of the WAV's name if there is any."""
+    title = os.path.splitext(wav_name)[0].lstrip("0123456789").lstrip(" -_.")
+    return "%03d-%s.txt" % (track, title) if title else "%03d.txt" % track
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Generate choreography scripts from WAV files.")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="worker processes (default: all cores)")
+    parser.add_argument("--force", action="store_true", help="overwrite existing scripts")
+    parser.add_argument("wav_folder")
+    parser.add_argument("script_folder")
+    args = parser.parse_args(argv[1:])
+
+    os.makedirs(args.script_folder, exist_ok=True)
+    try:
+        existing = {choreo.track_number(name): name for name in choreo.script_names(args.script_folder)}
+    except choreo.ChoreographyError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+    jobs = []
+    failures = 0
+    for name in sorted(os.listdir(args.wav_folder)):
+        if not name.lower().endswith(".wav"):
+            continue
+        try:
+            track = choreo.track_number(name)
+        except choreo.ChoreographyError:
+            failures += 1
+            print("%-32s error: WAV names must start with the track number" % name, file=sys.stderr)
+            continue
+        # Scripts are found by track number, as they are usually named with the title too
+        if track in existing and not args.force:
+            print("%-32s skipped, %s already exists" % (name, existing[track]))
+            continue
+        script_name = existing.get(track) or script_name_for(name, track)
+        jobs.append((os.path.join(args.wav_folder, name), os.path.join(args.script_folder, script_name)))
+
+    started = time.perf_counter()
+    busy = 0.0
+    with multiprocessing.Pool(max(args.jobs, 1)) as pool:
+        for wav_path, summary, error, elapsed in pool.imap_unordered(process, jobs):
+            busy += elapsed
+            if error:
+                failures += 1
+                print("%-32s error: %s" % (os.path.basename(wav_path), error), file=sys.stderr)
+            else:
+                print("%-32s %s in %.2f s" % (os.path.basename(wav_path), summary, elapsed))
+    wall = time.perf_counter() - started
+    if jobs:
+        print("%d tracks in %.2f s with %d workers, %.2f s per track, %.1fx parallel speedup"
+              % (len(jobs), wall, max(args.jobs, 1), busy / len(jobs), busy / wall if wall > 0 else 0))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,18 @@
+# Big Mouth Phatt Bass choreography build step
+# by Ian Renton, 2024. CC Zero / Public Domain
+#
+# PlatformIO pre-build script that compiles the choreography scripts into data/songs, ready for
+# "pio run -t uploadfs" to write them to the LittleFS partition, and into the built-in copy in
+# src/builtinchoreography.cpp that the firmware falls back on.
+
+import os
+import sys
+
+Import("env")
+
+project_dir = env.subst("$PROJECT_DIR")
+sys.path.insert(0, os.path.join(project_dir, "tools"))
+import choreo
+
+choreo.build_all(os.path.join(project_dir, "choreography"), os.path.join(project_dir, "data", "songs"))
+choreo.export_cpp(os.path.join(project_dir, "choreography"), os.path.join(project_dir, "src", "builtinchoreography.cpp"))
@@ -0,0 +1,634 @@
+#!/usr/bin/env python3
+# Big Mouth Phatt Bass choreography compiler
+# by Ian Renton, 2024. CC Zero / Public Domain
+#
+# Compiles the human-readable choreography scripts in the "choreography" folder into the binary
+# format played by the firmware (see src/choreography.h), and dumps binary files back out as a
+# timeline so playback can be checked. It also exports the scripts as C++ (see
+# src/choreographydsl.h), so they are built into the firmware as well.
+#
+# Script syntax is one statement per line, with "#" starting a comment. Statements mirror the
+# motor functions in the firmware, with times in millis:
+#
+#   sleep <time>
+#   headOut | tailOut | headTailRest | mouthOpen | mouthClose | mouthRest
+#   mouthOpen <amplitude>
+#   mouthOpenFor <runtime> [<amplitude>]
+#   flapMouthFor <runtime> <interval> [<amplitude>]
+#   flapMouthAndTailTogetherFor <runtime> <interval>
+#   flapHeadFor <runtime> <interval>
+#   flapTailFor <runtime> <interval>
+#   repeat <count> ... end
+#   length <time>                      The track's length, which every script must give. The
+#                                      choreography must fit in it, and ends with the track.
+#
+# A flap's runtime must be a whole number of flaps, each twice the interval. A motor can't be
+# moved two ways at the same moment, e.g. by mouthClose straight after mouthOpen. The exception is
+# a move that puts it straight back as it was, e.g. one mouthOpenFor straight after another, where
+# the close and the reopen cancel out and the mouth stays open, as the original firmware did.
+#
+# The mouth can be opened part of the way, with an amplitude from 10 to 100 percent, rounded to
+# the nearest 10.
+#
+# Bops can also be locked to the beat of the music rather than a fixed interval:
+#
+#   tempo <bpm> [<beats per bar>]      The beat starts now, at this tempo (bpm can be fractional)
+#   meter <beats per bar>              Bars start again from the next beat, at the same tempo
+#   bopHeadFor <runtime> [<beats>]     Head out on every <beats>th beat of the bar, back half way
+#   bopTailFor <runtime> [<beats>]     to the next bop
+#
+# Beat times are worked out from where the tempo was set, not from the previous bop, so however
+# long a section runs the moves stay on the beat to within a millisecond. A script that bops
+# without setting a tempo uses its track's tempo from data/tracks.csv (see src/tracks.h), or from
+# BUILTIN_TEMPOS if there is no such file, with the beat starting at the start of the track.
+#
+# Usage:
+#   choreo.py build <script.txt> <output.chr>
+#   choreo.py build-all <script folder> <output folder>
+#   choreo.py dump <file.chr>
+#   choreo.py cpp <script folder> <output.cpp>
+#   choreo.py upload <script.txt or file.chr> <serial port> [play] [commit]
+#
+# "upload" loads a choreography straight into the fish's RAM over USB serial (see src/upload.h),
+# then optionally performs it and writes it to the fish's flash, for tuning a routine without
+# reflashing. It needs pyserial. If the fish has deep slept, press the button first.
+
+import math
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"BMPC"
+VERSION = 1
+
+HEADTAIL_REST = 0x00
+HEAD_OUT = 0x01
+TAIL_OUT = 0x02
+MOUTH_REST = 0x10
+MOUTH_OPEN = 0x11
+MOUTH_CLOSE = 0x12
+MOUTH_OPEN_PARTLY = 0x20  # Low nibble is the amplitude in tenths, 1-9
+END = 0xFF
+
+ACTION_NAMES = {
+    HEADTAIL_REST: "headTailRest",
+    HEAD_OUT: "headOut",
+    TAIL_OUT: "tailOut",
+    MOUTH_REST: "mouthRest",
+    MOUTH_OPEN: "mouthOpen",
+    MOUTH_CLOSE: "mouthClose",
+    END: "end",
+}
+ACTIONS = {name: action for action, name in ACTION_NAMES.items() if action != END}
+ACTION_NAMES.update({MOUTH_OPEN_PARTLY | tenths: "mouthOpen %d" % (tenths * 10) for tenths in range(1, 10)})
+
+# Track registry that replaces the built-in track list, see src/tracks.h, and the tempos by
+# choreography number of the built-in list, as builtinTracks in src/tracks.cpp
+TRACK_REGISTRY_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir, "data", "tracks.csv")
+BUILTIN_TEMPOS = {1: 150, 8: 86}
+
+
+class ChoreographyError(Exception):
+    pass
+
+
+def actuator(action):
+    """Which motor an action moves: 0 for the head and tail, 1 for the mouth."""
+    return 1 if action & 0xF0 == MOUTH_OPEN_PARTLY else action >> 4
+
+
+class Timeline:
+    """Accumulates (time, action) events as a script is executed."""
+
+    def __init__(self, filename="<script>", tempo=None):
+        self.time = 0
+        self.events = []
+        # For each motor: the time of its last move, its state before that moment and after, and the
+        # line that moved it, to catch a motor moved two ways at once
+        self.moved_at = [None, None]
+        self.state_before = [HEADTAIL_REST, MOUTH_REST]
+        self.state = [HEADTAIL_REST, MOUTH_REST]
+        self.moved_line = [0, 0]
+        self.filename = filename
+        self.line = 0
+        self.length = None
+        self.tempo_start = None
+        self.beat_ms = None
+        self.beats_per_bar = 4
+        self.bar_origin = 0
+        if tempo:
+            self.tempo(tempo, 4)
+
+    def act(self, *actions):
+        for action in actions:
+            self.add(self.time, action)
+
+    def add(self, time, action):
+        # A second move at the same moment is only allowed if it puts the motor back as it was, like
+        # one mouthOpenFor straight after another. The two cancel out, and the motor never stops.
+        motor = actuator(action)
+        if time != self.moved_at[motor]:
+            self.moved_at[motor] = time
+            self.state_before[motor] = self.state[motor]
+        elif action != self.state[motor] and action != self.state_before[motor]:
+            raise ChoreographyError("%s:%d: moves the %s at %d ms, which line %d already moved another way"
+                                    % (self.filename, self.line, "mouth" if motor else "head/tail", time,
+                                       self.moved_line[motor]))
+        self.state[motor] = action
+        self.moved_line[motor] = self.line
+        self.events.append((time, action))
+
+    def sleep(self, duration):
+        self.time += duration
+
+    def flap(self, runtime, interval, out_actions, in_actions):
+        # Same rounding as the original firmware: runtime / interval / 2.0, truncated
+        runs = int((runtime // interval) / 2.0)
+        for _ in range(runs):
+            self.act(*out_actions)
+            self.sleep(interval)
+            self.act(*in_actions)
+            self.sleep(interval)
+
+    def tempo(self, bpm, beats_per_bar):
+        self.tempo_start = self.time
+        self.beat_ms = 60000.0 / bpm
+        self.beats_per_bar = beats_per_bar
+        self.bar_origin = 0
+
+    def meter(self, beats_per_bar):
+        self.bar_origin = self.next_beat(self.time)
+        self.beats_per_bar = beats_per_bar
+
+    def next_beat(self, time):
+        """Index of the first beat at or after a time, counting from where the tempo was set."""
+        return math.ceil((time - self.tempo_start) / self.beat_ms - 1e-9)
+
+    def bop(self, runtime, every, out_actions, in_actions):
+        # Each move is placed from its exact beat time and rounded on its own, so nothing accumulates
+        end = self.time + runtime
+        beat = self.next_beat(self.time)
+        while True:
+            out_time = self.tempo_start + beat * self.beat_ms
+            in_time = out_time + every * self.beat_ms / 2
+            if in_time > end:
+                break
+            if (beat - self.bar_origin) % self.beats_per_bar % every == 0:
+                for action in out_actions:
+                    self.add(max(round(out_time), self.time), action)
+                for action in in_actions:
+                    self.add(round(in_time), action)
+            beat += 1
+        self.time = end
+
+
+def parse(lines, filename):
+    """Parse script lines into a nested list of (line number, name, args) statements."""
+    root = []
+    stack = [root]
+    for number, line in enumerate(lines, 1):
+        line = line.split("#", 1)[0].strip()
+        if not line:
+            continue
+        words = line.split()
+        name = words[0]
+        try:
+            if name == "tempo" and len(words) > 1:
+                args = [float(words[1])] + [int(word) for word in words[2:]]
+            else:
+                args = [int(word) for word in words[1:]]
+        except ValueError:
+            raise ChoreographyError("%s:%d: arguments must be whole numbers, except the tempo" % (filename, number))
+        if any(arg < 0 for arg in args):
+            raise ChoreographyError("%s:%d: arguments must not be negative" % (filename, number))
+        if name == "repeat":
+            block = []
+            stack[-1].append((number, name, args, block))
+            stack.append(block)
+        elif name == "end":
+            if len(stack) == 1:
+                raise ChoreographyError("%s:%d: 'end' without 'repeat'" % (filename, number))
+            stack.pop()
+        else:
+            stack[-1].append((number, name, args, None))
+    if len(stack) != 1:
+        raise ChoreographyError("%s: 'repeat' without 'end'" % filename)
+    return root
+
+
+# Minimum and maximum number of arguments for each statement
+ARG_COUNTS = {
+    "sleep": (1, 1),
+    "repeat": (1, 1),
+    "length": (1, 1),
+    "mouthOpen": (0, 1),
+    "mouthOpenFor": (1, 2),
+    "flapMouthFor": (2, 3),
+    "flapMouthAndTailTogetherFor": (2, 2),
+    "flapHeadFor": (2, 2),
+    "flapTailFor": (2, 2),
+    "tempo": (1, 2),
+    "meter": (1, 1),
+    "bopHeadFor": (1, 2),
+    "bopTailFor": (1, 2),
+}
+
+
+def execute(statements, timeline, filename):
+    for number, name, args, block in statements:
+        least, most = ARG_COUNTS.get(name, (0, 0))
+        if name not in ARG_COUNTS and name not in ACTIONS:
+            raise ChoreographyError("%s:%d: unknown statement '%s'" % (filename, number, name))
+        if not least <= len(args) <= most:
+            if least == most:
+                raise ChoreographyError("%s:%d: '%s' takes %d argument(s)" % (filename, number, name, least))
+            raise ChoreographyError("%s:%d: '%s' takes %d to %d arguments" % (filename, number, name, least, most))
+        if name in ("flapMouthFor", "flapMouthAndTailTogetherFor", "flapHeadFor", "flapTailFor"):
+            if args[1] == 0:
+                raise ChoreographyError("%s:%d: interval must not be zero" % (filename, number))
+            if args[0] % (args[1] * 2):
+                raise ChoreographyError("%s:%d: runtime must be a multiple of twice the interval, e.g. %d"
+                                        % (filename, number, args[0] // (args[1] * 2) * args[1] * 2))
+        if name in ("tempo", "meter", "bopHeadFor", "bopTailFor") and 0 in args:
+            raise ChoreographyError("%s:%d: '%s' arguments must not be zero" % (filename, number, name))
+        if name in ("mouthOpen", "mouthOpenFor", "flapMouthFor") and len(args) == most and not 10 <= args[-1] <= 100:
+            raise ChoreographyError("%s:%d: amplitude must be 10 to 100 percent" % (filename, number))
+        if name in ("meter", "bopHeadFor", "bopTailFor") and timeline.beat_ms is None:
+            raise ChoreographyError("%s:%d: '%s' needs a 'tempo' first, or one for its track in tracks.csv"
+                                    % (filename, number, name))
+
+        timeline.line = number
+        if name == "repeat":
+            for _ in range(args[0]):
+                execute(block, timeline, filename)
+        elif name == "length":
+            timeline.length = args[0]
+        elif name == "sleep":
+            timeline.sleep(args[0])
+        elif name == "mouthOpen" and args:
+            timeline.act(mouth_open_action(args[0]))
+        elif name == "mouthOpenFor":
+            timeline.act(mouth_open_action(args[1] if len(args) > 1 else 100))
+            timeline.sleep(args[0])
+            timeline.act(MOUTH_CLOSE)
+        elif name == "flapMouthFor":
+            timeline.flap(args[0], args[1], [mouth_open_action(args[2] if len(args) > 2 else 100)], [MOUTH_CLOSE])
+        elif name == "flapMouthAndTailTogetherFor":
+            timeline.flap(args[0], args[1], [MOUTH_OPEN, TAIL_OUT], [MOUTH_CLOSE, HEADTAIL_REST])
+        elif name == "flapHeadFor":
+            timeline.flap(args[0], args[1], [HEAD_OUT], [HEADTAIL_REST])
+        elif name == "flapTailFor":
+            timeline.flap(args[0], args[1], [TAIL_OUT], [HEADTAIL_REST])
+        elif name == "tempo":
+            timeline.tempo(args[0], args[1] if len(args) > 1 else 4)
+        elif name == "meter":
+            timeline.meter(args[0])
+        elif name == "bopHeadFor":
+            timeline.bop(args[0], args[1] if len(args) > 1 else 1, [HEAD_OUT], [HEADTAIL_REST])
+        elif name == "bopTailFor":
+            timeline.bop(args[0], args[1] if len(args) > 1 else 1, [TAIL_OUT], [HEADTAIL_REST])
+        else:
+            timeline.act(ACTIONS[name])
+
+
+def mouth_open_action(amplitude):
+    """The action to open the mouth to an amplitude in percent, rounded to the nearest 10."""
+    tenths = int(amplitude / 10 + 0.5)
+    return MOUTH_OPEN if tenths >= 10 else MOUTH_OPEN_PARTLY | tenths
+
+
+def run_script(text, filename="<script>", tempo=None):
+    """Execute a choreography script, checking it fits in the track's length. The tempo, if given,
+    is the track's, for bops before the script sets its own."""
+    timeline = Timeline(filename, tempo)
+    execute(parse(text.splitlines(), filename), timeline, filename)
+    if timeline.length is None:
+        raise ChoreographyError("%s: needs a 'length' giving the track's length, for the choreography to fit in"
+                                % filename)
+    if timeline.time > timeline.length:
+        raise ChoreographyError("%s: choreography runs for %d ms, longer than the track's %d ms"
+                                % (filename, timeline.time, timeline.length))
+    return timeline
+
+
+def compile_script(text, filename="<script>", tempo=None):
+    """Compile a choreography script into the binary file format. The end event is at the end of
+    the track."""
+    timeline = run_script(text, filename, tempo)
+    timeline.events.append((timeline.length, END))
+    return encode(timeline.events)
+
+
+def check_action(action):
+    """Fail if an action is a partial mouth opening with an amplitude the firmware refuses."""
+    if action & 0xF0 == MOUTH_OPEN_PARTLY and not 1 <= action & 0x0F <= 9:
+        raise ChoreographyError("action 0x%02x: a partial mouth opening must be 1-9 tenths" % action)
+
+
+def encode(events):
+    """Encode a list of (absolute time, action) events, ending with END, into the binary file format."""
+    duration = events[-1][0]
+    out = bytearray(MAGIC + struct.pack("<B3xI", VERSION, duration))
+    last = 0
+    for time, action in events:
+        delta = time - last
+        last = time
+        while True:
+            byte = delta & 0x7F
+            delta >>= 7
+            if delta:
+                out.append(byte | 0x80)
+            else:
+                out.append(byte)
+                break
+        check_action(action)
+        out.append(action)
+    return bytes(out)
+
+
+def decode(data):
+    """Decode the binary file format into its duration and a list of (absolute time, action) events."""
+    if len(data) < 12 or data[:4] != MAGIC:
+        raise ChoreographyError("not a choreography file")
+    version, duration = struct.unpack("<B3xI", data[4:12])
+    if version != VERSION:
+        raise ChoreographyError("unsupported version %d" % version)
+    events = []
+    time = 0
+    pos = 12
+    while pos < len(data):
+        delta = 0
+        shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            delta |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        time += delta
+        check_action(data[pos])
+        events.append((time, data[pos]))
+        pos += 1
+    return duration, events
+
+
+def output_name(script_name):
+    """Scripts are named "<track number>-<title>.txt" and compile to "<track number>.chr"."""
+    match = re.match(r"(\d+)", script_name)
+    if not match:
+        raise ChoreographyError("%s: script names must start with the track number" % script_name)
+    return "%03d.chr" % int(match.group(1))
+
+
+def track_number(script_name):
+    """The track number a script or .chr file is named after."""
+    return int(output_name(script_name)[:3])
+
+
+def script_names(script_dir):
+    """The scripts in a folder, in order. Fails if two have the same track number, as they would
+    compile to the same file."""
+    names = sorted(name for name in os.listdir(script_dir) if name.endswith(".txt"))
+    tracks = {}
+    for name in names:
+        track = track_number(name)
+        if track in tracks:
+            raise ChoreographyError("%s and %s are both for track %d" % (tracks[track], name, track))
+        tracks[track] = name
+    return names
+
+
+def track_tempos(path=TRACK_REGISTRY_PATH):
+    """The tempo of each choreography number, from the track registry if there is one, otherwise
+    the built-in list. Choreographies shared by tracks with different tempos get none."""
+    if not os.path.exists(path):
+        return dict(BUILTIN_TEMPOS)
+    tempos = {}
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            try:
+                fields = [int(field) for field in line.split(",")]
+            except ValueError:
+                fields = []
+            if len(fields) != 7:
+                raise ChoreographyError("%s:%d: expected folder, file, announcer folder, announcer file, "
+                                        "choreography, volume, tempo" % (path, number))
+            choreography, tempo = fields[4], fields[6]
+            if choreography and tempo:
+                tempos[choreography] = tempo if tempos.get(choreography, tempo) == tempo else 0
+    return tempos
+
+
+def build(script_path, output_path, tempos=None):
+    if tempos is None:
+        tempos = track_tempos()
+    match = re.match(r"(\d+)", os.path.basename(script_path))
+    with open(script_path) as f:
+        data = compile_script(f.read(), script_path, tempos.get(int(match.group(1))) if match else None)
+    with open(output_path, "wb") as f:
+        f.write(data)
+    return data
+
+
+def build_all(script_dir, output_dir):
+    os.makedirs(output_dir, exist_ok=True)
+    tempos = track_tempos()
+    for name in script_names(script_dir):
+        build(os.path.join(script_dir, name), os.path.join(output_dir, output_name(name)), tempos)
+
+
+# C++ step for each plain action, see src/choreographydsl.h
+DSL_ACTIONS = {HEADTAIL_REST: "headTailRest()", HEAD_OUT: "headOut()", TAIL_OUT: "tailOut()",
+               MOUTH_REST: "mouthRest()", MOUTH_OPEN: "mouthOpen()", MOUTH_CLOSE: "mouthClose()"}
+DSL_ACTIONS.update({MOUTH_OPEN_PARTLY | tenths: "mouthOpen(%d)" % (tenths * 10) for tenths in range(1, 10)})
+
+
+def export_steps(statements, timeline, lines, filename, indent, in_repeat=False):
+    """C++ step lines for a script's statements, executing them on the timeline as we go so
+    beat-locked bops can be written out as the moves they make."""
+    out = []
+    for number, name, args, block in statements:
+        comment = lines[number - 1].split("#", 1)[1].strip() if "#" in lines[number - 1] else None
+        steps = []
+        if name == "repeat":
+            out.append("%srepeat(%d),%s" % (indent, args[0], " // " + comment if comment else ""))
+            for count in range(args[0]):
+                inner = export_steps(block, timeline, lines, filename, indent + "  ", True)
+            if args[0] == 0:
+                inner = export_steps(block, Timeline(filename), lines, filename, indent + "  ", True)
+            out.extend(inner)
+            out.append("%send()," % indent)
+            continue
+        if name in ("bopHeadFor", "bopTailFor"):
+            if in_repeat:
+                raise ChoreographyError("%s:%d: can't export a bop inside a repeat" % (filename, number))
+            start, first = timeline.time, len(timeline.events)
+            execute([(number, name, args, block)], timeline, filename)
+            cursor = start
+            for time, action in timeline.events[first:]:
+                if time > cursor:
+                    steps.append("sleep(%d)" % (time - cursor))
+                    cursor = time
+                steps.append(DSL_ACTIONS[action])
+            if timeline.time > cursor:
+                steps.append("sleep(%d)" % (timeline.time - cursor))
+            comment = "%s %s, expanded%s" % (name, " ".join(str(arg) for arg in args), ": " + comment if comment else "")
+        else:
+            execute([(number, name, args, block)], timeline, filename)
+            if name in ("tempo", "meter", "length"):
+                comment = lines[number - 1].split("#", 1)[0].strip() + (": " + comment if comment else "")
+            elif name in ACTIONS or name == "mouthOpen":
+                steps.append(DSL_ACTIONS[timeline.events[-1][1]])
+            else:
+                steps.append("%s(%s)" % (name, ", ".join(str(arg) for arg in args)))
+        if not steps:
+            out.append("%s// %s" % (indent, comment))
+            continue
+        for i, step in enumerate(steps):
+            out.append("%s%s,%s" % (indent, step, " // " + comment if comment and i == 0 else ""))
+    return out
+
+
+def export_cpp(script_dir, output_path):
+    """Write every script as built-in choreography for the firmware, see src/choreographydsl.h. The
+    file is only rewritten if it has changed, so the firmware isn't rebuilt for nothing."""
+    songs = []
+    text = ["// Big Mouth Phatt Bass built-in choreography, generated by tools/choreo.py from the scripts in",
+            "// the \"choreography\" folder. Don't edit it; it's regenerated from the scripts on every build.",
+            "",
+            "#include \"choreographydsl.h\"",
+            "",
+            "namespace dsl {"]
+    tempos = track_tempos()
+    for name in script_names(script_dir):
+        with open(os.path.join(script_dir, name)) as f:
+            lines = f.read().splitlines()
+        track = track_number(name)
+        # For the checks, with line numbers, and the track's length for the firmware's to check against
+        length = run_script("\n".join(lines), name, tempos.get(track)).length
+        steps = export_steps(parse(lines, name), Timeline(name, tempos.get(track)), lines, name, "  ")
+        songs.append((track, length))
+        text += ["", "// %s" % name, "constexpr Step track%03d[] = {" % track] + steps + ["};"]
+    text += ["", "} // namespace dsl", ""]
+    for track, length in songs:
+        text.append("BUILTIN_CHOREOGRAPHY(track%03d, %d);" % (track, length))
+    text += ["", "const BuiltinChoreography builtinChoreographies[] = {"]
+    for track, length in songs:
+        text.append("  { %d, track%03dData.data(), track%03dData.size() }," % (track, track, track))
+    text += ["};",
+             "const size_t builtinChoreographyCount = sizeof(builtinChoreographies) / sizeof(builtinChoreographies[0]);",
+             ""]
+    text = "\n".join(text)
+    if os.path.exists(output_path):
+        with open(output_path) as f:
+            if f.read() == text:
+                return
+    with open(output_path, "w") as f:
+        f.write(text)
+
+
+SERIAL_BAUD_RATE = 115200  # As SERIAL_BAUD_RATE in src/config.h
+UPLOAD_REPLY_TIMEOUT = 5  # Seconds
+
+
+def upload(path, port, play=False, commit=False):
+    """Upload a script, compiling it first, or a .chr file, into a RAM slot on the fish over USB
+    serial, then optionally perform it and commit it to the fish's flash."""
+    try:
+        import serial
+    except ImportError:
+        raise ChoreographyError("uploading needs pyserial: pip install pyserial")
+    number = track_number(os.path.basename(path))
+    if path.endswith(".chr"):
+        with open(path, "rb") as f:
+            data = f.read()
+        decode(data)  # Check it before the fish does
+    else:
+        with open(path) as f:
+            data = compile_script(f.read(), path, track_tempos().get(number))
+
+    # Opening the port normally resets the ESP32 through DTR and RTS, which would lose the slots
+    fish = serial.Serial()
+    fish.port = port
+    fish.baudrate = SERIAL_BAUD_RATE
+    fish.timeout = UPLOAD_REPLY_TIMEOUT
+    fish.dtr = False
+    fish.rts = False
+    try:
+        fish.open()
+    except serial.SerialException as e:
+        raise ChoreographyError(str(e))
+    with fish:
+        upload_command(fish, "upload %d %d %08x" % (number, len(data), zlib.crc32(data)), "UPLOAD_READY")
+        fish.write(data)
+        print(upload_reply(fish, "UPLOAD_OK"))
+        if commit:
+            print(upload_command(fish, "slot commit %d" % number, "UPLOAD_OK"))
+        if play:
+            print(upload_command(fish, "slot play %d" % number, "UPLOAD_OK"))
+
+
+def upload_command(fish, command, expected):
+    """Send a console command, first waking the fish from light sleep, which loses what woke it,
+    and wait for its reply."""
+    fish.reset_input_buffer()
+    fish.write(b"\r\n\r\n")
+    time.sleep(0.1)
+    fish.write(command.encode() + b"\n")
+    return upload_reply(fish, expected)
+
+
+def upload_reply(fish, expected):
+    """Read the fish's log until it replies to an upload command, skipping anything else."""
+    while True:
+        line = fish.readline().decode(errors="replace").strip()
+        if not line:
+            raise ChoreographyError("no reply from the fish, press its button to wake it")
+        if line.startswith("UPLOAD_ERROR"):
+            raise ChoreographyError(line[len("UPLOAD_ERROR "):])
+        if line.startswith(expected):
+            return line
+
+
+def dump(path):
+    with open(path, "rb") as f:
+        duration, events = decode(f.read())
+    print("# duration %d ms, %d events" % (duration, len(events)))
+    for time, action in events:
+        print("%8d %s" % (time, ACTION_NAMES.get(action, "0x%02x" % action)))
+
+
+def main(argv):
+    try:
+        if len(argv) == 4 and argv[1] == "build":
+            build(argv[2], argv[3])
+        elif len(argv) == 4 and argv[1] == "build-all":
+            build_all(argv[2], argv[3])
+        elif len(argv) == 3 and argv[1] == "dump":
+            dump(argv[2])
+        elif len(argv) == 4 and argv[1] == "cpp":
+            export_cpp(argv[2], argv[3])
+        elif 4 <= len(argv) <= 6 and argv[1] == "upload" and set(argv[4:]) <= {"play", "commit"}:
+            upload(argv[2], argv[3], "play" in argv[4:], "commit" in argv[4:])
+        else:
+            print("usage: choreo.py build <script.txt> <output.chr>\n"
+                  "       choreo.py build-all <script folder> <output folder>\n"
+                  "       choreo.py dump <file.chr>\n"
+                  "       choreo.py cpp <script folder> <output.cpp>\n"
+                  "       choreo.py upload <script.txt or file.chr> <serial port> [play] [commit]", file=sys.stderr)
+            return 2
+    except ChoreographyError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+# Big Mouth Phatt Bass trace converter
+# by Ian Renton, 2024. CC Zero / Public Domain
+#
+# Converts a trace dumped by the firmware (the "trace" console command over USB serial, see
+# src/trace.h) into Chrome trace event JSON, which can be opened in https://ui.perfetto.dev or
+# chrome://tracing to see a whole performance on a timeline: how long each motor was driven, when
+# each MP3 command was queued, sent and answered, and when each core was waiting or asleep and how
+# late it woke.
+#
+# The input is a saved serial log, e.g. from "pio device monitor | tee fish.log". Other lines in
+# the log are ignored, and if it holds several dumps the last one is used.
+#
+# Usage:
+#   trace2chrome.py <serial log> <output.json>
+
+import json
+import re
+import sys
+
+# Event types and wait kinds, as in src/trace.h
+MOTOR, MP3_QUEUED, MP3_SENT, MP3_RECEIVED, WAIT_START, WAIT_END, LATE, PERFORMANCE_START, PERFORMANCE_END = range(9)
+WAIT_NAMES = ["task delay", "light sleep", "light sleep until button", "spin"]
+
+# Motor actions, as in src/choreography.h, by actuator then state
+MOTOR_STATES = {0x0: {0x0: None, 0x1: "headOut", 0x2: "tailOut"}, 0x1: {0x0: None, 0x1: "open", 0x2: "close"}}
+
+MP3_COMMAND_NAMES = {
+    0x06: "volume", 0x0F: "play", 0x11: "repeat", 0x16: "stop",
+    0x3D: "track finished", 0x40: "error", 0x41: "ack",
+}
+MP3_FRAME_US = 10 * 10 * 1000000 // 9600  # 10 byte frame at MP3_PLAYER_BAUD_RATE, 8N1
+
+# Timeline rows
+PID = 1
+HEADTAIL_TID, MOUTH_TID, MP3_TID, PERFORMANCE_TID, CORE_TID = 1, 2, 3, 4, 10
+ROW_NAMES = {HEADTAIL_TID: "head/tail motor", MOUTH_TID: "mouth motor", MP3_TID: "MP3 player",
+             PERFORMANCE_TID: "performance", CORE_TID: "core 0", CORE_TID + 1: "core 1"}
+
+LINE = re.compile(r"TRACE(_BEGIN|_END)?,?([0-9,]*)")
+
+
+def read_dump(lines):
+    """The (time us, core, type, arg8, arg16) events of the last complete dump in a log."""
+    dump = None
+    current = None
+    for line in lines:
+        match = LINE.search(line)
+        if not match:
+            continue
+        kind, fields = match.group(1), match.group(2)
+        if kind == "_BEGIN":
+            current = []
+        elif kind == "_END":
+            if current is not None:
+                dump = current
+            current = None
+        elif current is not None:
+            values = [int(v) for v in fields.split(",") if v]
+            if len(values) == 5:
+                current.append(tuple(values))
+    if dump is None:
+        raise ValueError("no complete trace dump found (TRACE_BEGIN ... TRACE_END)")
+    return dump
+
+
+def unwrap(events):
+    """Extend the 32 bit times to 64 bits, assuming events are never more than 35 minutes apart."""
+    result = []
+    offset = 0
+    previous = None
+    for time, core, kind, arg8, arg16 in events:
+        if previous is not None and time + offset < previous - (1 << 31):
+            offset += 1 << 32
+        previous = time + offset
+        result.append((time + offset, core, kind, arg8, arg16))
+    # Events from the two cores can land in the buffer slightly out of time order
+    result.sort(key=lambda event: event[0])
+    return result
+
+
+def mp3_name(command, data):
+    return "%s %d" % (MP3_COMMAND_NAMES.get(command, "0x%02x" % command), data)
+
+
+def convert(events):
+    trace = []
+
+    def span(tid, name, start, end, args=None):
+        trace.append({"name": name, "ph": "X", "pid": PID, "tid": tid, "ts": start, "dur": max(end - start, 1),
+                      "args": args or {}})
+
+    def instant(tid, name, time, args=None):
+        trace.append({"name": name, "ph": "i", "s": "t", "pid": PID, "tid": tid, "ts": time, "args": args or {}})
+
+    motors = {}        # Actuator -> (state name, since)
+    waits = {}         # Core -> (kind, since, planned ms)
+    performance = None  # (track, since)
+    for time, core, kind, arg8, arg16 in events:
+        if kind == MOTOR:
+            actuator, state = arg8 >> 4, arg8 & 0x0F
+            tid = HEADTAIL_TID if actuator == 0 else MOUTH_TID
+            if actuator in motors:
+                name, since = motors.pop(actuator)
+                span(tid, name, since, time)
+            name = MOTOR_STATES.get(actuator, {}).get(state, "0x%02x" % arg8)
+            if name and 0 < arg16 < 100:
+                name += " %d%%" % arg16
+            if name:
+                motors[actuator] = (name, time)
+        elif kind == MP3_QUEUED:
+            instant(MP3_TID, "queued " + mp3_name(arg8, arg16), time)
+        elif kind == MP3_SENT:
+            span(MP3_TID, "sent " + mp3_name(arg8, arg16), time, time + MP3_FRAME_US)
+        elif kind == MP3_RECEIVED:
+            instant(MP3_TID, "received " + mp3_name(arg8, arg16), time)
+        elif kind == WAIT_START:
+            waits[core] = (arg8, time, arg16)
+        elif kind == WAIT_END and core in waits:
+            wait, since, planned = waits.pop(core)
+            span(CORE_TID + core, WAIT_NAMES[wait] if wait < len(WAIT_NAMES) else "wait", since, time,
+                 {"planned_ms": planned})
+        elif kind == LATE:
+            instant(CORE_TID + core, "late %d us" % arg16, time, {"late_us": arg16})
+        elif kind == PERFORMANCE_START:
+            performance = (arg16, time)
+        elif kind == PERFORMANCE_END and performance:
+            span(PERFORMANCE_TID, "track %d" % performance[0], performance[1], time)
+            performance = None
+
+    # Anything still going at the end of the dump
+    end = events[-1][0] if events else 0
+    for actuator, (name, since) in motors.items():
+        span(HEADTAIL_TID if actuator == 0 else MOUTH_TID, name, since, end)
+    if performance:
+        span(PERFORMANCE_TID, "track %d" % performance[0], performance[1], end)
+
+    trace.append({"name": "process_name", "ph": "M", "pid": PID, "args": {"name": "Big Mouth Billy Bass"}})
+    for tid, name in ROW_NAMES.items():
+        trace.append({"name": "thread_name", "ph": "M", "pid": PID, "tid": tid, "args": {"name": name}})
+        trace.append({"name": "thread_sort_index", "ph": "M", "pid": PID, "tid": tid, "args": {"sort_index": tid}})
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}
+
+
+def main(argv):
+    if len(argv) != 3:
+        print("usage: trace2chrome.py <serial log> <output.json>", file=sys.stderr)
+        return 2
+    try:
+        with open(argv[1], errors="replace") as f:
+            events = unwrap(read_dump(f))
+    except (OSError, ValueError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+    with open(argv[2], "w") as f:
+        json.dump(convert(events), f)
+    print("%d events, %.1f s" % (len(events), (events[-1][0] - events[0][0]) / 1e6 if events else 0))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))